@@ -0,0 +1,260 @@
+///////////////////////////////////////////////////////////////////////////////
+// AssetPack.cpp
+// =============
+// Memory mapped pack of the startup assets (see AssetPack.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "AssetPack.h"
+#include "ContentHash.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const char PACK_MAGIC[4] = { 'A', 'P', 'A', 'K' };
+const unsigned int PACK_VERSION = 1;
+const size_t HEADER_SIZE = 24;
+const size_t ASSET_ALIGNMENT = 4096;        // a page, reading one asset never faults in its neighbours
+const size_t MAX_NAME_LENGTH = 1024;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// little endian values
+///////////////////////////////////////////////////////////////////////////////
+static void writeValue(std::vector<unsigned char>& out, unsigned long long value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out.push_back((unsigned char)((value >> (i * 8)) & 0xff));
+}
+
+static bool readValue(const unsigned char*& p, const unsigned char* end, unsigned long long& value, int bytes)
+{
+    value = 0;
+    if (end - p < bytes)
+        return false;
+    for (int i = 0; i < bytes; ++i)
+        value |= (unsigned long long)*p++ << (i * 8);
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/open/close
+///////////////////////////////////////////////////////////////////////////////
+AssetPack::AssetPack() : mapped(nullptr), mappedSize(0), fileHandle(nullptr), mappingHandle(nullptr)
+{
+}
+
+bool AssetPack::open(const char* filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER fileSize;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        printf("Failed to open asset pack %s\n", filename);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    mapped = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedSize = (size_t)fileSize.QuadPart;
+#else
+    int file = ::open(filename, O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        if (file >= 0)
+            ::close(file);
+        printf("Failed to open asset pack %s\n", filename);
+        return false;
+    }
+    // the mapping keeps the file alive
+    void* address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    mapped = (address == MAP_FAILED) ? nullptr : (const unsigned char*)address;
+    mappedSize = (size_t)status.st_size;
+#endif
+    if (!mapped)
+    {
+        close();
+        printf("Failed to map asset pack %s\n", filename);
+        return false;
+    }
+
+    // header and index; the assets themselves are not touched
+    const unsigned char* p = mapped;
+    const unsigned char* end = mapped + mappedSize;
+    unsigned long long version = 0, count = 0, indexSize = 0, indexHash = 0;
+    bool ok = mappedSize >= HEADER_SIZE && memcmp(p, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0;
+    p += ok ? sizeof(PACK_MAGIC) : 0;
+    ok = ok && readValue(p, end, version, 4) && version == PACK_VERSION &&
+         readValue(p, end, count, 4) && readValue(p, end, indexSize, 4) && readValue(p, end, indexHash, 8) &&
+         indexSize <= (unsigned long long)(end - p) && hashContent(p, (size_t)indexSize) == indexHash;
+
+    end = p + (ok ? (size_t)indexSize : 0);
+    for (unsigned long long i = 0; ok && i < count; ++i)
+    {
+        unsigned long long nameLength = 0, offset = 0, size = 0, hash = 0;
+        ok = readValue(p, end, nameLength, 4) && nameLength <= MAX_NAME_LENGTH &&
+             nameLength <= (unsigned long long)(end - p);
+        if (!ok)
+            break;
+        Entry entry;
+        entry.name.assign((const char*)p, (size_t)nameLength);
+        p += nameLength;
+        ok = readValue(p, end, offset, 8) && readValue(p, end, size, 8) && readValue(p, end, hash, 8) &&
+             offset <= mappedSize && size <= mappedSize - offset;
+        entry.offset = (size_t)offset;
+        entry.size = (size_t)size;
+        entry.hash = hash;
+        entries.push_back(entry);
+    }
+    if (!ok)
+    {
+        close();
+        printf("Asset pack %s is corrupt or of another version\n", filename);
+        return false;
+    }
+    return true;
+}
+
+void AssetPack::close()
+{
+#ifdef _WIN32
+    if (mapped)
+        UnmapViewOfFile(mapped);
+    if (mappingHandle)
+        CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle)
+        CloseHandle((HANDLE)fileHandle);
+#else
+    if (mapped)
+        munmap((void*)mapped, mappedSize);
+#endif
+    mapped = nullptr;
+    mappedSize = 0;
+    fileHandle = mappingHandle = nullptr;
+    entries.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// lookup
+///////////////////////////////////////////////////////////////////////////////
+bool AssetPack::find(const std::string& name, AssetView& view) const
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].name != name)
+            continue;
+        view.data = mapped + entries[i].offset;
+        view.size = entries[i].size;
+        view.hash = entries[i].hash;
+        return true;
+    }
+    return false;
+}
+
+bool AssetPack::verify(const AssetView& view)
+{
+    return hashContent(view.data, view.size) == view.hash;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// writer
+///////////////////////////////////////////////////////////////////////////////
+bool AssetPackWriter::addFile(const std::string& name)
+{
+    FILE* file = fopen(name.c_str(), "rb");
+    if (!file)
+    {
+        printf("Failed to read asset %s\n", name.c_str());
+        return false;
+    }
+    Asset asset;
+    asset.name = name;
+    unsigned char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        asset.data.insert(asset.data.end(), buffer, buffer + count);
+    fclose(file);
+    assets.push_back(asset);
+    return true;
+}
+
+bool AssetPackWriter::write(const char* filename) const
+{
+    // the index size is known before the offsets, the offsets before the index is written
+    size_t indexSize = 0;
+    for (size_t i = 0; i < assets.size(); ++i)
+        indexSize += 4 + assets[i].name.size() + 8 + 8 + 8;
+    std::vector<size_t> offsets(assets.size());
+    size_t offset = HEADER_SIZE + indexSize;
+    for (size_t i = 0; i < assets.size(); ++i)
+    {
+        offset = (offset + ASSET_ALIGNMENT - 1) / ASSET_ALIGNMENT * ASSET_ALIGNMENT;
+        offsets[i] = offset;
+        offset += assets[i].data.size();
+    }
+
+    std::vector<unsigned char> index;
+    for (size_t i = 0; i < assets.size(); ++i)
+    {
+        const Asset& asset = assets[i];
+        writeValue(index, asset.name.size(), 4);
+        index.insert(index.end(), asset.name.begin(), asset.name.end());
+        writeValue(index, offsets[i], 8);
+        writeValue(index, asset.data.size(), 8);
+        writeValue(index, hashContent(asset.data.data(), asset.data.size()), 8);
+    }
+    std::vector<unsigned char> header(PACK_MAGIC, PACK_MAGIC + sizeof(PACK_MAGIC));
+    writeValue(header, PACK_VERSION, 4);
+    writeValue(header, assets.size(), 4);
+    writeValue(header, index.size(), 4);
+    writeValue(header, hashContent(index.data(), index.size()), 8);
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("Failed to write asset pack %s\n", filename);
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+              fwrite(index.data(), 1, index.size(), file) == index.size();
+    size_t position = header.size() + index.size();
+    const unsigned char padding[ASSET_ALIGNMENT] = {};
+    for (size_t i = 0; ok && i < assets.size(); ++i)
+    {
+        ok = fwrite(padding, 1, offsets[i] - position, file) == offsets[i] - position &&
+             fwrite(assets[i].data.data(), 1, assets[i].data.size(), file) == assets[i].data.size();
+        position = offsets[i] + assets[i].data.size();
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        printf("Failed to write asset pack %s\n", filename);
+    return ok;
+}
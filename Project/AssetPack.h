@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// AssetPack.h
+// ===========
+// All the files the program loads at startup, in one file that is memory
+// mapped instead of opened and read file by file.
+// The pack is little endian:
+//   "APAK", version, asset count, index byte size, content hash of the index,
+//   per asset: name length, name, offset, byte size, content hash,
+//   then the contents of every asset, each starting on a page boundary.
+// Assets are named by the path the program opens them with outside the pack,
+// e.g. ../resources/textures/wood.jpg, so a loader falls back to the file
+// when the pack lacks it. find() only looks at the index and hands out a view
+// into the mapping: the pages of an asset are faulted in when its contents
+// are read, and assets that are never read, such as the source image of a
+// texture that has its compiled version in the pack, cost nothing.
+// The index is checked when the pack is opened; a loader checks an asset
+// with verify() when it reads it anyway.
+// AssetPackWriter builds a pack (see --pack-assets).
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct AssetView
+{
+    const unsigned char* data;              // into the mapping, valid while the pack is open
+    size_t size;
+    unsigned long long hash;                // of the contents, from the index (see ContentHash.h)
+};
+
+class AssetPack
+{
+public:
+    AssetPack();
+    ~AssetPack()                            { close(); }
+
+    bool open(const char* filename);        // maps the file and checks the index
+    void close();
+    bool isOpen() const                     { return mapped != nullptr; }
+
+    bool find(const std::string& name, AssetView& view) const;
+    // hashes the contents and compares with the index, reading every page
+    static bool verify(const AssetView& view);
+
+    int getAssetCount() const               { return (int)entries.size(); }
+    size_t getSize() const                  { return mappedSize; }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        size_t offset;
+        size_t size;
+        unsigned long long hash;
+    };
+
+    const unsigned char* mapped;
+    size_t mappedSize;
+    void* fileHandle;                       // Windows only
+    void* mappingHandle;
+    std::vector<Entry> entries;
+};
+
+class AssetPackWriter
+{
+public:
+    // reads the file now; the asset is named name
+    bool addFile(const std::string& name);
+    bool write(const char* filename) const;
+    int getAssetCount() const               { return (int)assets.size(); }
+
+private:
+    struct Asset
+    {
+        std::string name;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Asset> assets;
+};
+
+#endif
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark.cpp
+// =============
+// Per-frame measurements of a benchmark run, summarized as JSON
+// (see Benchmark.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+#include "Benchmark.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// settings are stored as ready-to-write JSON values
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkRecorder::addSetting(const char* name, const char* value)
+{
+    std::string quoted = "\"";
+    for (const char* c = value; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            quoted += '\\';
+        quoted += *c;
+    }
+    quoted += "\"";
+    settings.push_back(std::make_pair(std::string(name), quoted));
+}
+
+void BenchmarkRecorder::addSetting(const char* name, double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%g", value);
+    settings.push_back(std::make_pair(std::string(name), std::string(text)));
+}
+
+void BenchmarkRecorder::addFrame(double frameTime, double cpuTime, double gpuTime, int drawCallCount, long long triangleCount)
+{
+    frameTimes.push_back(frameTime);
+    cpuTimes.push_back(cpuTime);
+    gpuTimes.push_back(gpuTime);
+    drawCalls.push_back(drawCallCount);
+    triangles.push_back(triangleCount);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// mean and nearest-rank percentiles
+///////////////////////////////////////////////////////////////////////////////
+// the smallest value with at least the fraction p of the values at or below
+// it: rank ceil(p * n), 1-based; the epsilon keeps e.g. 0.07 * 100 at rank 7
+static double getPercentile(const std::vector<double>& sorted, double p)
+{
+    int rank = (int)std::ceil(p * sorted.size() - 1e-9);
+    return sorted[std::min(std::max(rank, 1), (int)sorted.size()) - 1];
+}
+
+BenchmarkRecorder::Summary BenchmarkRecorder::summarize(std::vector<double> values)
+{
+    Summary summary = {};
+    if (values.empty())
+        return summary;
+
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); ++i)
+        sum += values[i];
+
+    summary.mean = sum / values.size();
+    summary.median = getPercentile(values, 0.50);
+    summary.p95 = getPercentile(values, 0.95);
+    summary.p99 = getPercentile(values, 0.99);
+    summary.min = values.front();
+    summary.max = values.back();
+    return summary;
+}
+
+void BenchmarkRecorder::writeSummary(FILE* file, const char* name, const Summary& summary)
+{
+    fprintf(file, "    \"%s\": { \"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f }",
+            name, summary.mean, summary.median, summary.p95, summary.p99, summary.min, summary.max);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one JSON object: settings, frame count, time summaries, draw stats
+///////////////////////////////////////////////////////////////////////////////
+void BenchmarkRecorder::writeJson(FILE* file, int warmupFrames) const
+{
+    int first = std::min(std::max(0, warmupFrames), (int)frameTimes.size());
+    int frames = (int)frameTimes.size() - first;
+
+    long long totalDrawCalls = 0, totalTriangles = 0;
+    for (int i = first; i < (int)frameTimes.size(); ++i)
+    {
+        totalDrawCalls += drawCalls[i];
+        totalTriangles += triangles[i];
+    }
+
+    fprintf(file, "{\n  \"settings\": {");
+    for (size_t i = 0; i < settings.size(); ++i)
+        fprintf(file, "%s\n    \"%s\": %s", i == 0 ? "" : ",", settings[i].first.c_str(), settings[i].second.c_str());
+    fprintf(file, "\n  },\n");
+
+    fprintf(file, "  \"frames\": %d,\n  \"warmupFrames\": %d,\n  \"timesMs\": {\n", frames, first);
+    writeSummary(file, "frame", summarize(std::vector<double>(frameTimes.begin() + first, frameTimes.end())));
+    fprintf(file, ",\n");
+    writeSummary(file, "cpu", summarize(std::vector<double>(cpuTimes.begin() + first, cpuTimes.end())));
+    fprintf(file, ",\n");
+    writeSummary(file, "gpu", summarize(std::vector<double>(gpuTimes.begin() + first, gpuTimes.end())));
+    fprintf(file, "\n  },\n");
+
+    fprintf(file, "  \"drawCalls\": { \"mean\": %.2f, \"total\": %lld },\n",
+            frames ? (double)totalDrawCalls / frames : 0.0, totalDrawCalls);
+    fprintf(file, "  \"triangles\": { \"mean\": %.2f, \"total\": %lld }\n}\n",
+            frames ? (double)totalTriangles / frames : 0.0, totalTriangles);
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark.h
+// ===========
+// Per-frame measurements of a benchmark run, summarized as JSON.
+// Frame, CPU and GPU times are reported as mean, median, p95, p99, min and
+// max; the median and percentiles are nearest-rank, so always measured
+// values. Draw calls and triangles are reported as per-frame means and totals.
+// Settings are copied into the output as they are, so runs stay comparable.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class BenchmarkRecorder
+{
+public:
+    BenchmarkRecorder() {}
+    ~BenchmarkRecorder() {}
+
+    void addSetting(const char* name, const char* value);
+    void addSetting(const char* name, double value);
+
+    void addFrame(double frameTime, double cpuTime, double gpuTime, int drawCalls, long long triangles);
+    int getFrameCount() const               { return (int)frameTimes.size(); }
+
+    // the first warmupFrames frames are left out of the statistics
+    void writeJson(FILE* file, int warmupFrames=0) const;
+
+private:
+    struct Summary
+    {
+        double mean, median, p95, p99, min, max;
+    };
+
+    static Summary summarize(std::vector<double> values);
+    static void writeSummary(FILE* file, const char* name, const Summary& summary);
+
+    std::vector<std::pair<std::string, std::string> > settings;    // name, JSON value
+    std::vector<double> frameTimes;         // ms
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+    std::vector<int> drawCalls;
+    std::vector<long long> triangles;
+};
+
+#endif
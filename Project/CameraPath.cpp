@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// CameraPath.cpp
+// ==============
+// Timed camera keys for recording and replaying camera movement
+// (see CameraPath.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <cmath>
+
+#include "CameraPath.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const double END_TOLERANCE = 1e-6;          // s, frame * timestep can round to just past the end
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// text I/O
+///////////////////////////////////////////////////////////////////////////////
+bool CameraPath::load(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("Failed to open camera path %s\n", filename);
+        return false;
+    }
+
+    keys.clear();
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file))
+    {
+        ++lineNumber;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        CameraKey key;
+        key.fov = DEFAULT_CAMERA_FOV;
+        int perspective = 1;
+        int fields = sscanf(line, "%lf %f %f %f %f %f %d %f", &key.time, &key.position.x, &key.position.y,
+                            &key.position.z, &key.yaw, &key.pitch, &perspective, &key.fov);
+        if (fields < 7 || key.fov <= 0.0f || key.fov >= 180.0f || (!keys.empty() && key.time < keys.back().time))
+        {
+            printf("%s:%d: expected \"time x y z yaw pitch perspective [fov]\" in time order\n", filename,
+                   lineNumber);
+            ok = false;
+            break;
+        }
+        key.perspective = (perspective != 0);
+        keys.push_back(key);
+    }
+    fclose(file);
+
+    if (ok && keys.empty())
+    {
+        printf("Camera path %s has no keys\n", filename);
+        ok = false;
+    }
+    return ok;
+}
+
+bool CameraPath::save(const char* filename) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        printf("Failed to open %s for writing\n", filename);
+        return false;
+    }
+
+    fprintf(file, "# time x y z yaw pitch perspective fov\n");
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        const CameraKey& key = keys[i];
+        fprintf(file, "%.4f %.4f %.4f %.4f %.3f %.3f %d %.3f\n", key.time, key.position.x, key.position.y,
+                key.position.z, key.yaw, key.pitch, key.perspective ? 1 : 0, key.fov);
+    }
+    fclose(file);
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// linear interpolation between the two keys around the time, held at the
+// first key before it and at the last key at the end
+///////////////////////////////////////////////////////////////////////////////
+CameraKey CameraPath::sample(double time) const
+{
+    if (keys.empty())
+    {
+        CameraKey key = {};
+        key.fov = DEFAULT_CAMERA_FOV;
+        key.perspective = true;
+        return key;
+    }
+
+    // the end itself is the last key, only later times start over
+    double duration = getDuration();
+    if (duration > 0.0 && time > duration + END_TOLERANCE)
+        time = std::fmod(time, duration);
+    if (time <= keys[0].time)
+    {
+        CameraKey key = keys[0];
+        key.time = time;
+        return key;
+    }
+
+    size_t next = 1;
+    while (next < keys.size() && keys[next].time <= time)
+        ++next;
+    if (next >= keys.size())
+        return keys.back();
+
+    const CameraKey& a = keys[next - 1];
+    const CameraKey& b = keys[next];
+    float t = (float)((time - a.time) / (b.time - a.time));
+
+    CameraKey key;
+    key.time = time;
+    key.position = a.position + (b.position - a.position) * t;
+    key.yaw = a.yaw + (b.yaw - a.yaw) * t;
+    key.pitch = a.pitch + (b.pitch - a.pitch) * t;
+    key.fov = a.fov + (b.fov - a.fov) * t;
+    key.perspective = a.perspective;
+    return key;
+}
@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+// CameraPath.h
+// ============
+// Timed camera keys for recording and replaying camera movement.
+// Positions, angles and field of view are interpolated linearly between keys.
+// The projection mode switches at each key. The text format has one key per
+// line:
+//   time x y z yaw pitch perspective [fov]
+// fov defaults to DEFAULT_CAMERA_FOV. Lines starting with # are comments.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+const float DEFAULT_CAMERA_FOV = 45.0f;     // degrees, Camera's initial Zoom
+
+struct CameraKey
+{
+    double time;                            // s from the start of the path
+    glm::vec3 position;
+    float yaw;                              // degrees, as in Camera
+    float pitch;
+    float fov;                              // degrees, vertical, as Camera::Zoom
+    bool perspective;                       // false for orthographic
+};
+
+class CameraPath
+{
+public:
+    CameraPath() {}
+    ~CameraPath() {}
+
+    bool load(const char* filename);
+    bool save(const char* filename) const;
+
+    void clear()                            { keys.clear(); }
+    // keys must be added in time order
+    void addKey(const CameraKey& key)       { keys.push_back(key); }
+
+    int getKeyCount() const                 { return (int)keys.size(); }
+    double getDuration() const              { return keys.empty() ? 0.0 : keys.back().time; }
+
+    // camera at the given time; before the first key it stays there, at
+    // the end it is the last key, past the end the path starts over
+    CameraKey sample(double time) const;
+
+private:
+    std::vector<CameraKey> keys;
+};
+
+#endif
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////
+// ChangeTracker.h
+// ===============
+// Version counters for everything that affects the rendered image.
+// Code that changes the camera, transforms, lights, GPU resources or render
+// settings bumps the matching counter. The render loop compares the summed
+// version with that of the last presented frame, and skips the frame when
+// nothing changed.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CHANGE_TRACKER_H
+#define CHANGE_TRACKER_H
+
+#include <atomic>
+
+enum ChangeCategory
+{
+    CHANGE_CAMERA,
+    CHANGE_TRANSFORMS,
+    CHANGE_LIGHTS,
+    CHANGE_RESOURCES,
+    CHANGE_SETTINGS,                        // render toggles, projection mode
+    CHANGE_WINDOW,                          // resized or exposed
+    CHANGE_COUNT
+};
+
+class ChangeTracker
+{
+public:
+    ChangeTracker()                         { for (int i = 0; i < CHANGE_COUNT; ++i) versions[i] = 0; }
+
+    // safe to call from any thread
+    void markChanged(ChangeCategory category) { ++versions[category]; }
+
+    unsigned int getVersion(ChangeCategory category) const { return versions[category]; }
+
+    // changes whenever any of the categories does
+    unsigned int getVersion() const
+    {
+        unsigned int version = 0;
+        for (int i = 0; i < CHANGE_COUNT; ++i)
+            version += versions[i];
+        return version;
+    }
+
+private:
+    std::atomic<unsigned int> versions[CHANGE_COUNT];
+};
+
+#endif
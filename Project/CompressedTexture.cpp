@@ -0,0 +1,530 @@
+///////////////////////////////////////////////////////////////////////////////
+// CompressedTexture.cpp
+// =====================
+// Block-compressed texture with its full mip chain, and the container file it
+// is cached in (see CompressedTexture.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "CompressedTexture.h"
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const char CONTAINER_MAGIC[4] = { 'C', 'T', 'E', 'X' };
+const unsigned int CONTAINER_VERSION = 4;   // bump whenever the encoder or mip output changes
+const int POWER_ITERATIONS = 4;             // for the principal axis of a block
+const int REFINE_PASSES = 2;                // least squares endpoint passes per block
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// runs task(0) .. task(count - 1), on the pool if there is one
+///////////////////////////////////////////////////////////////////////////////
+static void forEach(ThreadPool* threadPool, int count, const std::function<void(int)>& task)
+{
+    if (threadPool)
+        threadPool->parallelFor(count, task);
+    else
+    {
+        for (int i = 0; i < count; ++i)
+            task(i);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BC1 color block: two RGB565 endpoints and 2 bit indices
+///////////////////////////////////////////////////////////////////////////////
+static unsigned short packColor(const float color[3])
+{
+    int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor(unsigned short packed, float color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+// nearest of the four palette entries for every pixel; returns the squared error
+static float findColorIndices(const unsigned char* block, unsigned short color0, unsigned short color1,
+                              unsigned int& indices)
+{
+    float palette[4][3];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    float error = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        const unsigned char* pixel = &block[i * 4];
+        int best = 0;
+        float bestDistance = 1e30f;
+        for (int p = 0; p < 4; ++p)
+        {
+            float dr = pixel[0] - palette[p][0], dg = pixel[1] - palette[p][1], db = pixel[2] - palette[p][2];
+            float distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = p;
+            }
+        }
+        indices |= (unsigned int)best << (i * 2);
+        error += bestDistance;
+    }
+    return error;
+}
+
+// least squares endpoints for a given index assignment; false if degenerate
+static bool refineEndpoints(const unsigned char* block, unsigned int indices, float endpoint0[3], float endpoint1[3])
+{
+    const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; ++c)
+        {
+            ax[c] += a * block[i * 4 + c];
+            bx[c] += b * block[i * 4 + c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; ++c)
+    {
+        endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+        endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+    }
+    return true;
+}
+
+static void writeColorBlock(unsigned short color0, unsigned short color1, unsigned int indices, unsigned char* out)
+{
+    out[0] = (unsigned char)(color0 & 0xff);
+    out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)(color1 & 0xff);
+    out[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// endpoints from the extent of the pixels along their principal axis, then one
+// least squares pass; always uses the four color mode (color0 > color1)
+static void encodeColorBlock(const unsigned char* block, unsigned char* out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+            mean[c] += block[i * 4 + c];
+    }
+    for (int c = 0; c < 3; ++c)
+        mean[c] /= 16.0f;
+
+    // covariance: xx xy xz yy yz zz
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        float r = block[i * 4 + 0] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < POWER_ITERATIONS; ++iteration)
+    {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float scale = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+        if (scale < 1e-6f)
+            break;
+        axis[0] = x / scale;
+        axis[1] = y / scale;
+        axis[2] = z / scale;
+    }
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (int c = 0; c < 3; ++c)
+        axis[c] /= length;
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = (block[i * 4 + 0] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] +
+                  (block[i * 4 + 2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float endpoint0[3], endpoint1[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        endpoint0[c] = mean[c] + axis[c] * maxT;
+        endpoint1[c] = mean[c] + axis[c] * minT;
+    }
+
+    unsigned short color0 = packColor(endpoint0), color1 = packColor(endpoint1);
+    if (color0 < color1)
+        std::swap(color0, color1);
+    unsigned int indices = 0;
+    float error = findColorIndices(block, color0, color1, indices);
+
+    for (int pass = 0; pass < REFINE_PASSES && color0 != color1; ++pass)
+    {
+        if (!refineEndpoints(block, indices, endpoint0, endpoint1))
+            break;
+        unsigned short refined0 = packColor(endpoint0), refined1 = packColor(endpoint1);
+        if (refined0 < refined1)
+            std::swap(refined0, refined1);
+        unsigned int refinedIndices = 0;
+        float refinedError = 0.0f;
+        if (refined0 == refined1 || (refinedError = findColorIndices(block, refined0, refined1, refinedIndices)) >= error)
+            break;
+        color0 = refined0;
+        color1 = refined1;
+        indices = refinedIndices;
+        error = refinedError;
+    }
+
+    // equal endpoints would select the three color mode
+    if (color0 == color1)
+        indices = 0;
+    writeColorBlock(color0, color1, indices, out);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BC3 alpha block: two 8 bit endpoints and 3 bit indices into 8 steps
+///////////////////////////////////////////////////////////////////////////////
+static void encodeAlphaBlock(const unsigned char* block, unsigned char* out)
+{
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+        maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+    }
+
+    unsigned long long indices = 0;
+    if (maxAlpha > minAlpha)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            // step 0 is alpha0 (max), step 7 is alpha1 (min); codes 2..7 are the steps between
+            int step = (int)((maxAlpha - block[i * 4 + 3]) * 7.0f / (maxAlpha - minAlpha) + 0.5f);
+            unsigned long long code = (step == 0) ? 0 : (step == 7) ? 1 : step + 1;
+            indices |= code << (i * 3);
+        }
+    }
+
+    out[0] = (unsigned char)maxAlpha;
+    out[1] = (unsigned char)minAlpha;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+CompressedTexture::CompressedTexture() : format(COMPRESSED_BC1), external(nullptr), blockOffset(0), blockBytes(0),
+                                         sourceSize(0), sourceHash(0)
+{
+}
+
+void CompressedTexture::clear()
+{
+    levels.clear();
+    std::vector<unsigned char>().swap(data);
+    external = nullptr;
+    blockOffset = blockBytes = 0;
+    sourceSize = sourceHash = 0;
+}
+
+// the smaller levels are stored after the larger ones, dropping is only offsets
+void CompressedTexture::dropLevels(int count)
+{
+    count = std::min(count, (int)levels.size() - 1);
+    if (count <= 0)
+        return;
+    const size_t dropped = levels[count].offset;
+    levels.erase(levels.begin(), levels.begin() + count);
+    for (size_t i = 0; i < levels.size(); ++i)
+        levels[i].offset -= dropped;
+    if (external)
+        blockOffset += dropped;
+    else
+        data.erase(data.begin() + blockOffset, data.begin() + blockOffset + dropped);
+    blockBytes -= dropped;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RGBA working copy -> layer size -> mip chain -> blocks, one row of
+// blocks per task
+///////////////////////////////////////////////////////////////////////////////
+void CompressedTexture::compile(const unsigned char* pixels, int width, int height, int channels,
+                                ThreadPool* threadPool)
+{
+    clear();
+
+    // grey is spread to RGB, like the swizzle of an uncompressed upload
+    std::vector<unsigned char> image((size_t)width * height * 4), mip;
+    bool opaque = true;
+    for (int i = 0; i < width * height; ++i)
+    {
+        const unsigned char* pixel = &pixels[(size_t)i * channels];
+        unsigned char* rgba = &image[(size_t)i * 4];
+        rgba[0] = pixel[0];
+        rgba[1] = pixel[channels >= 3 ? 1 : 0];
+        rgba[2] = pixel[channels >= 3 ? 2 : 0];
+        rgba[3] = (channels == 2 || channels == 4) ? pixel[channels - 1] : 255;
+        opaque = opaque && rgba[3] == 255;
+    }
+    format = opaque ? COMPRESSED_BC1 : COMPRESSED_BC3;
+    const size_t blockSize = opaque ? 8 : 16;
+
+    // texture coordinates are normalized, so the size can change freely
+    int layerWidth = 0, layerHeight = 0;
+    getLayerSize(width, height, layerWidth, layerHeight);
+    if (layerWidth != width || layerHeight != height)
+    {
+        mip.resize((size_t)layerWidth * layerHeight * 4);
+        resampleImage(&image[0], width, height, 4, &mip[0], layerWidth, layerHeight, threadPool);
+        image.swap(mip);
+        width = layerWidth;
+        height = layerHeight;
+    }
+
+    // every level down to 1x1
+    size_t offset = 0;
+    for (int w = width, h = height;; w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+    {
+        CompressedLevel level = { w, h, offset, (size_t)((w + 3) / 4) * ((h + 3) / 4) * blockSize };
+        levels.push_back(level);
+        offset += level.size;
+        if (w == 1 && h == 1)
+            break;
+    }
+    data.resize(offset);
+    blockBytes = offset;
+
+    for (size_t index = 0; index < levels.size(); ++index)
+    {
+        const CompressedLevel& level = levels[index];
+        const int w = level.width, h = level.height;
+
+        // filtered in linear light from the previous level
+        if (index > 0)
+        {
+            mip.resize((size_t)w * h * 4);
+            generateMipLevel(&image[0], levels[index - 1].width, levels[index - 1].height, 4, &mip[0], threadPool);
+            image.swap(mip);
+        }
+
+        const int blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+        unsigned char* out = &data[level.offset];
+        forEach(threadPool, blocksY, [&](int blockY) {
+            unsigned char block[16 * 4];
+            for (int blockX = 0; blockX < blocksX; ++blockX)
+            {
+                // texels past the edge repeat the last row/column
+                for (int y = 0; y < 4; ++y)
+                {
+                    const unsigned char* row = &image[(size_t)std::min(blockY * 4 + y, h - 1) * w * 4];
+                    for (int x = 0; x < 4; ++x)
+                        memcpy(&block[(y * 4 + x) * 4], &row[std::min(blockX * 4 + x, w - 1) * 4], 4);
+                }
+
+                unsigned char* blockOut = out + ((size_t)blockY * blocksX + blockX) * blockSize;
+                if (opaque)
+                    encodeColorBlock(block, blockOut);
+                else
+                {
+                    encodeAlphaBlock(block, blockOut);
+                    encodeColorBlock(block, blockOut + 8);
+                }
+            }
+        });
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// container file
+///////////////////////////////////////////////////////////////////////////////
+static void writeValue(FILE* file, unsigned long long value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        fputc((int)((value >> (i * 8)) & 0xff), file);
+}
+
+static bool readValue(const unsigned char*& p, const unsigned char* end, unsigned long long& value, int bytes)
+{
+    value = 0;
+    if (end - p < bytes)
+        return false;
+    for (int i = 0; i < bytes; ++i)
+        value |= (unsigned long long)*p++ << (i * 8);
+    return true;
+}
+
+bool CompressedTexture::save(const char* filename) const
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("Failed to write compressed texture %s\n", filename);
+        return false;
+    }
+
+    fwrite(CONTAINER_MAGIC, 1, sizeof(CONTAINER_MAGIC), file);
+    writeValue(file, CONTAINER_VERSION, 4);
+    writeValue(file, format, 4);
+    writeValue(file, getWidth(), 4);
+    writeValue(file, getHeight(), 4);
+    writeValue(file, levels.size(), 4);
+    writeValue(file, sourceSize, 8);
+    writeValue(file, sourceHash, 8);
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        writeValue(file, levels[i].width, 4);
+        writeValue(file, levels[i].height, 4);
+        writeValue(file, levels[i].size, 4);
+    }
+    bool ok = fwrite(getBlocks(), 1, blockBytes, file) == blockBytes;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        printf("Failed to write compressed texture %s\n", filename);
+    return ok;
+}
+
+bool CompressedTexture::load(const char* filename, unsigned long long size, unsigned long long hash)
+{
+    clear();
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+        return false;
+
+    std::vector<unsigned char> bytes;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long fileSize = ok ? ftell(file) : -1;
+    ok = fileSize >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize((size_t)fileSize);
+        ok = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    fclose(file);
+
+    // the blocks stay where they were read, after the header
+    if (!ok || !parse(bytes.data(), bytes.size(), size, hash))
+        return false;
+    data.swap(bytes);
+    return true;
+}
+
+bool CompressedTexture::view(const unsigned char* bytes, size_t byteCount, unsigned long long size,
+                             unsigned long long hash)
+{
+    clear();
+    if (!parse(bytes, byteCount, size, hash))
+        return false;
+    external = bytes;
+    return true;
+}
+
+bool CompressedTexture::parse(const unsigned char* bytes, size_t byteCount, unsigned long long size,
+                              unsigned long long hash)
+{
+    const unsigned char* p = bytes;
+    const unsigned char* end = bytes + byteCount;
+    unsigned long long version = 0, fileFormat = 0, width = 0, height = 0, levelCount = 0;
+    bool ok = byteCount >= sizeof(CONTAINER_MAGIC) && memcmp(p, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+    p += ok ? sizeof(CONTAINER_MAGIC) : 0;
+    ok = ok && readValue(p, end, version, 4) && version == CONTAINER_VERSION &&
+         readValue(p, end, fileFormat, 4) && fileFormat <= COMPRESSED_BC3 &&
+         readValue(p, end, width, 4) && readValue(p, end, height, 4) &&
+         readValue(p, end, levelCount, 4) && levelCount > 0 && levelCount <= 32 &&
+         readValue(p, end, sourceSize, 8) && readValue(p, end, sourceHash, 8) &&
+         sourceSize == size && sourceHash == hash;
+
+    size_t offset = 0;
+    for (unsigned long long i = 0; ok && i < levelCount; ++i)
+    {
+        unsigned long long w = 0, h = 0, levelBytes = 0;
+        ok = readValue(p, end, w, 4) && readValue(p, end, h, 4) && readValue(p, end, levelBytes, 4) &&
+             levelBytes == ((w + 3) / 4) * ((h + 3) / 4) * (fileFormat == COMPRESSED_BC1 ? 8 : 16);
+        CompressedLevel level = { (int)w, (int)h, offset, (size_t)levelBytes };
+        levels.push_back(level);
+        offset += (size_t)levelBytes;
+    }
+    ok = ok && levels[0].width == (int)width && levels[0].height == (int)height;
+
+    // the block data has to fill the rest of the container exactly
+    ok = ok && (size_t)(end - p) == offset;
+    if (!ok)
+    {
+        clear();
+        return false;
+    }
+    format = (CompressedFormat)fileFormat;
+    blockOffset = (size_t)(p - bytes);
+    blockBytes = offset;
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// cache helpers
+///////////////////////////////////////////////////////////////////////////////
+void CompressedTexture::getLayerSize(int width, int height, int& layerWidth, int& layerHeight)
+{
+    layerWidth = 1 << std::max((int)std::floor(std::log2((double)width) + 0.5), 0);
+    layerHeight = 1 << std::max((int)std::floor(std::log2((double)height) + 0.5), 0);
+}
+
+std::string CompressedTexture::getCacheFilename(const std::string& sourceFilename)
+{
+    size_t slash = sourceFilename.find_last_of("/\\");
+    size_t dot = sourceFilename.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return sourceFilename + ".ctex";
+    return sourceFilename.substr(0, dot) + ".ctex";
+}
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// CompressedTexture.h
+// ===================
+// Block-compressed texture with its full mip chain, and the container file it
+// is cached in.
+// compile() encodes BC1 (opaque) or BC3 (with alpha) on the CPU. The levels are
+// uploaded as they are, so a texture loaded from the cache never goes through
+// the image decoder. Compiled textures are resampled to the nearest power of
+// two in each direction, so textures of similar size end up with the same
+// size and can share a texture array.
+// The container is little endian:
+//   "CTEX", version, format, width, height, level count,
+//   size and content hash of the source image file (see ContentHash.h),
+//   per level: width, height, byte size,
+//   then the block data of every level, largest first.
+// A cache file is used only if version and source hash still match.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+enum CompressedFormat
+{
+    COMPRESSED_BC1 = 0,                     // RGB, 8 bytes per 4x4 block
+    COMPRESSED_BC3 = 1                      // RGBA, 16 bytes per 4x4 block
+};
+
+struct CompressedLevel
+{
+    int width;
+    int height;
+    size_t offset;                          // into the block data
+    size_t size;                            // bytes
+};
+
+class CompressedTexture
+{
+public:
+    CompressedTexture();
+    ~CompressedTexture() {}
+
+    // pixels have 1 to 4 channels, rows in upload order; the pool may be null
+    void compile(const unsigned char* pixels, int width, int height, int channels, ThreadPool* threadPool);
+    // stamps the texture with the file it was compiled from
+    void setSource(unsigned long long size, unsigned long long hash) { sourceSize = size; sourceHash = hash; }
+
+    // fails if the file is missing, corrupt, of an older version or compiled
+    // from a different source
+    bool load(const char* filename, unsigned long long size, unsigned long long hash);
+    // like load(), on a container already in memory; the levels are read
+    // from there without a copy, so bytes have to outlive the texture
+    bool view(const unsigned char* bytes, size_t byteCount, unsigned long long size, unsigned long long hash);
+    bool save(const char* filename) const;
+    void clear();
+    // removes the count largest levels, keeping at least the smallest; the
+    // texture can no longer be saved
+    void dropLevels(int count);
+
+    bool isValid() const                    { return !levels.empty(); }
+    CompressedFormat getFormat() const      { return format; }
+    int getWidth() const                    { return levels.empty() ? 0 : levels[0].width; }
+    int getHeight() const                   { return levels.empty() ? 0 : levels[0].height; }
+    int getLevelCount() const               { return (int)levels.size(); }
+    const CompressedLevel& getLevel(int index) const { return levels[index]; }
+    const unsigned char* getLevelData(int index) const { return getBlocks() + levels[index].offset; }
+    size_t getDataSize() const              { return blockBytes; }
+
+    // nearest power of two in each direction, e.g. 1600x1068 -> 2048x1024
+    static void getLayerSize(int width, int height, int& layerWidth, int& layerHeight);
+    // wood.jpg -> wood.ctex, next to the source image
+    static std::string getCacheFilename(const std::string& sourceFilename);
+
+private:
+    bool parse(const unsigned char* bytes, size_t byteCount, unsigned long long size, unsigned long long hash);
+    const unsigned char* getBlocks() const  { return (external ? external : data.data()) + blockOffset; }
+
+    CompressedFormat format;
+    std::vector<CompressedLevel> levels;
+    std::vector<unsigned char> data;        // compiled or loaded, empty when viewed
+    const unsigned char* external;          // the viewed container, not owned
+    size_t blockOffset;                     // of the block data, past the header of a container
+    size_t blockBytes;
+    unsigned long long sourceSize;
+    unsigned long long sourceHash;
+};
+
+#endif
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// ContentHash.cpp
+// ===============
+// 64 bit content hash of a byte range, XXH64 (see ContentHash.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "ContentHash.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const unsigned long long PRIME1 = 0x9E3779B185EBCA87ULL;
+const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const unsigned long long PRIME3 = 0x165667B19E3779F9ULL;
+const unsigned long long PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const unsigned long long PRIME5 = 0x27D4EB2F165667C5ULL;
+const size_t STRIPE_SIZE = 32;              // 4 lanes of 8 bytes
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers, little endian loads as the targets of this project are
+///////////////////////////////////////////////////////////////////////////////
+static inline unsigned long long rotateLeft(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline unsigned long long read64(const unsigned char* p)
+{
+    unsigned long long value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline unsigned long long read32(const unsigned char* p)
+{
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline unsigned long long accumulate(unsigned long long lane, unsigned long long input)
+{
+    lane += input * PRIME2;
+    lane = rotateLeft(lane, 31);
+    return lane * PRIME1;
+}
+
+static inline unsigned long long mergeLane(unsigned long long hash, unsigned long long lane)
+{
+    hash ^= accumulate(0, lane);
+    return hash * PRIME1 + PRIME4;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 32 byte stripes over 4 lanes, then the tail 8, 4 and 1 bytes at a time
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long hashContent(const void* data, size_t size, unsigned long long seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + size;
+    unsigned long long hash;
+
+    if (size >= STRIPE_SIZE)
+    {
+        unsigned long long lanes[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+        for (; p + STRIPE_SIZE <= end; p += STRIPE_SIZE)
+        {
+            lanes[0] = accumulate(lanes[0], read64(p));
+            lanes[1] = accumulate(lanes[1], read64(p + 8));
+            lanes[2] = accumulate(lanes[2], read64(p + 16));
+            lanes[3] = accumulate(lanes[3], read64(p + 24));
+        }
+        hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = mergeLane(hash, lanes[i]);
+    }
+    else
+        hash = seed + PRIME5;
+    hash += size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= accumulate(0, read64(p));
+        hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= read32(p) * PRIME1;
+        hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        hash ^= *p * PRIME5;
+        hash = rotateLeft(hash, 11) * PRIME1;
+    }
+
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,18 @@
+///////////////////////////////////////////////////////////////////////////////
+// ContentHash.h
+// =============
+// 64 bit content hash of a byte range, XXH64 as specified by the xxHash
+// project, so the values match other xxHash implementations.
+// It runs at memory speed, several GB/s, far quicker than decoding the same
+// bytes, so hashing every texture file to find duplicates costs next to
+// nothing. Not for cryptographic use.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <stddef.h>
+
+unsigned long long hashContent(const void* data, size_t size, unsigned long long seed=0);
+
+#endif
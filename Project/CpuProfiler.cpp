@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+// CpuProfiler.cpp
+// ===============
+// Scoped CPU instrumentation with Chrome trace-event export
+// (see CpuProfiler.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CpuProfiler.h"
+
+#ifndef CPU_PROFILER_DISABLED
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+
+namespace {
+    const unsigned int RING_SIZE = 1 << 16;    // events per thread, power of two
+
+    // relaxed atomics, so a slot read while its thread reuses it is not a data race
+    struct Event
+    {
+        std::atomic<const char*> name;
+        std::atomic<long long> begin;           // ns
+        std::atomic<long long> end;
+    };
+
+    // a copy taken by writeTrace()
+    struct EventCopy
+    {
+        const char* name;
+        long long begin;
+        long long end;
+    };
+
+    // written by its own thread only
+    struct ThreadRing
+    {
+        ThreadRing() : events(RING_SIZE), started(0), written(0), id(0) {}
+
+        std::vector<Event> events;
+        std::atomic<unsigned int> started;      // events whose slot is being or has been written
+        std::atomic<unsigned int> written;      // total count, the ring index is written % RING_SIZE
+        int id;
+        std::string name;
+    };
+
+    // rings stay alive after their thread ends, so its events can still be written out
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+    const long long startTime = CpuProfiler::now();
+    thread_local ThreadRing* threadRing = nullptr;
+
+    ThreadRing* getThreadRing()
+    {
+        if (!threadRing)
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            rings.push_back(std::unique_ptr<ThreadRing>(new ThreadRing()));
+            threadRing = rings.back().get();
+            threadRing->id = (int)rings.size();
+            threadRing->name = "thread " + std::to_string(threadRing->id);
+        }
+        return threadRing;
+    }
+
+    void writeEscaped(FILE* file, const char* text)
+    {
+        for (; *text; ++text)
+        {
+            if (*text == '"' || *text == '\\')
+                fputc('\\', file);
+            fputc(*text, file);
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one complete event; like a sequence lock, started is raised before the slot
+// is overwritten and written after, so a reader can tell which slots it copied
+// intact
+///////////////////////////////////////////////////////////////////////////////
+void CpuProfiler::record(const char* name, long long begin, long long end)
+{
+    ThreadRing* ring = getThreadRing();
+    unsigned int index = ring->written.load(std::memory_order_relaxed);
+    ring->started.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Event& event = ring->events[index & (RING_SIZE - 1)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char* name)
+{
+    ThreadRing* ring = getThreadRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    ring->name = name;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// trace-event JSON: one "X" (complete) event per scope, times in microseconds
+// Threads keep recording while this runs. The published events of a ring are
+// copied first; those whose slot the thread started to reuse meanwhile are
+// dropped.
+///////////////////////////////////////////////////////////////////////////////
+bool CpuProfiler::writeTrace(const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        printf("Failed to open %s for writing\n", filename);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    size_t eventCount = 0;
+    std::vector<EventCopy> events;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        const ThreadRing& ring = *rings[i];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                i == 0 ? "" : ",\n", ring.id);
+        writeEscaped(file, ring.name.c_str());
+        fprintf(file, "\"}}");
+
+        unsigned int written = ring.written.load(std::memory_order_acquire);
+        unsigned int first = (written > RING_SIZE) ? written - RING_SIZE : 0;
+        events.resize(written - first);
+        for (unsigned int j = first; j < written; ++j)
+        {
+            const Event& event = ring.events[j & (RING_SIZE - 1)];
+            EventCopy& copy = events[j - first];
+            copy.name = event.name.load(std::memory_order_relaxed);
+            copy.begin = event.begin.load(std::memory_order_relaxed);
+            copy.end = event.end.load(std::memory_order_relaxed);
+        }
+
+        // event j is intact unless event j + RING_SIZE was started
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned int started = ring.started.load(std::memory_order_relaxed);
+        size_t intact = std::min((size_t)(started > first + RING_SIZE ? started - RING_SIZE - first : 0), events.size());
+        for (size_t j = intact; j < events.size(); ++j)
+        {
+            const EventCopy& event = events[j];
+            fprintf(file, ",\n{\"name\":\"");
+            writeEscaped(file, event.name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    ring.id, (event.begin - startTime) / 1000.0, (event.end - event.begin) / 1000.0);
+        }
+        eventCount += events.size() - intact;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %d trace events to %s\n", (int)eventCount, filename);
+    return true;
+}
+
+#endif
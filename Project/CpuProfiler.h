@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+// CpuProfiler.h
+// =============
+// Scoped CPU instrumentation with Chrome trace-event export.
+// PROFILE_SCOPE("name") records the time from that line to the end of the
+// enclosing block. Every thread writes its events into its own ring buffer
+// without taking a lock. Only the oldest events are lost when a ring wraps.
+// writeTrace() saves all rings as trace-event JSON for chrome://tracing or
+// ui.perfetto.dev. Names must be string literals or otherwise outlive the
+// profiler.
+// Defining CPU_PROFILER_DISABLED turns every PROFILE_* macro into nothing.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#ifndef CPU_PROFILER_DISABLED
+
+#include <chrono>
+
+class CpuProfiler
+{
+public:
+    // ns on a monotonic clock
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void record(const char* name, long long begin, long long end);
+    static void setThreadName(const char* name);
+    static bool writeTrace(const char* filename);
+};
+
+class CpuProfileScope
+{
+public:
+    explicit CpuProfileScope(const char* name) : name(name), begin(CpuProfiler::now()) {}
+    ~CpuProfileScope()                      { CpuProfiler::record(name, begin, CpuProfiler::now()); }
+
+private:
+    CpuProfileScope(const CpuProfileScope&);
+    CpuProfileScope& operator=(const CpuProfileScope&);
+
+    const char* name;
+    long long begin;
+};
+
+#define CPU_PROFILER_JOIN2(a, b) a##b
+#define CPU_PROFILER_JOIN(a, b) CPU_PROFILER_JOIN2(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILER_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) CpuProfiler::setThreadName(name)
+#define PROFILE_WRITE_TRACE(filename) CpuProfiler::writeTrace(filename)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#define PROFILE_WRITE_TRACE(filename) false
+
+#endif
+
+#endif
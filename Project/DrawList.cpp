@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+// DrawList.cpp
+// ============
+// Multithreaded draw-list recording (see DrawList.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+
+#include "CpuProfiler.h"
+#include "DrawList.h"
+#include "OcclusionCuller.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+
+
+namespace {
+    typedef std::chrono::high_resolution_clock Clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    bool comparePackets(const DrawPacket& a, const DrawPacket& b)
+    {
+        return a.sortKey < b.sortKey;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+DrawListRecorder::DrawListRecorder(ThreadPool* threadPool, int sliceSize)
+    : threadPool(threadPool), sliceSize(sliceSize > 0 ? sliceSize : 512), scene(nullptr),
+      occlusionCuller(nullptr), recordTime(0.0)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// cache the world bounds of every object and size the slices
+///////////////////////////////////////////////////////////////////////////////
+void DrawListRecorder::setScene(const Scene* scene)
+{
+    this->scene = scene;
+
+    int count = scene->getObjectCount();
+    worldMin.resize(count);
+    worldMax.resize(count);
+    for (int i = 0; i < count; ++i)
+        scene->getWorldBounds(scene->getObjects()[i], worldMin[i], worldMax[i]);
+
+    slices.resize((count + sliceSize - 1) / sliceSize);
+    for (size_t i = 0; i < slices.size(); ++i)
+        slices[i].packets.reserve(sliceSize);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// cull and record all slices in parallel
+///////////////////////////////////////////////////////////////////////////////
+void DrawListRecorder::record(const glm::mat4& viewProjection)
+{
+    Clock::time_point start = Clock::now();
+
+    // Gribb/Hartmann: planes are sums/differences of the matrix rows
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    frustumPlanes[0] = rows[3] + rows[0];   // left
+    frustumPlanes[1] = rows[3] - rows[0];   // right
+    frustumPlanes[2] = rows[3] + rows[1];   // bottom
+    frustumPlanes[3] = rows[3] - rows[1];   // top
+    frustumPlanes[4] = rows[3] + rows[2];   // near
+    frustumPlanes[5] = rows[3] - rows[2];   // far
+
+    if (threadPool)
+    {
+        threadPool->parallelFor((int)slices.size(), [this](int index) { recordSlice(index); });
+    }
+    else
+    {
+        for (int i = 0; i < (int)slices.size(); ++i)
+            recordSlice(i);
+    }
+
+    recordTime = millisecondsSince(start);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one slice: cull, build packets, sort by state
+///////////////////////////////////////////////////////////////////////////////
+void DrawListRecorder::recordSlice(int index)
+{
+    PROFILE_SCOPE("record slice");
+    Slice& slice = slices[index];
+    slice.packets.clear();
+    slice.frustumCulled = 0;
+    slice.occlusionCulled = 0;
+    slice.occlusionTestTime = 0.0;
+
+    const std::vector<SceneObject>& objects = scene->getObjects();
+    int first = index * sliceSize;
+    int last = std::min((int)objects.size(), first + sliceSize);
+
+    for (int i = first; i < last; ++i)
+    {
+        const SceneObject& object = objects[i];
+
+        if (!isInFrustum(worldMin[i], worldMax[i]))
+        {
+            ++slice.frustumCulled;
+            continue;
+        }
+
+        // occluders are always drawn
+        if (occlusionCuller && !object.occluder)
+        {
+            Clock::time_point testStart = Clock::now();
+            const SceneMesh& mesh = scene->getMesh(object.mesh);
+            bool visible = occlusionCuller->isBoxVisible(mesh.boundsMin, mesh.boundsMax, object.model);
+            slice.occlusionTestTime += millisecondsSince(testStart);
+            if (!visible)
+            {
+                ++slice.occlusionCulled;
+                continue;
+            }
+        }
+
+        DrawPacket packet;
+        packet.sortKey = (object.occluder ? 0u : 1u << 31) | ((unsigned int)object.mesh << 16) | (unsigned int)object.texture;
+        packet.object = (unsigned int)i;
+        packet.model = object.model;
+        slice.packets.push_back(packet);
+    }
+
+    // stable keeps the scene order within equal state
+    std::stable_sort(slice.packets.begin(), slice.packets.end(), comparePackets);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// box vs. frustum with the corner furthest along each plane normal
+///////////////////////////////////////////////////////////////////////////////
+bool DrawListRecorder::isInFrustum(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustumPlanes[i];
+        glm::vec4 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x,
+                         plane.y >= 0.0f ? boxMax.y : boxMin.y,
+                         plane.z >= 0.0f ? boxMax.z : boxMin.z, 1.0f);
+        if (glm::dot(plane, corner) < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// copy the packets of every slice into one list
+///////////////////////////////////////////////////////////////////////////////
+void DrawListRecorder::getPackets(std::vector<DrawPacket>& packets) const
+{
+    packets.clear();
+    for (size_t i = 0; i < slices.size(); ++i)
+        packets.insert(packets.end(), slices[i].packets.begin(), slices[i].packets.end());
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// stats summed over the slices
+///////////////////////////////////////////////////////////////////////////////
+int DrawListRecorder::getPacketCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < slices.size(); ++i)
+        count += (int)slices[i].packets.size();
+    return count;
+}
+
+int DrawListRecorder::getFrustumCulledCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < slices.size(); ++i)
+        count += slices[i].frustumCulled;
+    return count;
+}
+
+int DrawListRecorder::getOcclusionCulledCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < slices.size(); ++i)
+        count += slices[i].occlusionCulled;
+    return count;
+}
+
+double DrawListRecorder::getOcclusionTestTime() const
+{
+    double time = 0.0;
+    for (size_t i = 0; i < slices.size(); ++i)
+        time += slices[i].occlusionTestTime;
+    return time;
+}
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// DrawList.h
+// ==========
+// Multithreaded draw-list recording.
+// The scene object list is cut into fixed-size slices. Worker threads cull
+// every slice (frustum, then the CPU occlusion culler), resolve the mesh,
+// texture and model matrix of the survivors into compact packets, and sort
+// each slice by state. The GL thread only replays the packets in order.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Scene;
+class ThreadPool;
+class OcclusionCuller;
+
+// everything the GL thread needs to submit one object
+struct DrawPacket
+{
+    unsigned int sortKey;                   // occluders first, then by mesh, then by texture
+    unsigned int object;                    // index in the scene object list
+    glm::mat4 model;
+
+    int getMesh() const                     { return (int)((sortKey >> 16) & 0x7fff); }
+    int getTexture() const                  { return (int)(sortKey & 0xffff); }
+};
+
+class DrawListRecorder
+{
+public:
+    DrawListRecorder(ThreadPool* threadPool=nullptr, int sliceSize=512);
+    ~DrawListRecorder() {}
+
+    // world bounds are cached here, call again whenever objects move
+    void setScene(const Scene* scene);
+    // culler must already hold this frame's occluders, null disables the test
+    void setOcclusionCuller(const OcclusionCuller* culler) { occlusionCuller = culler; }
+
+    void record(const glm::mat4& viewProjection);
+
+    // recorded packets, replay slice by slice
+    int getSliceCount() const                               { return (int)slices.size(); }
+    const std::vector<DrawPacket>& getSlice(int index) const { return slices[index].packets; }
+    void getPackets(std::vector<DrawPacket>& packets) const;    // all slices, in replay order
+
+    // stats of the last record()
+    int getPacketCount() const;
+    int getFrustumCulledCount() const;
+    int getOcclusionCulledCount() const;
+    double getOcclusionTestTime() const;    // ms, summed over all threads
+    double getRecordTime() const            { return recordTime; }   // ms, wall clock
+
+private:
+    struct Slice
+    {
+        std::vector<DrawPacket> packets;
+        int frustumCulled;
+        int occlusionCulled;
+        double occlusionTestTime;
+    };
+
+    void recordSlice(int index);
+    bool isInFrustum(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    ThreadPool* threadPool;
+    int sliceSize;
+    const Scene* scene;
+    const OcclusionCuller* occlusionCuller;
+    std::vector<glm::vec3> worldMin;        // per object
+    std::vector<glm::vec3> worldMax;
+    glm::vec4 frustumPlanes[6];             // inside: dot(plane, (p, 1)) >= 0
+    std::vector<Slice> slices;
+    double recordTime;
+};
+
+#endif
@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+// DynamicResolution.cpp
+// =====================
+// Dynamic resolution scaling toward a GPU frame-time budget
+// (see DynamicResolution.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+#include "DynamicResolution.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const float MIN_SCALE = 0.5f;
+const float MAX_STEP = 0.05f;               // largest scale change per adjustment
+const double SMOOTHING = 0.2;               // weight of a new sample in the moving average
+const double OVER_BUDGET = 1.0;             // shrink above budget * this
+const double UNDER_BUDGET = 0.85;           // grow below budget * this
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/dtor
+///////////////////////////////////////////////////////////////////////////////
+DynamicResolution::DynamicResolution()
+    : width(0), height(0), budget(8.0), scale(1.0f), minScale(MIN_SCALE),
+      framebuffer(0), colorBuffer(0), depthBuffer(0), resolveFramebuffer(0), resolveBuffer(0),
+      frame(0), framesSinceChange(0), lastGpuTime(0.0), smoothedGpuTime(0.0), logFile(nullptr)
+{
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        queries[i] = 0;
+        queryPending[i] = false;
+    }
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    if (logFile)
+        fclose(logFile);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// create the offscreen targets at window size
+///////////////////////////////////////////////////////////////////////////////
+bool DynamicResolution::init(int width, int height, int samples, double budgetMs, const char* logFilename)
+{
+    this->width = width;
+    this->height = height;
+    budget = budgetMs;
+    scale = 1.0f;
+    smoothedGpuTime = budgetMs;
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    // a multisampled buffer cannot be blitted to a different size, so resolve first
+    glGenRenderbuffers(1, &resolveBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, resolveBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &resolveFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveBuffer);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenQueries(QUERY_COUNT, queries);
+
+    if (logFilename)
+    {
+        logFile = fopen(logFilename, "w");
+        if (logFile)
+            fprintf(logFile, "frame,gpu_ms,smoothed_ms,budget_ms,scale,width,height\n");
+        else
+            printf("Failed to open %s for writing\n", logFilename);
+    }
+
+    if (!complete)
+    {
+        printf("Failed to create the dynamic resolution framebuffer\n");
+        release();
+    }
+    return complete;
+}
+
+void DynamicResolution::release()
+{
+    if (framebuffer)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteFramebuffers(1, &resolveFramebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteRenderbuffers(1, &resolveBuffer);
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+    framebuffer = resolveFramebuffer = colorBuffer = depthBuffer = resolveBuffer = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// render size, never smaller than one pixel
+///////////////////////////////////////////////////////////////////////////////
+int DynamicResolution::getRenderWidth() const
+{
+    return std::max(1, (int)(width * scale + 0.5f));
+}
+
+int DynamicResolution::getRenderHeight() const
+{
+    return std::max(1, (int)(height * scale + 0.5f));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// adapt the scale, then render into the scaled corner of the offscreen target
+///////////////////////////////////////////////////////////////////////////////
+void DynamicResolution::beginFrame()
+{
+    readGpuTimes();
+    updateScale();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, getRenderWidth(), getRenderHeight());
+
+    int slot = frame % QUERY_COUNT;
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    queryPending[slot] = true;
+}
+
+void DynamicResolution::endFrame(GLuint targetFramebuffer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    ++frame;
+
+    int renderWidth = getRenderWidth();
+    int renderHeight = getRenderHeight();
+
+    // resolve the samples at render size
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+    glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // upscale to the window
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+    glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    glViewport(0, 0, width, height);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// collect the timer results that are ready, without waiting
+///////////////////////////////////////////////////////////////////////////////
+void DynamicResolution::readGpuTimes()
+{
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        // oldest first, so the moving average sees the samples in order
+        int slot = (frame + i) % QUERY_COUNT;
+        if (!queryPending[slot])
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        queryPending[slot] = false;
+
+        lastGpuTime = elapsed / 1.0e6;
+        smoothedGpuTime += (lastGpuTime - smoothedGpuTime) * SMOOTHING;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GPU time is roughly proportional to the pixel count, i.e. to scale^2
+// Results lag QUERY_COUNT frames behind, so the scale is held for that long
+// after every change to avoid overshooting.
+///////////////////////////////////////////////////////////////////////////////
+void DynamicResolution::updateScale()
+{
+    float oldScale = scale;
+    ++framesSinceChange;
+
+    if (framesSinceChange > QUERY_COUNT && smoothedGpuTime > 0.0)
+    {
+        if (smoothedGpuTime > budget * OVER_BUDGET || smoothedGpuTime < budget * UNDER_BUDGET)
+        {
+            float target = scale * (float)std::sqrt(budget / smoothedGpuTime);
+            target = std::min(scale + MAX_STEP, std::max(scale - MAX_STEP, target));
+            scale = std::min(1.0f, std::max(minScale, target));
+        }
+    }
+
+    if (scale != oldScale)
+        framesSinceChange = 0;
+
+    if (logFile)
+    {
+        fprintf(logFile, "%d,%.3f,%.3f,%.3f,%.3f,%d,%d\n", frame, lastGpuTime, smoothedGpuTime,
+                budget, scale, getRenderWidth(), getRenderHeight());
+    }
+}
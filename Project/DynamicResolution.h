@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// DynamicResolution.h
+// ===================
+// Dynamic resolution scaling toward a GPU frame-time budget.
+// The scene is rendered into an offscreen multisampled target that is as
+// large as the window. Only a scaled sub-rectangle of it is used. The
+// sub-rectangle is resolved and stretched onto the window with a linear blit.
+// GPU time per frame is measured with GL_TIME_ELAPSED queries that are read
+// a few frames later, and the scale is nudged toward the budget.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+class DynamicResolution
+{
+public:
+    DynamicResolution();
+    ~DynamicResolution();
+
+    // needs a current GL context; logFilename may be null
+    bool init(int width, int height, int samples, double budgetMs, const char* logFilename=nullptr);
+    void release();
+
+    // bind the offscreen target at the current scale / blit it to the window (or another framebuffer)
+    void beginFrame();
+    void endFrame(GLuint targetFramebuffer=0);
+
+    float getScale() const                  { return scale; }
+    int getRenderWidth() const;
+    int getRenderHeight() const;
+    double getGpuTime() const               { return smoothedGpuTime; }    // ms
+
+private:
+    static const int QUERY_COUNT = 4;       // frames in flight before a result is read
+
+    void readGpuTimes();
+    void updateScale();
+
+    int width;
+    int height;
+    double budget;                          // ms
+    float scale;                            // render size / window size, per axis
+    float minScale;
+
+    GLuint framebuffer;                     // multisampled color + depth
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    GLuint resolveFramebuffer;              // single-sampled color
+    GLuint resolveBuffer;
+
+    GLuint queries[QUERY_COUNT];
+    bool queryPending[QUERY_COUNT];
+    int frame;
+    int framesSinceChange;
+
+    double lastGpuTime;
+    double smoothedGpuTime;
+    FILE* logFile;
+};
+
+#endif
@@ -13,10 +13,90 @@ uniform vec3 lightPos0;
 uniform vec3 lightColor1;
 uniform vec3 lightPos1;
 uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
+#if defined(VIRTUAL_TEXTURE) || defined(VIRTUAL_TEXTURE_FEEDBACK)
+// Virtual texture (see VirtualTexture.h): every level of a texture is split
+// into pages, the page table maps each one to a tile of the page atlas, or
+// to the tile of its finest resident ancestor
+const int PAGE_SIZE = 128; // texels of a level per page
+const int PAGE_BORDER = 4; // texels around a page in its tile, one compressed block
+const int TILE_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+uniform usamplerBuffer uPageTable; // per page: tile x, tile y, level of the tile, 1 if mapped
+uniform ivec4 uVirtualTexture; // first page table entry, level count (0 until loaded), level 0 width and height
+
+ivec2 getLevelSize(int level)
+{
+    return max(uVirtualTexture.zw >> level, ivec2(1));
+}
+
+ivec2 getPageCount(int level)
+{
+    return (getLevelSize(level) + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+// the level the hardware would pick, nearest rather than blended
+int getVirtualLevel(vec2 uv, float lodBias)
+{
+    vec2 texels = uv * vec2(uVirtualTexture.zw);
+    vec2 dx = dFdx(texels), dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + lodBias;
+    return clamp(int(floor(lod + 0.5)), 0, uVirtualTexture.y - 1);
+}
+
+// page of a level the wrapped coordinates fall into
+ivec2 getPage(vec2 wrapped, int level)
+{
+    return min(ivec2(wrapped * vec2(getLevelSize(level))) / PAGE_SIZE, getPageCount(level) - 1);
+}
+
+uvec4 getPageEntry(ivec2 page, int level)
+{
+    int index = uVirtualTexture.x;
+    for (int i = 0; i < level; ++i)
+        index += getPageCount(i).x * getPageCount(i).y;
+    return texelFetch(uPageTable, index + page.y * getPageCount(level).x + page.x);
+}
+#endif
+
+#ifdef VIRTUAL_TEXTURE
+uniform sampler2D uPageAtlas; // compressed tiles with a wrapped border
+
+vec4 sampleVirtualTexture(vec2 uv)
+{
+    int level = getVirtualLevel(uv, 0.0);
+    if (uVirtualTexture.y == 0)
+        return vec4(0.5, 0.5, 0.5, 1.0); // the placeholder grey until the texture is loaded
+    vec2 wrapped = fract(uv);
+    uvec4 entry = getPageEntry(getPage(wrapped, level), level);
+    if (entry.w == 0u)
+        return vec4(0.5, 0.5, 0.5, 1.0);
+
+    // texels into the page of the level that is mapped, then into its tile
+    int mappedLevel = int(entry.z);
+    vec2 texel = wrapped * vec2(getLevelSize(mappedLevel));
+    vec2 pageTexel = texel - vec2(getPage(wrapped, mappedLevel) * PAGE_SIZE);
+    vec2 atlasTexel = vec2(entry.xy) * float(TILE_SIZE) + float(PAGE_BORDER) + pageTexel;
+    return textureLod(uPageAtlas, atlasTexel / vec2(textureSize(uPageAtlas, 0)), 0.0);
+}
+#elif defined(VIRTUAL_TEXTURE_FEEDBACK)
+uniform int uFeedbackTexture; // texture of the object
+uniform float uFeedbackBias; // log2 of how much smaller the feedback target is than the screen
+#else
+uniform sampler2DArray uTexture; // Texture array of the current object
+uniform float uTextureLayer; // Layer of the object's texture in uTexture
+#endif
 
 void main()
 {
+#ifdef VIRTUAL_TEXTURE_FEEDBACK
+    // the page this pixel needs at screen resolution: texture + 1, level, page x and y; 0 for none
+    int level = getVirtualLevel(vertexTextureCoordinate, -uFeedbackBias);
+    ivec2 page = getPage(fract(vertexTextureCoordinate), level);
+    if (uVirtualTexture.y == 0)
+        fragmentColor = vec4(0.0);
+    else
+        fragmentColor = vec4(float(uFeedbackTexture + 1), float(level), float(page.x), float(page.y)) / 255.0;
+#else
+
     /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
 
     //Calculate Ambient lighting*/
@@ -48,10 +128,15 @@ void main()
     vec3 specular = specularIntensity * specularComponent0 * lightColor0;
 
     // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate);
+#ifdef VIRTUAL_TEXTURE
+    vec4 textureColor = sampleVirtualTexture(vertexTextureCoordinate);
+#else
+    vec4 textureColor = texture(uTexture, vec3(vertexTextureCoordinate, uTextureLayer));
+#endif
 
     // Calculate phong result
     vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
 
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+#endif
 }
\ No newline at end of file
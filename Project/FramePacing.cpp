@@ -0,0 +1,272 @@
+///////////////////////////////////////////////////////////////////////////////
+// FramePacing.cpp
+// ===============
+// Frame pacing: monotonic clock, frame limiter, swap interval selection and
+// per-frame timeline (see FramePacing.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "FramePacing.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+const double SPIN_THRESHOLD = 0.002;        // Sleep() is only good to ~1 ms even at 1 ms timer resolution
+#else
+const double SPIN_THRESHOLD = 0.0005;
+#endif
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// clock
+///////////////////////////////////////////////////////////////////////////////
+double getFrameClock()
+{
+    typedef std::chrono::steady_clock Clock;
+    static const Clock::time_point start = Clock::now();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// swap interval
+///////////////////////////////////////////////////////////////////////////////
+bool parseVsyncMode(const char* name, VsyncMode& mode)
+{
+    if (strcmp(name, "off") == 0)
+        mode = VSYNC_OFF;
+    else if (strcmp(name, "on") == 0)
+        mode = VSYNC_ON;
+    else if (strcmp(name, "adaptive") == 0)
+        mode = VSYNC_ADAPTIVE;
+    else
+        return false;
+    return true;
+}
+
+VsyncMode setSwapInterval(VsyncMode mode)
+{
+    // a negative interval needs the swap_control_tear extension
+    if (mode == VSYNC_ADAPTIVE &&
+        !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+        printf("Adaptive vsync is not supported, using vsync\n");
+        mode = VSYNC_ON;
+    }
+
+    glfwSwapInterval(mode == VSYNC_OFF ? 0 : (mode == VSYNC_ON ? 1 : -1));
+    return mode;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameLimiter
+///////////////////////////////////////////////////////////////////////////////
+FrameLimiter::FrameLimiter(double targetRate)
+    : targetInterval(0.0), frameStart(0.0), spinThreshold(SPIN_THRESHOLD), started(false)
+{
+#ifdef _WIN32
+    // the default scheduler tick of ~15.6 ms would make sleeping useless
+    timeBeginPeriod(1);
+#endif
+    setTargetRate(targetRate);
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FrameLimiter::setTargetRate(double rate)
+{
+    targetInterval = (rate > 0.0) ? 1.0 / rate : 0.0;
+}
+
+void FrameLimiter::reset()
+{
+    started = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sleep for the coarse part of the wait, spin for the last bit
+// Frame starts advance by exactly one interval, so the delta time stays steady.
+// After falling behind by more than a frame, the grid restarts at "now"
+// instead of trying to catch up with a burst of frames.
+///////////////////////////////////////////////////////////////////////////////
+double FrameLimiter::beginFrame()
+{
+    double now = getFrameClock();
+    if (!started)
+    {
+        started = true;
+        frameStart = now;
+        return 0.0;
+    }
+
+    double previousStart = frameStart;
+    if (targetInterval <= 0.0)
+    {
+        frameStart = now;
+        return frameStart - previousStart;
+    }
+
+    double deadline = previousStart + targetInterval;
+    double remaining = deadline - now;
+    if (remaining > spinThreshold)
+        std::this_thread::sleep_for(std::chrono::duration<double>(remaining - spinThreshold));
+
+    while ((now = getFrameClock()) < deadline)
+        std::this_thread::yield();
+
+    frameStart = (now - deadline > targetInterval) ? now : deadline;
+    return frameStart - previousStart;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameTimeline
+///////////////////////////////////////////////////////////////////////////////
+FrameTimeline::FrameTimeline()
+    : timings(HISTORY), current(-1), lastComplete(-1), gpuClockOffset(0.0),
+      initialized(false), logFile(nullptr)
+{
+    for (int i = 0; i < HISTORY; ++i)
+        pending[i] = false;
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    if (logFile)
+        fclose(logFile);
+}
+
+void FrameTimeline::init(const char* logFilename)
+{
+    glGenQueries(HISTORY * 2, queries);
+
+    // GL_TIMESTAMP counts nanoseconds from an unspecified origin; line it up with the clock
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuClockOffset = getFrameClock() - gpuNow / 1.0e9;
+    initialized = true;
+
+    if (logFilename)
+    {
+        logFile = fopen(logFilename, "w");
+        if (logFile)
+            fprintf(logFile, "frame,cpu_begin,cpu_end,gpu_begin,gpu_end,present\n");
+        else
+            printf("Failed to open %s for writing\n", logFilename);
+    }
+}
+
+void FrameTimeline::release()
+{
+    if (initialized)
+        glDeleteQueries(HISTORY * 2, queries);
+    initialized = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// the begin timestamp is written when the GPU reaches it, not when it is issued
+///////////////////////////////////////////////////////////////////////////////
+void FrameTimeline::beginFrame(unsigned int frame, double cpuBegin)
+{
+    readGpuTimestamps();
+
+    current = (current + 1) % HISTORY;
+
+    FrameTiming& timing = timings[current];
+    timing.frame = frame;
+    timing.cpuBegin = cpuBegin;
+    timing.cpuEnd = timing.gpuBegin = timing.gpuEnd = timing.present = 0.0;
+
+    // a frame whose results never arrived is dropped
+    if (lastComplete == current)
+        lastComplete = -1;
+    pending[current] = false;
+
+    glQueryCounter(queries[current * 2], GL_TIMESTAMP);
+}
+
+void FrameTimeline::endFrame()
+{
+    glQueryCounter(queries[current * 2 + 1], GL_TIMESTAMP);
+    pending[current] = true;
+    timings[current].cpuEnd = getFrameClock();
+}
+
+void FrameTimeline::present()
+{
+    timings[current].present = getFrameClock();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// collect the frames whose end timestamp is ready, oldest first, without waiting
+///////////////////////////////////////////////////////////////////////////////
+void FrameTimeline::readGpuTimestamps()
+{
+    for (int i = 1; i <= HISTORY; ++i)
+    {
+        int slot = (current + i) % HISTORY;
+        if (!pending[slot])
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;                          // later frames cannot be done either
+
+        GLuint64 gpuBegin = 0, gpuEnd = 0;
+        glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &gpuBegin);
+        glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &gpuEnd);
+        pending[slot] = false;
+
+        FrameTiming& timing = timings[slot];
+        timing.gpuBegin = toClock(gpuBegin);
+        timing.gpuEnd = toClock(gpuEnd);
+        lastComplete = slot;
+
+        if (logFile)
+        {
+            fprintf(logFile, "%u,%.6f,%.6f,%.6f,%.6f,%.6f\n", timing.frame, timing.cpuBegin,
+                    timing.cpuEnd, timing.gpuBegin, timing.gpuEnd, timing.present);
+        }
+    }
+}
+
+double FrameTimeline::toClock(GLuint64 gpuTime) const
+{
+    return gpuTime / 1.0e9 + gpuClockOffset;
+}
+
+const FrameTiming* FrameTimeline::getLastCompleteFrame() const
+{
+    return (lastComplete >= 0) ? &timings[lastComplete] : nullptr;
+}
+
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// FramePacing.h
+// =============
+// Frame pacing: a monotonic clock, a frame limiter, swap interval selection,
+// and a per-frame timeline.
+// FrameLimiter runs on the thread that starts frames. It holds a target rate
+// by sleeping for most of the remaining time and spinning for the rest.
+// Frame starts are placed on a fixed grid, so the delta time is steady.
+// FrameTimeline runs on the GL thread. It records the CPU, GPU and present
+// timestamps of every frame on one clock, so jitter can be measured.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// seconds since the first call, monotonic and double precision
+double getFrameClock();
+
+enum VsyncMode
+{
+    VSYNC_OFF,
+    VSYNC_ON,
+    VSYNC_ADAPTIVE                          // tear instead of waiting when a frame is late
+};
+
+// parse "off", "on" or "adaptive"; false if the name is unknown
+bool parseVsyncMode(const char* name, VsyncMode& mode);
+
+// sets the swap interval of the current context, returns the mode actually used
+VsyncMode setSwapInterval(VsyncMode mode);
+
+
+
+class FrameLimiter
+{
+public:
+    FrameLimiter(double targetRate=0.0);    // frames per second, 0 is unlimited
+    ~FrameLimiter();
+
+    void setTargetRate(double rate);
+    double getTargetRate() const            { return targetInterval > 0.0 ? 1.0 / targetInterval : 0.0; }
+
+    // waits for the start of the next frame and returns the time since the previous one
+    double beginFrame();
+    double getFrameStart() const            { return frameStart; }
+
+    // forget the previous frame, e.g. after idling
+    void reset();
+
+private:
+    double targetInterval;                  // s
+    double frameStart;
+    double spinThreshold;                   // sleep until this long before the deadline, then spin
+    bool started;
+};
+
+
+
+struct FrameTiming
+{
+    unsigned int frame;
+    double cpuBegin;                        // frame started on the simulation side
+    double cpuEnd;                          // GL commands submitted
+    double gpuBegin;                        // 0 until the GPU results arrive
+    double gpuEnd;
+    double present;                         // swap returned
+};
+
+class FrameTimeline
+{
+public:
+    FrameTimeline();
+    ~FrameTimeline();
+
+    // needs a current GL context; logFilename may be null
+    void init(const char* logFilename=nullptr);
+    void release();
+
+    // around the GL commands of one frame, then after the swap
+    void beginFrame(unsigned int frame, double cpuBegin);
+    void endFrame();
+    void present();
+
+    // frame between beginFrame() and the next beginFrame(), GPU times not known yet
+    const FrameTiming& getCurrentFrame() const { return timings[current]; }
+    // latest frame whose GPU timestamps have arrived, null if none
+    const FrameTiming* getLastCompleteFrame() const;
+
+private:
+    static const int HISTORY = 8;           // frames in flight before the GPU results are read
+
+    void readGpuTimestamps();
+    double toClock(GLuint64 gpuTime) const;
+
+    std::vector<FrameTiming> timings;       // ring of HISTORY frames
+    GLuint queries[HISTORY * 2];            // begin/end timestamp per frame
+    bool pending[HISTORY];
+    int current;
+    int lastComplete;
+    double gpuClockOffset;                  // clock - GPU time, s
+    bool initialized;
+    FILE* logFile;
+};
+
+#endif
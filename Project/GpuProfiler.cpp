@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////////////
+// GpuProfiler.cpp
+// ===============
+// GPU time per named scope from GL_TIMESTAMP queries (see GpuProfiler.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+#include "GpuProfiler.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+GpuProfiler::GpuProfiler(int frameLatency, int historySize)
+    : frames(std::max(2, frameLatency)), current(0), historySize(std::max(1, historySize)), inFrame(false)
+{
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        frames[i].usedQueries = 0;
+        frames[i].pending = false;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// queries are created on demand by issueTimestamp()
+///////////////////////////////////////////////////////////////////////////////
+void GpuProfiler::init()
+{
+    release();
+}
+
+void GpuProfiler::release()
+{
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        Frame& frame = frames[i];
+        if (!frame.queries.empty())
+            glDeleteQueries((GLsizei)frame.queries.size(), &frame.queries[0]);
+        frame.queries.clear();
+        frame.markers.clear();
+        frame.usedQueries = 0;
+        frame.pending = false;
+    }
+    openMarkers.clear();
+    inFrame = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scopes are looked up by name once, then referred to by id
+///////////////////////////////////////////////////////////////////////////////
+int GpuProfiler::registerScope(const char* name)
+{
+    for (size_t i = 0; i < scopes.size(); ++i)
+    {
+        if (scopes[i].name == name)
+            return (int)i;
+    }
+
+    Scope scope;
+    scope.name = name;
+    scope.history.assign(historySize, 0.0f);
+    scope.next = 0;
+    scope.samples = 0;
+    scopes.push_back(scope);
+    return (int)scopes.size() - 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// read back every finished frame, then reuse the oldest slot for this one
+///////////////////////////////////////////////////////////////////////////////
+void GpuProfiler::beginFrame()
+{
+    for (size_t i = 1; i <= frames.size(); ++i)
+    {
+        Frame& frame = frames[(current + i) % frames.size()];
+        if (frame.pending)
+            readFrame(frame);
+    }
+
+    current = (current + 1) % (int)frames.size();
+    Frame& frame = frames[current];
+
+    // the GPU is more than frameLatency frames behind; drop the old results
+    frame.pending = false;
+    frame.usedQueries = 0;
+    frame.markers.clear();
+    openMarkers.clear();
+    inFrame = true;
+}
+
+void GpuProfiler::endFrame()
+{
+    Frame& frame = frames[current];
+    while (!openMarkers.empty())
+        endScope(frame.markers[openMarkers.back()].scope);
+
+    frame.pending = !frame.markers.empty();
+    inFrame = false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// a timestamp at the begin and at the end of the scope
+///////////////////////////////////////////////////////////////////////////////
+void GpuProfiler::beginScope(int scope)
+{
+    if (!inFrame)
+        return;
+
+    Marker marker;
+    marker.scope = scope;
+    marker.beginQuery = issueTimestamp();
+    marker.endQuery = -1;
+
+    Frame& frame = frames[current];
+    frame.markers.push_back(marker);
+    openMarkers.push_back((int)frame.markers.size() - 1);
+}
+
+void GpuProfiler::endScope(int scope)
+{
+    if (!inFrame || openMarkers.empty())
+        return;
+
+    Frame& frame = frames[current];
+    Marker& marker = frame.markers[openMarkers.back()];
+    openMarkers.pop_back();
+    if (marker.scope != scope)
+        printf("GPU profiler: scope %s closed while %s is open\n", getScopeName(scope), getScopeName(marker.scope));
+    marker.endQuery = issueTimestamp();
+}
+
+int GpuProfiler::issueTimestamp()
+{
+    Frame& frame = frames[current];
+    if (frame.usedQueries == (int)frame.queries.size())
+    {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+
+    glQueryCounter(frame.queries[frame.usedQueries], GL_TIMESTAMP);
+    return frame.usedQueries++;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// the last timestamp of a frame is written last, so if it is available all are
+///////////////////////////////////////////////////////////////////////////////
+void GpuProfiler::readFrame(Frame& frame)
+{
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    frameTimes.assign(scopes.size(), 0.0);
+    frameHits.assign(scopes.size(), 0);
+    for (size_t i = 0; i < frame.markers.size(); ++i)
+    {
+        const Marker& marker = frame.markers[i];
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[marker.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[marker.endQuery], GL_QUERY_RESULT, &end);
+        frameTimes[marker.scope] += (end > begin) ? (end - begin) / 1.0e6 : 0.0;
+        frameHits[marker.scope] = 1;
+    }
+    frame.pending = false;
+
+    for (size_t i = 0; i < scopes.size(); ++i)
+    {
+        if (!frameHits[i])
+            continue;
+        Scope& scope = scopes[i];
+        scope.history[scope.next] = (float)frameTimes[i];
+        scope.next = (scope.next + 1) % historySize;
+        scope.samples = std::min(scope.samples + 1, historySize);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// average and nearest-rank percentiles over the history
+///////////////////////////////////////////////////////////////////////////////
+// the smallest value with at least the fraction p of the samples at or below
+// it: rank ceil(p * n), 1-based; the epsilon keeps e.g. 0.07 * 100 at rank 7
+static float getPercentile(const std::vector<float>& sorted, double p)
+{
+    int rank = (int)std::ceil(p * sorted.size() - 1e-9);
+    return sorted[std::min(std::max(rank, 1), (int)sorted.size()) - 1];
+}
+
+void GpuProfiler::getStats(int scope, ScopeStats& stats) const
+{
+    const Scope& s = scopes[scope];
+    stats.samples = s.samples;
+    stats.average = stats.p50 = stats.p95 = stats.p99 = stats.max = 0.0;
+    if (s.samples == 0)
+        return;
+
+    // the history is full once it wrapped, otherwise it fills from the front
+    std::vector<float> sorted(s.history.begin(), s.history.begin() + s.samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+        sum += sorted[i];
+    stats.average = sum / sorted.size();
+
+    stats.p50 = getPercentile(sorted, 0.50);
+    stats.p95 = getPercentile(sorted, 0.95);
+    stats.p99 = getPercentile(sorted, 0.99);
+    stats.max = sorted.back();
+}
+
+void GpuProfiler::dump(FILE* file) const
+{
+    fprintf(file, "%-24s %8s %9s %9s %9s %9s %9s\n", "GPU scope", "frames", "avg ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    for (int i = 0; i < getScopeCount(); ++i)
+    {
+        ScopeStats stats;
+        getStats(i, stats);
+        fprintf(file, "%-24s %8d %9.3f %9.3f %9.3f %9.3f %9.3f\n", getScopeName(i), stats.samples,
+                stats.average, stats.p50, stats.p95, stats.p99, stats.max);
+    }
+}
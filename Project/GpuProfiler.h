@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+// GpuProfiler.h
+// =============
+// GPU time per named scope (passes, object groups) from GL_TIMESTAMP queries.
+// Each scope writes a timestamp where it begins and where it ends. The
+// queries come from a per-frame pool and are read back a few frames later,
+// once the GPU is done with them, so nothing stalls. Scopes may nest. A scope
+// that runs several times in one frame adds up. Every scope keeps a history of
+// per-frame times for rolling averages and percentiles.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+class GpuProfiler
+{
+public:
+    struct ScopeStats
+    {
+        int samples;                        // frames in the history that ran the scope
+        double average;                     // ms
+        double p50;
+        double p95;
+        double p99;
+        double max;
+    };
+
+    GpuProfiler(int frameLatency=4, int historySize=240);
+    ~GpuProfiler() {}
+
+    // needs a current GL context
+    void init();
+    void release();
+
+    // same name, same id
+    int registerScope(const char* name);
+
+    // all scopes of a frame must be opened and closed between these two
+    void beginFrame();
+    void endFrame();
+    void beginScope(int scope);
+    void endScope(int scope);
+
+    int getScopeCount() const               { return (int)scopes.size(); }
+    const char* getScopeName(int scope) const { return scopes[scope].name.c_str(); }
+    void getStats(int scope, ScopeStats& stats) const;
+
+    // one line per scope, in registration order
+    void dump(FILE* file) const;
+
+private:
+    struct Marker
+    {
+        int scope;
+        int beginQuery;                     // index in the frame's query pool
+        int endQuery;
+    };
+
+    struct Frame
+    {
+        std::vector<GLuint> queries;        // grows to the largest frame seen
+        int usedQueries;
+        std::vector<Marker> markers;
+        bool pending;                       // issued, results not read yet
+    };
+
+    struct Scope
+    {
+        std::string name;
+        std::vector<float> history;         // ring of per-frame times, ms
+        int next;
+        int samples;
+    };
+
+    int issueTimestamp();
+    void readFrame(Frame& frame);
+
+    std::vector<Frame> frames;              // ring of frameLatency frames
+    std::vector<Scope> scopes;
+    std::vector<int> openMarkers;           // stack of markers of the current frame
+    std::vector<double> frameTimes;         // scratch, per scope
+    std::vector<char> frameHits;
+    int current;
+    int historySize;
+    bool inFrame;
+};
+
+// opens a scope for the lifetime of the object, does nothing without a profiler
+class GpuScope
+{
+public:
+    GpuScope(GpuProfiler* profiler, int scope) : profiler(profiler), scope(scope)
+    {
+        if (profiler)
+            profiler->beginScope(scope);
+    }
+    ~GpuScope()
+    {
+        if (profiler)
+            profiler->endScope(scope);
+    }
+
+private:
+    GpuScope(const GpuScope&);
+    GpuScope& operator=(const GpuScope&);
+
+    GpuProfiler* profiler;
+    int scope;
+};
+
+#endif
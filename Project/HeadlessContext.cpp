@@ -0,0 +1,286 @@
+///////////////////////////////////////////////////////////////////////////////
+// HeadlessContext.cpp
+// ===================
+// OpenGL context and render target for machines without a display
+// (see HeadlessContext.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include "HeadlessContext.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <GL/wglew.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+HeadlessContext::HeadlessContext()
+    : width(0), height(0), framebuffer(0), colorBuffer(0), depthBuffer(0),
+      display(nullptr), context(nullptr), pbuffer(nullptr)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// context first, then a single-sampled RGBA8 + depth framebuffer
+///////////////////////////////////////////////////////////////////////////////
+bool HeadlessContext::create(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    if (!createContext())
+        return false;
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Failed to create the headless framebuffer\n");
+        destroy();
+        return false;
+    }
+    glViewport(0, 0, width, height);
+
+    printf("Headless renderer: %s (%s)\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (framebuffer)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+    framebuffer = colorBuffer = depthBuffer = 0;
+    destroyContext();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// read the framebuffer back; GL rows run bottom-up, image files top-down
+///////////////////////////////////////////////////////////////////////////////
+void HeadlessContext::readPixels(std::vector<unsigned char>& pixels) const
+{
+    pixels.resize(width * height * 3);
+    std::vector<unsigned char> rows(pixels.size());
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rows[0]);
+
+    int rowSize = width * 3;
+    for (int y = 0; y < height; ++y)
+        memcpy(&pixels[y * rowSize], &rows[(height - 1 - y) * rowSize], rowSize);
+}
+
+bool HeadlessContext::writePPM(const char* filename, int width, int height, const unsigned char* pixels)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("Failed to open %s for writing\n", filename);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool written = fwrite(pixels, 3, (size_t)width * height, file) == (size_t)width * height;
+    fclose(file);
+    return written;
+}
+
+
+
+#ifndef _WIN32
+///////////////////////////////////////////////////////////////////////////////
+// EGL: surfaceless platform if the driver has it, default display otherwise,
+// and a context that is made current without any surface
+///////////////////////////////////////////////////////////////////////////////
+bool HeadlessContext::createContext()
+{
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        printf("Failed to initialize EGL\n");
+        return false;
+    }
+    display = eglDisplay;
+
+    const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        printf("EGL %d.%d has no surfaceless contexts\n", major, minor);
+        destroyContext();
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        printf("No desktop OpenGL config available through EGL\n");
+        destroyContext();
+        return false;
+    }
+
+    context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext)context))
+    {
+        printf("Failed to create an EGL context\n");
+        destroyContext();
+        return false;
+    }
+
+    // glewInit() would look for a GLX display; only the GL entry points are needed
+    glewExperimental = true;
+    if (glewContextInit() != GLEW_OK)
+    {
+        printf("Failed to initialize GLEW\n");
+        destroyContext();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::destroyContext()
+{
+    if (!display)
+        return;
+
+    eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context && context != EGL_NO_CONTEXT)
+        eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+    eglTerminate((EGLDisplay)display);
+    display = context = nullptr;
+}
+
+#else
+///////////////////////////////////////////////////////////////////////////////
+// Windows: WGL has no surfaceless contexts and its extensions are only
+// reachable from a current context, so a plain context on a hidden window
+// loads WGL_ARB_pbuffer, and the real context is made on a 1x1 pbuffer. The
+// window and its context are gone before this returns
+///////////////////////////////////////////////////////////////////////////////
+bool HeadlessContext::createContext()
+{
+    const char* const WINDOW_CLASS = "HeadlessContext";
+    WNDCLASSA windowClass = {};
+    windowClass.lpfnWndProc = DefWindowProcA;
+    windowClass.hInstance = GetModuleHandleA(nullptr);
+    windowClass.lpszClassName = WINDOW_CLASS;
+    RegisterClassA(&windowClass);           // fails harmlessly when already registered
+    HWND window = CreateWindowA(WINDOW_CLASS, "headless", WS_OVERLAPPEDWINDOW, 0, 0, 1, 1, nullptr, nullptr,
+                                windowClass.hInstance, nullptr);
+    HDC windowDC = window ? GetDC(window) : nullptr;
+
+    PIXELFORMATDESCRIPTOR descriptor = {};
+    descriptor.nSize = sizeof(descriptor);
+    descriptor.nVersion = 1;
+    descriptor.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL;
+    descriptor.iPixelType = PFD_TYPE_RGBA;
+    descriptor.cColorBits = 32;
+    int windowFormat = windowDC ? ChoosePixelFormat(windowDC, &descriptor) : 0;
+    HGLRC bootstrap = (windowFormat && SetPixelFormat(windowDC, windowFormat, &descriptor)) ?
+                      wglCreateContext(windowDC) : nullptr;
+    glewExperimental = true;
+    bool ok = bootstrap && wglMakeCurrent(windowDC, bootstrap) && glewInit() == GLEW_OK &&
+              WGLEW_ARB_pixel_format && WGLEW_ARB_pbuffer;
+
+    // the framebuffer is ours, the pbuffer only has to carry the context
+    if (ok)
+    {
+        const int formatAttributes[] = {
+            WGL_DRAW_TO_PBUFFER_ARB, GL_TRUE,
+            WGL_SUPPORT_OPENGL_ARB, GL_TRUE,
+            WGL_PIXEL_TYPE_ARB, WGL_TYPE_RGBA_ARB,
+            WGL_COLOR_BITS_ARB, 24,
+            0
+        };
+        const int pbufferAttributes[] = { 0 };
+        int format = 0;
+        UINT formatCount = 0;
+        ok = wglChoosePixelFormatARB(windowDC, formatAttributes, nullptr, 1, &format, &formatCount) && formatCount > 0;
+        HPBUFFERARB pbufferHandle = ok ? wglCreatePbufferARB(windowDC, format, 1, 1, pbufferAttributes) : nullptr;
+        HDC pbufferDC = pbufferHandle ? wglGetPbufferDCARB(pbufferHandle) : nullptr;
+        pbuffer = pbufferHandle;
+        display = pbufferDC;
+        context = pbufferDC ? wglCreateContext(pbufferDC) : nullptr;
+        ok = context != nullptr;
+    }
+
+    wglMakeCurrent(nullptr, nullptr);
+    if (bootstrap)
+        wglDeleteContext(bootstrap);
+    if (windowDC)
+        ReleaseDC(window, windowDC);
+    if (window)
+        DestroyWindow(window);
+    if (!ok)
+    {
+        printf("Failed to create a WGL pbuffer context\n");
+        destroyContext();
+        return false;
+    }
+
+    // entry points of the bootstrap context may not be valid for this one
+    if (!wglMakeCurrent((HDC)display, (HGLRC)context) || glewInit() != GLEW_OK)
+    {
+        printf("Failed to initialize GLEW\n");
+        destroyContext();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::destroyContext()
+{
+    if (context)
+    {
+        wglMakeCurrent(nullptr, nullptr);
+        wglDeleteContext((HGLRC)context);
+    }
+    if (display)
+        wglReleasePbufferDCARB((HPBUFFERARB)pbuffer, (HDC)display);
+    if (pbuffer)
+        wglDestroyPbufferARB((HPBUFFERARB)pbuffer);
+    display = context = pbuffer = nullptr;
+}
+#endif
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// HeadlessContext.h
+// =================
+// OpenGL context and render target for machines without a display.
+// On Linux the context comes from EGL on Mesa's surfaceless platform, which
+// runs on llvmpipe when there is no GPU; the Visual Studio project is the only
+// build in the tree, so a Linux build has to link libEGL itself. On Windows,
+// where EGL is rarely available, the context lives on a 1x1 WGL pbuffer:
+// WGL_ARB_pbuffer is loaded through a throwaway context on a window that is
+// never shown and is destroyed before anything renders, so no monitor or
+// visible window is needed. Either way the frame is rendered into an
+// offscreen framebuffer that can be read back and written to disk.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+    ~HeadlessContext()                      { destroy(); }
+
+    // context made current on the calling thread, GLEW initialized, framebuffer created
+    bool create(int width, int height);
+    void destroy();
+
+    GLuint getFramebuffer() const           { return framebuffer; }
+    int getWidth() const                    { return width; }
+    int getHeight() const                   { return height; }
+
+    // RGB, top row first
+    void readPixels(std::vector<unsigned char>& pixels) const;
+
+    // binary PPM, which needs no image library
+    static bool writePPM(const char* filename, int width, int height, const unsigned char* pixels);
+
+private:
+    bool createContext();
+    void destroyContext();
+
+    int width;
+    int height;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+
+    // platform handles
+    void* display;                          // EGLDisplay, or the HDC of the pbuffer
+    void* context;                          // EGLContext, or HGLRC
+    void* pbuffer;                          // HPBUFFERARB, Windows only
+};
+
+#endif
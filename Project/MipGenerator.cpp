@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+// MipGenerator.cpp
+// ================
+// Builds mip levels on the CPU, filtering in linear light (see MipGenerator.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int LINEAR_STEPS = 16384;             // linear -> sRGB table, fine enough for the dark end
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sRGB transfer function both ways, built once on first use
+///////////////////////////////////////////////////////////////////////////////
+struct TransferTables
+{
+    float toLinear[256];
+    unsigned char toSrgb[LINEAR_STEPS];
+
+    TransferTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float v = i / 255.0f;
+            toLinear[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < LINEAR_STEPS; ++i)
+        {
+            float v = (float)i / (LINEAR_STEPS - 1);
+            float srgb = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (unsigned char)(std::min(std::max(srgb, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const TransferTables& getTables()
+{
+    static const TransferTables tables;
+    return tables;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one row of the next level
+// Every texel averages a 2x2 footprint. When a size above 1 is odd, the last
+// texel of the row or column takes the third source texel as well, so the
+// edge is folded in instead of dropped. Both paths add in the same order and
+// round half up, so they write the same bytes.
+///////////////////////////////////////////////////////////////////////////////
+// source indices of output index i: 1, 2 or 3 of them
+static int getFootprint(int i, int sourceSize, int size, int indices[3])
+{
+    if (sourceSize == 1)
+    {
+        indices[0] = 0;
+        return 1;
+    }
+    indices[0] = i * 2;
+    indices[1] = i * 2 + 1;
+    if (i == size - 1 && (sourceSize & 1))
+    {
+        indices[2] = i * 2 + 2;
+        return 3;
+    }
+    return 2;
+}
+
+static void generateRow(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+                        unsigned char* row, int width, int y, const TransferTables& tables)
+{
+    const int height = std::max(sourceHeight / 2, 1);
+    int sourceRows[3];
+    const int rowCount = getFootprint(y, sourceHeight, height, sourceRows);
+    const unsigned char* rows[3];
+    for (int j = 0; j < rowCount; ++j)
+        rows[j] = source + (size_t)sourceRows[j] * sourceWidth * channels;
+
+    const int colorChannels = (channels >= 3) ? 3 : 1;
+    for (int x = 0; x < width; ++x)
+    {
+        int columns[3];
+        const int columnCount = getFootprint(x, sourceWidth, width, columns);
+        const int count = rowCount * columnCount;
+        const float weight = 1.0f / count;
+
+#ifdef MIP_GENERATOR_USE_SSE2
+        if (channels == 4)
+        {
+            const __m128 scale = _mm_set1_ps((float)(LINEAR_STEPS - 1));
+            const __m128 half = _mm_set1_ps(0.5f);
+            __m128 sum = _mm_setzero_ps();
+            int alpha = 0;
+            for (int j = 0; j < rowCount; ++j)
+            {
+                for (int i = 0; i < columnCount; ++i)
+                {
+                    const unsigned char* texel = rows[j] + columns[i] * 4;
+                    sum = _mm_add_ps(sum, _mm_set_ps(0.0f, tables.toLinear[texel[2]], tables.toLinear[texel[1]],
+                                                     tables.toLinear[texel[0]]));
+                    alpha += texel[3];
+                }
+            }
+
+            // table indices for color, truncated after adding a half like the scalar path
+            int values[4];
+            __m128 index = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sum, _mm_set1_ps(weight)), scale), half);
+            _mm_storeu_si128((__m128i*)values, _mm_cvttps_epi32(index));
+            unsigned char* out = row + x * 4;
+            out[0] = tables.toSrgb[values[0]];
+            out[1] = tables.toSrgb[values[1]];
+            out[2] = tables.toSrgb[values[2]];
+            out[3] = (unsigned char)((alpha + count / 2) / count);
+            continue;
+        }
+#endif
+
+        for (int c = 0; c < channels; ++c)
+        {
+            if (c < colorChannels)
+            {
+                float sum = 0.0f;
+                for (int j = 0; j < rowCount; ++j)
+                {
+                    for (int i = 0; i < columnCount; ++i)
+                        sum += tables.toLinear[rows[j][columns[i] * channels + c]];
+                }
+                row[x * channels + c] = tables.toSrgb[(int)(sum * weight * (LINEAR_STEPS - 1) + 0.5f)];
+            }
+            else
+            {
+                int sum = 0;
+                for (int j = 0; j < rowCount; ++j)
+                {
+                    for (int i = 0; i < columnCount; ++i)
+                        sum += rows[j][columns[i] * channels + c];
+                }
+                row[x * channels + c] = (unsigned char)((sum + count / 2) / count);
+            }
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// whole levels
+///////////////////////////////////////////////////////////////////////////////
+int getMipLevelCount(int width, int height)
+{
+    int count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        ++count;
+    }
+    return count;
+}
+
+void generateMipLevel(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+                      unsigned char* dest, ThreadPool* threadPool)
+{
+    const int width = std::max(sourceWidth / 2, 1), height = std::max(sourceHeight / 2, 1);
+    const TransferTables& tables = getTables();
+    auto task = [&](int y) {
+        generateRow(source, sourceWidth, sourceHeight, channels, dest + (size_t)y * width * channels, width, y, tables);
+    };
+
+    if (threadPool)
+        threadPool->parallelFor(height, task);
+    else
+    {
+        for (int y = 0; y < height; ++y)
+            task(y);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// resampling
+///////////////////////////////////////////////////////////////////////////////
+// taps of one output row or column
+struct FilterTaps
+{
+    int first;                              // source index of weights[0], may be outside
+    std::vector<float> weights;             // normalized
+};
+
+static void getFilterTaps(int index, int sourceSize, int size, FilterTaps& taps)
+{
+    const float scale = (float)sourceSize / size;
+    const float radius = std::max(scale, 1.0f);
+    const float center = (index + 0.5f) * scale - 0.5f;
+    taps.first = (int)std::floor(center - radius) + 1;
+    int last = (int)std::floor(center + radius);
+    taps.weights.clear();
+    float sum = 0.0f;
+    for (int i = taps.first; i <= last; ++i)
+    {
+        float weight = std::max(1.0f - std::fabs(i - center) / radius, 0.0f);
+        taps.weights.push_back(weight);
+        sum += weight;
+    }
+    for (size_t i = 0; i < taps.weights.size(); ++i)
+        taps.weights[i] /= sum;
+}
+
+// vertical pass into one linear row per task, then the horizontal pass out of it
+void resampleImage(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+                   unsigned char* dest, int width, int height, ThreadPool* threadPool)
+{
+    const TransferTables& tables = getTables();
+    const int colorChannels = (channels >= 3) ? 3 : 1;
+
+    std::vector<FilterTaps> columns(width);
+    for (int x = 0; x < width; ++x)
+        getFilterTaps(x, sourceWidth, width, columns[x]);
+
+    auto task = [&](int y) {
+        FilterTaps rows;
+        getFilterTaps(y, sourceHeight, height, rows);
+
+        std::vector<float> line((size_t)sourceWidth * channels, 0.0f);
+        for (size_t k = 0; k < rows.weights.size(); ++k)
+        {
+            const float weight = rows.weights[k];
+            const int sourceY = std::min(std::max(rows.first + (int)k, 0), sourceHeight - 1);
+            const unsigned char* row = source + (size_t)sourceY * sourceWidth * channels;
+            for (int i = 0; i < sourceWidth * channels; ++i)
+            {
+                const int c = i % channels;
+                line[i] += weight * (c < colorChannels ? tables.toLinear[row[i]] : row[i] / 255.0f);
+            }
+        }
+
+        unsigned char* out = dest + (size_t)y * width * channels;
+        for (int x = 0; x < width; ++x)
+        {
+            const FilterTaps& taps = columns[x];
+            for (int c = 0; c < channels; ++c)
+            {
+                float value = 0.0f;
+                for (size_t k = 0; k < taps.weights.size(); ++k)
+                {
+                    const int sourceX = std::min(std::max(taps.first + (int)k, 0), sourceWidth - 1);
+                    value += taps.weights[k] * line[(size_t)sourceX * channels + c];
+                }
+                value = std::min(std::max(value, 0.0f), 1.0f);
+                out[x * channels + c] = (c < colorChannels) ? tables.toSrgb[(int)(value * (LINEAR_STEPS - 1) + 0.5f)]
+                                                            : (unsigned char)(value * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    if (threadPool)
+        threadPool->parallelFor(height, task);
+    else
+    {
+        for (int y = 0; y < height; ++y)
+            task(y);
+    }
+}
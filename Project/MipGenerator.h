@@ -0,0 +1,34 @@
+///////////////////////////////////////////////////////////////////////////////
+// MipGenerator.h
+// ==============
+// Builds mip levels on the CPU, filtering in linear light.
+// The images are authored in sRGB, so a 2x2 box filter on the stored values
+// (what glGenerateMipmap does for GL_RGB8/GL_RGBA8) darkens fine, high
+// contrast detail such as wood grain. Here color is converted to linear,
+// averaged and converted back; alpha is averaged as stored.
+// RGBA texels are filtered as one SSE2 vector each when SSE2 is available.
+// resampleImage() uses the same linear light conversion to fit an image to
+// another size, e.g. the layer size of a texture array.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+class ThreadPool;
+
+// # of levels down to 1x1, including the full size one
+int getMipLevelCount(int width, int height);
+
+// writes the next level, max(width / 2, 1) x max(height / 2, 1), of an image
+// with 1 to 4 channels (the last one is alpha for 2 and 4); with an odd width
+// or height above 1 the last column or row is averaged into the last texel
+// next to it. Rows are spread over the pool if there is one.
+void generateMipLevel(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+                      unsigned char* dest, ThreadPool* threadPool);
+
+// tent filter, widened when shrinking so every source texel contributes;
+// channels as for generateMipLevel()
+void resampleImage(const unsigned char* source, int sourceWidth, int sourceHeight, int channels,
+                   unsigned char* dest, int width, int height, ThreadPool* threadPool);
+
+#endif
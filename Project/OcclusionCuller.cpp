@@ -0,0 +1,306 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionCuller.cpp
+// ===================
+// Software occlusion culling against a small CPU depth buffer
+// (see OcclusionCuller.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "OcclusionCuller.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int BAND_HEIGHT = 16;                 // rows per parallel task
+const float MIN_TRIANGLE_AREA = 1.0e-6f;    // in pixels^2
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+OcclusionCuller::OcclusionCuller(int width, int height, ThreadPool* threadPool)
+    : width((width + 3) & ~3), height(height), bandHeight(BAND_HEIGHT),
+      threadPool(threadPool), viewProjection(1.0f), rasterizeTime(0.0)
+{
+    // rows are processed 4 pixels at a time, so keep the width a multiple of 4
+    depthBuffer.assign(this->width * this->height, 1.0f);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// clear the depth buffer and the occluder list for a new camera
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection)
+{
+    this->viewProjection = viewProjection;
+    std::fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+    triangles.clear();
+    rasterizeTime = 0.0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform the occluder triangles to depth buffer space
+// Triangles crossing the near plane are dropped, which only makes the
+// occluder smaller and therefore stays conservative.
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionCuller::addOccluder(const SceneMesh& mesh, const glm::mat4& model)
+{
+    const glm::mat4 mvp = viewProjection * model;
+
+    // every vertex once
+    std::vector<glm::vec4> clip(mesh.getVertexCount());
+    for (unsigned int i = 0; i < mesh.getVertexCount(); ++i)
+    {
+        const float* v = &mesh.interleavedVertices[i * 8];
+        clip[i] = mvp * glm::vec4(v[0], v[1], v[2], 1.0f);
+    }
+
+    const unsigned int count = mesh.getDrawCount();
+    for (unsigned int i = 0; i + 2 < count; i += 3)
+    {
+        ScreenTriangle tri;
+        bool rejected = false;
+        for (int k = 0; k < 3; ++k)
+        {
+            const glm::vec4& c = clip[mesh.isIndexed() ? mesh.indices[i + k] : i + k];
+            if (c.w <= 0.0f || c.z < -c.w)
+            {
+                rejected = true;
+                break;
+            }
+            float invW = 1.0f / c.w;
+            tri.x[k] = (c.x * invW * 0.5f + 0.5f) * width;
+            tri.y[k] = (c.y * invW * 0.5f + 0.5f) * height;
+            tri.z[k] = c.z * invW * 0.5f + 0.5f;
+        }
+        if (rejected)
+            continue;
+
+        // pixel bounding box of the pixel centers that may be covered
+        float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+        float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+        float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+        float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+        tri.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+        tri.maxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+        tri.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+        tri.maxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            continue;
+
+        triangles.push_back(tri);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// rasterize all occluders, one band of rows per task
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionCuller::rasterizeOccluders()
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    int bandCount = (height + bandHeight - 1) / bandHeight;
+    if (threadPool)
+    {
+        threadPool->parallelFor(bandCount, [this](int band) {
+            rasterizeBand(band * bandHeight, std::min(height, (band + 1) * bandHeight) - 1);
+        });
+    }
+    else
+    {
+        rasterizeBand(0, height - 1);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    rasterizeTime = elapsed.count();
+}
+
+
+
+void OcclusionCuller::rasterizeBand(int firstRow, int lastRow)
+{
+    PROFILE_SCOPE("rasterize band");
+    for (size_t i = 0; i < triangles.size(); ++i)
+        rasterizeTriangle(triangles[i], firstRow, lastRow);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// half-space rasterizer, keeps the nearest depth per pixel center
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionCuller::rasterizeTriangle(const ScreenTriangle& tri, int firstRow, int lastRow)
+{
+    int minY = std::max(tri.minY, firstRow);
+    int maxY = std::min(tri.maxY, lastRow);
+    if (minY > maxY)
+        return;
+
+    // make the winding counter-clockwise so inside means all edges >= 0
+    float x0 = tri.x[0], y0 = tri.y[0], z0 = tri.z[0];
+    float x1 = tri.x[1], y1 = tri.y[1], z1 = tri.z[1];
+    float x2 = tri.x[2], y2 = tri.y[2], z2 = tri.z[2];
+    float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (std::fabs(area) < MIN_TRIANGLE_AREA)
+        return;
+    if (area < 0.0f)
+    {
+        std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+        area = -area;
+    }
+
+    // edge functions E(x, y) = A * x + B * y + C, opposite to each vertex
+    float a0 = y1 - y2, b0 = x2 - x1, c0 = x1 * y2 - x2 * y1;
+    float a1 = y2 - y0, b1 = x0 - x2, c1 = x2 * y0 - x0 * y2;
+    float a2 = y0 - y1, b2 = x1 - x0, c2 = x0 * y1 - x1 * y0;
+
+    // depth is affine in screen space: z = zA * x + zB * y + zC
+    float invArea = 1.0f / area;
+    float zA = (a0 * z0 + a1 * z1 + a2 * z2) * invArea;
+    float zB = (b0 * z0 + b1 * z1 + b2 * z2) * invArea;
+    float zC = (c0 * z0 + c1 * z1 + c2 * z2) * invArea;
+
+    int startX = tri.minX & ~3;             // 4-pixel aligned
+    int endX = tri.maxX;
+
+#ifdef OCCLUSION_USE_SSE2
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 va0 = _mm_set1_ps(a0), va1 = _mm_set1_ps(a1), va2 = _mm_set1_ps(a2);
+    const __m128 vzA = _mm_set1_ps(zA);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float py = y + 0.5f;
+        __m128 row0 = _mm_set1_ps(b0 * py + c0);
+        __m128 row1 = _mm_set1_ps(b1 * py + c1);
+        __m128 row2 = _mm_set1_ps(b2 * py + c2);
+        __m128 rowZ = _mm_set1_ps(zB * py + zC);
+        float* depthRow = &depthBuffer[y * width];
+
+        for (int x = startX; x <= endX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(va0, px), row0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(va1, px), row1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(va2, px), row2);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+                            _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(vzA, px), rowZ);
+            __m128 depth = _mm_loadu_ps(depthRow + x);
+            __m128 nearest = _mm_min_ps(depth, z);
+            depth = _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, depth));
+            _mm_storeu_ps(depthRow + x, depth);
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float py = y + 0.5f;
+        float* depthRow = &depthBuffer[y * width];
+        for (int x = startX; x <= endX; ++x)
+        {
+            float px = x + 0.5f;
+            if (a0 * px + b0 * py + c0 < 0.0f ||
+                a1 * px + b1 * py + c1 < 0.0f ||
+                a2 * px + b2 * py + c2 < 0.0f)
+                continue;
+
+            float z = zA * px + zB * py + zC;
+            if (z < depthRow[x])
+                depthRow[x] = z;
+        }
+    }
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// test the screen rectangle of a box at its nearest depth
+// Returns false only if every pixel under the box holds a nearer occluder.
+///////////////////////////////////////////////////////////////////////////////
+bool OcclusionCuller::isBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                                   const glm::mat4& model) const
+{
+    const glm::mat4 mvp = viewProjection * model;
+
+    float minX = 0.0f, maxX = 0.0f, minY = 0.0f, maxY = 0.0f, minZ = 0.0f;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 corner((i & 1) ? boundsMax.x : boundsMin.x,
+                         (i & 2) ? boundsMax.y : boundsMin.y,
+                         (i & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+        glm::vec4 c = mvp * corner;
+
+        // the box reaches the camera, nothing can be in front of it
+        if (c.w <= 0.0f || c.z < -c.w)
+            return true;
+
+        float invW = 1.0f / c.w;
+        float x = (c.x * invW * 0.5f + 0.5f) * width;
+        float y = (c.y * invW * 0.5f + 0.5f) * height;
+        float z = c.z * invW * 0.5f + 0.5f;
+        if (i == 0)
+        {
+            minX = maxX = x;
+            minY = maxY = y;
+            minZ = z;
+        }
+        else
+        {
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            minZ = std::min(minZ, z);
+        }
+    }
+
+    // off screen or beyond the far plane
+    if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height || minZ > 1.0f)
+        return false;
+
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min(width - 1, (int)std::floor(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min(height - 1, (int)std::floor(maxY));
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        const float* depthRow = &depthBuffer[y * width];
+        int x = x0;
+#ifdef OCCLUSION_USE_SSE2
+        const __m128 vMinZ = _mm_set1_ps(minZ);
+        for (; x + 3 <= x1; x += 4)
+        {
+            if (_mm_movemask_ps(_mm_cmple_ps(vMinZ, _mm_loadu_ps(depthRow + x))) != 0)
+                return true;
+        }
+#endif
+        for (; x <= x1; ++x)
+        {
+            if (minZ <= depthRow[x])
+                return true;
+        }
+    }
+    return false;
+}
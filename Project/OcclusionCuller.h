@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionCuller.h
+// =================
+// Software occlusion culling against a small CPU depth buffer.
+// A handful of large occluders (table, tissue box) are rasterized into a low
+// resolution depth buffer (256x128 by default), then the screen-space
+// bounding rectangle of every other object is tested against it before the
+// object is submitted to OpenGL.
+// - the depth buffer is split into horizontal bands rasterized in parallel
+// - 4 pixels are evaluated at a time with SSE2 when it is available
+// - results are conservative: anything crossing the near plane is visible
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+struct SceneMesh;
+
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(int width=256, int height=128, ThreadPool* threadPool=nullptr);
+    ~OcclusionCuller() {}
+
+    int getWidth() const                    { return width; }
+    int getHeight() const                   { return height; }
+    const float* getDepthBuffer() const     { return depthBuffer.data(); }
+
+    // per frame: set the camera, add occluders, rasterize, then test boxes
+    void beginFrame(const glm::mat4& viewProjection);
+    void addOccluder(const SceneMesh& mesh, const glm::mat4& model);
+    void rasterizeOccluders();
+    bool isBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model) const;
+
+    // stats of the current frame
+    int getOccluderTriangleCount() const    { return (int)triangles.size(); }
+    double getRasterizeTime() const         { return rasterizeTime; }   // ms
+
+private:
+    // occluder triangle in depth buffer pixel coordinates, depth in [0, 1]
+    struct ScreenTriangle
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        int minX, maxX, minY, maxY;         // pixel bounding box (inclusive)
+    };
+
+    void rasterizeBand(int firstRow, int lastRow);
+    void rasterizeTriangle(const ScreenTriangle& tri, int firstRow, int lastRow);
+
+    int width;
+    int height;
+    int bandHeight;                         // rows per parallel task
+    ThreadPool* threadPool;                 // may be null (single-threaded)
+    glm::mat4 viewProjection;
+    std::vector<float> depthBuffer;         // row-major, cleared to 1.0 (far)
+    std::vector<ScreenTriangle> triangles;
+    double rasterizeTime;
+};
+
+#endif
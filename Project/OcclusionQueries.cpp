@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionQueries.cpp
+// ====================
+// Hardware occlusion queries with conditional rendering and temporal
+// coherence (see OcclusionQueries.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cfloat>
+
+#include "OcclusionQueries.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const float CAMERA_MARGIN = 0.2f;           // a bit more than the near plane distance
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+OcclusionQueryScheduler::OcclusionQueryScheduler()
+    : objectCount(0), queryInterval(8), queryTarget(GL_ANY_SAMPLES_PASSED), frame(0),
+      cameraPosition(0.0f), queryCount(0), occludedCount(0)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// create one query per object and per group
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionQueryScheduler::init(const std::vector<int>& groups, int groupCount, int queryInterval)
+{
+    release();
+
+    // conservative queries skip the exact sample coverage test (GL 4.3)
+    if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility)
+        queryTarget = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+    else
+        queryTarget = GL_ANY_SAMPLES_PASSED;
+
+    this->queryInterval = (queryInterval > 0) ? queryInterval : 1;
+    objectCount = (int)groups.size();
+    nodes.resize(objectCount + groupCount);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        Node& node = nodes[i];
+        glGenQueries(1, &node.query);
+        node.visible = true;
+        node.pending = false;
+        node.nextQueryFrame = (int)i % this->queryInterval;     // spread the queries over frames
+        node.group = ((int)i < objectCount && groups[i] >= 0) ? objectCount + groups[i] : -1;
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+    }
+    queryActive.assign(objectCount, 0);
+    conditionalActive.assign(objectCount, 0);
+    frame = 0;
+}
+
+void OcclusionQueryScheduler::release()
+{
+    for (size_t i = 0; i < nodes.size(); ++i)
+        glDeleteQueries(1, &nodes[i].query);
+    nodes.clear();
+    objectCount = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// world-space bounds of an object; group bounds grow to contain their objects
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionQueryScheduler::setObjectBounds(int object, const glm::vec3& worldMin, const glm::vec3& worldMax)
+{
+    Node& node = nodes[object];
+    node.boundsMin = worldMin;
+    node.boundsMax = worldMax;
+
+    if (node.group < 0)
+        return;
+
+    Node& group = nodes[node.group];
+    group.boundsMin = glm::min(group.boundsMin, worldMin);
+    group.boundsMax = glm::max(group.boundsMax, worldMax);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// collect the results that are ready and update the group states
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionQueryScheduler::beginFrame(const glm::vec3& cameraPosition)
+{
+    ++frame;
+    this->cameraPosition = cameraPosition;
+    queryCount = 0;
+    occludedCount = 0;
+
+    std::vector<char> arrived(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        Node& node = nodes[i];
+        if (!node.pending)
+            continue;
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(node.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint samples = 0;
+        glGetQueryObjectuiv(node.query, GL_QUERY_RESULT, &samples);
+        node.pending = false;
+        node.visible = (samples != 0);
+        arrived[i] = 1;
+
+        // visible nodes stay visible for a while, occluded ones are checked again right away
+        node.nextQueryFrame = node.visible ? frame + queryInterval - 1 : frame;
+    }
+
+    // a group is visible as long as one of its objects is
+    for (size_t i = objectCount; i < nodes.size(); ++i)
+    {
+        Node& group = nodes[i];
+        bool groupBoxVisible = arrived[i] && group.visible;
+        group.visible = false;
+        for (int j = 0; j < objectCount; ++j)
+        {
+            if (nodes[j].group == (int)i)
+                group.visible = group.visible || nodes[j].visible;
+        }
+
+        // the group box showed up again: check its objects one by one this frame
+        if (groupBoxVisible && !group.visible)
+            group.visible = true;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// wrap the draw call of an object in a query and/or conditional render
+///////////////////////////////////////////////////////////////////////////////
+void OcclusionQueryScheduler::beginObject(int object, const BoxDrawer& drawBox)
+{
+    Node& node = nodes[object];
+    queryActive[object] = 0;
+    conditionalActive[object] = 0;
+
+    if (isCameraInside(node))
+    {
+        node.visible = true;
+        return;
+    }
+
+    // the whole group is hidden: one box query covers all of its objects
+    if (node.group >= 0 && !nodes[node.group].visible && !isCameraInside(nodes[node.group]))
+    {
+        Node& group = nodes[node.group];
+        if (!group.pending)
+            queryBox(group, drawBox);
+        glBeginConditionalRender(group.query, GL_QUERY_NO_WAIT);
+        conditionalActive[object] = 1;
+        ++occludedCount;
+        return;
+    }
+
+    if (node.visible)
+    {
+        // the real geometry is the best query there is
+        if (needsQuery(node))
+        {
+            glBeginQuery(queryTarget, node.query);
+            queryActive[object] = 1;
+        }
+        return;
+    }
+
+    // known to be occluded: check the box every frame, and draw only if the check passes
+    if (!node.pending)
+        queryBox(node, drawBox);
+    glBeginConditionalRender(node.query, GL_QUERY_NO_WAIT);
+    conditionalActive[object] = 1;
+    ++occludedCount;
+}
+
+void OcclusionQueryScheduler::endObject(int object)
+{
+    Node& node = nodes[object];
+    if (queryActive[object])
+    {
+        glEndQuery(queryTarget);
+        node.pending = true;
+        ++queryCount;
+    }
+    if (conditionalActive[object])
+        glEndConditionalRender();
+
+    queryActive[object] = 0;
+    conditionalActive[object] = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+bool OcclusionQueryScheduler::isCameraInside(const Node& node) const
+{
+    // the near plane would clip the front faces of the box away
+    glm::vec3 boxMin = node.boundsMin - glm::vec3(CAMERA_MARGIN);
+    glm::vec3 boxMax = node.boundsMax + glm::vec3(CAMERA_MARGIN);
+    return cameraPosition.x >= boxMin.x && cameraPosition.x <= boxMax.x &&
+           cameraPosition.y >= boxMin.y && cameraPosition.y <= boxMax.y &&
+           cameraPosition.z >= boxMin.z && cameraPosition.z <= boxMax.z;
+}
+
+// visible nodes are only queried every queryInterval frames
+bool OcclusionQueryScheduler::needsQuery(const Node& node) const
+{
+    return !node.pending && frame >= node.nextQueryFrame;
+}
+
+void OcclusionQueryScheduler::queryBox(Node& node, const BoxDrawer& drawBox)
+{
+    GLboolean depthWrite = GL_TRUE;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthWrite);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    glBeginQuery(queryTarget, node.query);
+    drawBox(node.boundsMin, node.boundsMax);
+    glEndQuery(queryTarget);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(depthWrite);
+
+    node.pending = true;
+    ++queryCount;
+}
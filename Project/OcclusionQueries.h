@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionQueries.h
+// ==================
+// Hardware occlusion queries with conditional rendering and temporal
+// coherence, as a GPU-side complement to the CPU occlusion culler.
+// - every object (and every object group) owns one query object
+// - visible objects are queried with their real draw call, only once every
+//   few frames, since visibility rarely changes from one frame to the next
+// - occluded objects are queried every frame with their bounding box and
+//   drawn inside glBeginConditionalRender(GL_QUERY_NO_WAIT), so they never
+//   pop in late and never cost fragments while hidden
+// - when every object of a group is occluded only the group box is queried
+// - results are read with GL_QUERY_RESULT_AVAILABLE first; the CPU never
+//   waits for the GPU
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+class OcclusionQueryScheduler
+{
+public:
+    // draws an invisible world-space box (color and depth writes are off)
+    typedef std::function<void(const glm::vec3& boxMin, const glm::vec3& boxMax)> BoxDrawer;
+
+    OcclusionQueryScheduler();
+    ~OcclusionQueryScheduler() {}
+
+    // groups[i] is the group of object i, or -1; needs a current GL context
+    void init(const std::vector<int>& groups, int groupCount, int queryInterval=8);
+    void release();
+    void setObjectBounds(int object, const glm::vec3& worldMin, const glm::vec3& worldMax);
+
+    // read back whatever results arrived, then submit objects in between
+    // beginObject()/endObject()
+    void beginFrame(const glm::vec3& cameraPosition);
+    void beginObject(int object, const BoxDrawer& drawBox);
+    void endObject(int object);
+
+    // stats of the current frame
+    int getQueryCount() const               { return queryCount; }
+    int getOccludedCount() const            { return occludedCount; }
+
+private:
+    struct Node
+    {
+        GLuint query;
+        bool visible;                       // last known result
+        bool pending;                       // query issued, result not read yet
+        int nextQueryFrame;
+        int group;                          // node index of the group, or -1
+        glm::vec3 boundsMin;                // world space
+        glm::vec3 boundsMax;
+    };
+
+    bool isCameraInside(const Node& node) const;
+    bool needsQuery(const Node& node) const;
+    void queryBox(Node& node, const BoxDrawer& drawBox);
+
+    std::vector<Node> nodes;                // objects first, then groups
+    int objectCount;
+    int queryInterval;                      // frames between queries of visible nodes
+    GLenum queryTarget;
+    int frame;
+    glm::vec3 cameraPosition;
+
+    // per object state between beginObject() and endObject()
+    std::vector<char> queryActive;
+    std::vector<char> conditionalActive;
+
+    int queryCount;
+    int occludedCount;
+};
+
+#endif
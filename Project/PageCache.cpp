@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+// PageCache.cpp
+// =============
+// CPU side cache of virtual texture pages (see PageCache.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CpuProfiler.h"
+#include "PageCache.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/start/stop
+///////////////////////////////////////////////////////////////////////////////
+PageCache::PageCache() : loading(0), busy(false), quit(false), budget(0), size(0), useCounter(0), hits(0), loads(0)
+{
+}
+
+void PageCache::start(const PageLoader& loader, size_t byteBudget)
+{
+    stop();
+    this->loader = loader;
+    budget = byteBudget;
+    quit = false;
+    thread = std::thread(&PageCache::run, this);
+}
+
+void PageCache::stop()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wakeCondition.notify_one();
+        thread.join();
+    }
+    queue.clear();
+    ready.clear();
+    pages.clear();
+    busy = false;
+    size = 0;
+    hits = loads = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// requests in, ready pages out
+///////////////////////////////////////////////////////////////////////////////
+void PageCache::setRequests(const std::vector<unsigned long long>& keys)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            auto page = pages.find(keys[i]);
+            if (page != pages.end())
+            {
+                page->second.lastUse = ++useCounter;
+                ready.push_back(keys[i]);
+                ++hits;
+            }
+            else if (!busy || keys[i] != loading)
+                queue.push_back(keys[i]);
+        }
+    }
+    wakeCondition.notify_one();
+}
+
+bool PageCache::poll(unsigned long long& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready.empty())
+        return false;
+    key = ready.front();
+    ready.pop_front();
+    return true;
+}
+
+bool PageCache::getPage(unsigned long long key, std::vector<unsigned char>& data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto page = pages.find(key);
+    if (page == pages.end())
+        return false;
+    page->second.lastUse = ++useCounter;
+    data = page->second.data;
+    return true;
+}
+
+bool PageCache::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.empty() && ready.empty() && !busy;
+}
+
+size_t PageCache::getSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size;
+}
+
+int PageCache::getHitCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+int PageCache::getLoadCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return loads;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// loading thread
+///////////////////////////////////////////////////////////////////////////////
+void PageCache::run()
+{
+    PROFILE_THREAD_NAME("page cache");
+    std::vector<unsigned char> data;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wakeCondition.wait(lock, [this] { return quit || !queue.empty(); });
+        if (quit)
+            break;
+        loading = queue.front();
+        queue.pop_front();
+        busy = true;
+
+        lock.unlock();
+        {
+            PROFILE_SCOPE("load page");
+            data.clear();
+            loader(loading, data);
+        }
+        lock.lock();
+
+        busy = false;
+        insert(loading, data);
+        ready.push_back(loading);
+        ++loads;
+    }
+}
+
+// with the mutex locked; makes room from the least recently used pages
+void PageCache::insert(unsigned long long key, std::vector<unsigned char>& data)
+{
+    while (!pages.empty() && size + data.size() > budget)
+    {
+        auto victim = pages.begin();
+        for (auto page = pages.begin(); page != pages.end(); ++page)
+        {
+            if (page->second.lastUse < victim->second.lastUse)
+                victim = page;
+        }
+        size -= victim->second.data.size();
+        pages.erase(victim);
+    }
+    Page& page = pages[key];
+    page.data.swap(data);
+    page.lastUse = ++useCounter;
+    size += page.data.size();
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// PageCache.h
+// ===========
+// CPU side cache of virtual texture pages, loaded on a thread of its own.
+// The owner names pages by a 64 bit key and brings them in with a load
+// function that runs on the cache's thread. setRequests() replaces what is
+// queued with the pages the latest frame needs, most important first, so
+// pages that went out of view are never loaded. Loaded pages stay in memory
+// up to a byte budget, the least recently used ones go first, and a page
+// requested again is ready right away.
+// The GL thread picks up ready pages with poll() and copies them with
+// getPage() to upload them.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PageCache
+{
+public:
+    // fills data with the page of key; runs on the cache's thread
+    typedef std::function<void(unsigned long long key, std::vector<unsigned char>& data)> PageLoader;
+
+    PageCache();
+    ~PageCache()                            { stop(); }
+
+    void start(const PageLoader& loader, size_t byteBudget);
+    void stop();                            // waits for the page being loaded
+
+    // replaces the queue; cached pages are ready right away, the others are loaded in order
+    void setRequests(const std::vector<unsigned long long>& keys);
+    // a page that became ready since the last call
+    bool poll(unsigned long long& key);
+    // false if the page was evicted meanwhile
+    bool getPage(unsigned long long key, std::vector<unsigned char>& data);
+
+    bool isIdle() const;                    // nothing queued, loading or ready
+    size_t getSize() const;                 // bytes of the cached pages
+    int getHitCount() const;                // requests the cache had already
+    int getLoadCount() const;               // pages loaded
+
+private:
+    struct Page
+    {
+        std::vector<unsigned char> data;
+        unsigned long long lastUse;
+    };
+
+    void run();
+    void insert(unsigned long long key, std::vector<unsigned char>& data);
+
+    PageLoader loader;
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::deque<unsigned long long> queue;
+    std::deque<unsigned long long> ready;
+    std::map<unsigned long long, Page> pages;
+    unsigned long long loading;             // key on the thread, if busy
+    bool busy;
+    bool quit;
+    size_t budget;
+    size_t size;
+    unsigned long long useCounter;
+    int hits;
+    int loads;
+};
+
+#endif
@@ -0,0 +1,227 @@
+///////////////////////////////////////////////////////////////////////////////
+// ProgramCache.cpp
+// ================
+// Linked GLSL programs kept on disk between runs (see ProgramCache.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ContentHash.h"
+#include "ProgramCache.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const char CACHE_MAGIC[4] = { 'P', 'B', 'I', 'N' };
+const unsigned int CACHE_VERSION = 1;       // bump whenever the file layout changes
+const unsigned long long MAX_ENTRIES = 4096; // more is a corrupt file
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// little endian values of the file
+///////////////////////////////////////////////////////////////////////////////
+static void writeValue(FILE* file, unsigned long long value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        fputc((int)((value >> (i * 8)) & 0xff), file);
+}
+
+static bool readValue(const unsigned char*& p, const unsigned char* end, unsigned long long& value, int bytes)
+{
+    value = 0;
+    if (end - p < bytes)
+        return false;
+    for (int i = 0; i < bytes; ++i)
+        value |= (unsigned long long)*p++ << (i * 8);
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/open/save
+///////////////////////////////////////////////////////////////////////////////
+ProgramCache::ProgramCache() : driverHash(0), changed(false), hits(0), misses(0), rejects(0)
+{
+}
+
+bool ProgramCache::open(const char* filename)
+{
+    GLint formatCount = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0)
+        return false;
+
+    this->filename = filename;
+    driverHash = getDriverHash();
+    entries.clear();
+    changed = false;
+    hits = misses = rejects = 0;
+    read();
+    return true;
+}
+
+bool ProgramCache::save()
+{
+    if (!isOpen() || !changed)
+        return true;
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        printf("Failed to write program cache %s\n", filename.c_str());
+        return false;
+    }
+
+    fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), file);
+    writeValue(file, CACHE_VERSION, 4);
+    writeValue(file, driverHash, 8);
+    writeValue(file, entries.size(), 4);
+    bool ok = true;
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+    {
+        const std::vector<unsigned char>& binary = entry->second.binary;
+        writeValue(file, entry->first, 8);
+        writeValue(file, entry->second.format, 4);
+        writeValue(file, binary.size(), 4);
+        writeValue(file, hashContent(binary.data(), binary.size()), 8);
+        ok = fwrite(binary.data(), 1, binary.size(), file) == binary.size() && ok;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        printf("Failed to write program cache %s\n", filename.c_str());
+    changed = !ok;
+    return ok;
+}
+
+// false if the file is missing or of no use to this driver
+bool ProgramCache::read()
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+
+    std::vector<unsigned char> bytes;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long fileSize = ok ? ftell(file) : -1;
+    ok = fileSize >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize((size_t)fileSize);
+        ok = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    fclose(file);
+
+    const unsigned char* p = bytes.data();
+    const unsigned char* end = p + bytes.size();
+    unsigned long long version = 0, fileDriver = 0, entryCount = 0;
+    ok = ok && bytes.size() >= sizeof(CACHE_MAGIC) && memcmp(p, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+    p += ok ? sizeof(CACHE_MAGIC) : 0;
+    ok = ok && readValue(p, end, version, 4) && version == CACHE_VERSION && readValue(p, end, fileDriver, 8) &&
+         fileDriver == driverHash && readValue(p, end, entryCount, 4) && entryCount <= MAX_ENTRIES;
+
+    for (unsigned long long i = 0; ok && i < entryCount; ++i)
+    {
+        unsigned long long key = 0, format = 0, size = 0, hash = 0;
+        ok = readValue(p, end, key, 8) && readValue(p, end, format, 4) && readValue(p, end, size, 4) &&
+             readValue(p, end, hash, 8) && (unsigned long long)(end - p) >= size &&
+             hashContent(p, (size_t)size) == hash;
+        if (ok)
+        {
+            Entry& entry = entries[key];
+            entry.format = (GLenum)format;
+            entry.binary.assign(p, p + size);
+            p += size;
+        }
+    }
+    ok = ok && p == end;
+    if (!ok)
+    {
+        printf("Program cache %s is from another driver, version or corrupt, the programs are compiled again\n",
+               filename.c_str());
+        entries.clear();
+        changed = true;
+    }
+    return ok;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// programs in and out
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long ProgramCache::makeKey(const void* vertexSource, size_t vertexSize, const void* fragmentSource,
+                                         size_t fragmentSize, const char* defines)
+{
+    // chained through the seed, so the same bytes split differently hash differently
+    unsigned long long key = hashContent(vertexSource, vertexSize);
+    key = hashContent(fragmentSource, fragmentSize, key ^ vertexSize);
+    return hashContent(defines ? defines : "", defines ? strlen(defines) : 0, key ^ fragmentSize);
+}
+
+GLuint ProgramCache::loadProgram(unsigned long long key)
+{
+    auto entry = entries.find(key);
+    if (entry == entries.end())
+    {
+        ++misses;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, entry->second.format, entry->second.binary.data(), (GLsizei)entry->second.binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        entries.erase(entry);
+        changed = true;
+        ++rejects;
+        ++misses;
+        return 0;
+    }
+    ++hits;
+    return program;
+}
+
+void ProgramCache::storeProgram(unsigned long long key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    Entry entry;
+    entry.format = 0;
+    entry.binary.resize((size_t)length);
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &entry.format, entry.binary.data());
+    if (written <= 0)
+        return;
+    entry.binary.resize((size_t)written);
+    entries[key].format = entry.format;
+    entries[key].binary.swap(entry.binary);
+    changed = true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// vendor, renderer and version strings, a new driver gives another hash
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long ProgramCache::getDriverHash()
+{
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    std::string driver;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        const char* value = (const char*)glGetString(names[i]);
+        driver += value ? value : "";
+        driver += '\n';
+    }
+    return hashContent(driver.data(), driver.size());
+}
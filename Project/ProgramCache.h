@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////
+// ProgramCache.h
+// ==============
+// Linked GLSL programs kept on disk between runs, so a start with unchanged
+// shaders skips compiling and linking. LoadShaders() looks a program up by
+// the hash of its vertex source, fragment source and defines (see
+// ContentHash.h) and stores it on a miss, with glGetProgramBinary().
+// A binary only works on the driver that made it, so the file is stamped
+// with the hash of the vendor, renderer and version strings; a file from
+// another driver, or of another version, is ignored and rewritten. A binary
+// the driver still rejects, e.g. after an update that kept its version
+// string, is dropped and the program compiled from source.
+// The file is little endian:
+//   "PBIN", version, driver hash, entry count,
+//   per entry: key, binary format, byte size, content hash, then the binary.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+class ProgramCache
+{
+public:
+    ProgramCache();
+    ~ProgramCache() {}
+
+    // reads the programs of filename, if it has any for this driver; false
+    // if the driver has no program binaries. Needs a current GL context
+    bool open(const char* filename);
+    // writes the file back if programs were added or dropped
+    bool save();
+    bool isOpen() const                     { return !filename.empty(); }
+
+    static unsigned long long makeKey(const void* vertexSource, size_t vertexSize, const void* fragmentSource,
+                                      size_t fragmentSize, const char* defines);
+    // a linked program made from the cached binary, 0 on a miss or if the
+    // driver rejects it
+    GLuint loadProgram(unsigned long long key);
+    // program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    void storeProgram(unsigned long long key, GLuint program);
+
+    int getEntryCount() const               { return (int)entries.size(); }
+    int getHitCount() const                 { return hits; }
+    int getMissCount() const                { return misses; }     // rejected binaries included
+    int getRejectCount() const              { return rejects; }
+
+private:
+    struct Entry
+    {
+        GLenum format;
+        std::vector<unsigned char> binary;
+    };
+
+    static unsigned long long getDriverHash();
+    bool read();
+
+    std::string filename;
+    unsigned long long driverHash;
+    std::map<unsigned long long, Entry> entries;
+    bool changed;
+    int hits;
+    int misses;
+    int rejects;
+};
+
+#endif
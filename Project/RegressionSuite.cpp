@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+// RegressionSuite.cpp
+// ===================
+// Golden-image and performance-budget checks for fixed camera poses
+// (see RegressionSuite.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+
+#include "HeadlessContext.h"
+#include "RegressionSuite.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int DOWNSAMPLE = 4;                   // box filter size before comparing
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sRGB to CIE L*a*b* (D65), where distances roughly follow perceived difference
+///////////////////////////////////////////////////////////////////////////////
+static void toLab(const unsigned char* rgb, float lab[3])
+{
+    float linear[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        float v = rgb[c] / 255.0f;
+        linear[c] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+    float xyz[3] = {
+        (0.4124f * linear[0] + 0.3576f * linear[1] + 0.1805f * linear[2]) / 0.95047f,
+        (0.2126f * linear[0] + 0.7152f * linear[1] + 0.0722f * linear[2]),
+        (0.0193f * linear[0] + 0.1192f * linear[1] + 0.9505f * linear[2]) / 1.08883f
+    };
+    for (int c = 0; c < 3; ++c)
+        xyz[c] = xyz[c] > 0.008856f ? std::cbrt(xyz[c]) : 7.787f * xyz[c] + 16.0f / 116.0f;
+    lab[0] = 116.0f * xyz[1] - 16.0f;
+    lab[1] = 500.0f * (xyz[0] - xyz[1]);
+    lab[2] = 200.0f * (xyz[1] - xyz[2]);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+RegressionSuite::RegressionSuite() : timeTolerance(0.5), timeBudgets(true), deltaETolerance(10.0f), pixelTolerance(0.005f)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// suite file: cases and tolerances
+///////////////////////////////////////////////////////////////////////////////
+bool RegressionSuite::load(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("Failed to open regression suite %s\n", filename);
+        return false;
+    }
+
+    directory = filename;
+    size_t slash = directory.find_last_of("/\\");
+    directory = (slash == std::string::npos) ? std::string() : directory.substr(0, slash + 1);
+
+    cases.clear();
+    char line[512];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        ++lineNumber;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        char name[128];
+        float value = 0.0f;
+        if (sscanf(line, "tolerance %127s %f", name, &value) == 2)
+        {
+            if (strcmp(name, "time") == 0)
+                timeTolerance = value;
+            else if (strcmp(name, "deltaE") == 0)
+                deltaETolerance = value;
+            else if (strcmp(name, "pixels") == 0)
+                pixelTolerance = value;
+            else
+            {
+                printf("%s:%d: unknown tolerance %s\n", filename, lineNumber, name);
+                ok = false;
+            }
+            continue;
+        }
+
+        RegressionCase test;
+        CameraKey& camera = test.camera;
+        int perspective = 1;
+        if (sscanf(line, "%127s %f %f %f %f %f %d %d %lld %lf %lf", name, &camera.position.x, &camera.position.y,
+                   &camera.position.z, &camera.yaw, &camera.pitch, &perspective, &test.maxDrawCalls,
+                   &test.maxTriangles, &test.cpuBudget, &test.gpuBudget) != 11)
+        {
+            printf("%s:%d: expected \"name x y z yaw pitch perspective drawCalls triangles cpuMs gpuMs\"\n",
+                   filename, lineNumber);
+            ok = false;
+            continue;
+        }
+        test.name = name;
+        camera.time = 0.0;
+        camera.fov = DEFAULT_CAMERA_FOV;
+        camera.perspective = (perspective != 0);
+        cases.push_back(test);
+    }
+    fclose(file);
+
+    if (ok && cases.empty())
+    {
+        printf("Regression suite %s has no cases\n", filename);
+        ok = false;
+    }
+    return ok;
+}
+
+std::string RegressionSuite::getGoldenFilename(int index) const
+{
+    return directory + "golden/" + cases[index].name + ".ppm";
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// image against the reference, measurements against the budgets
+///////////////////////////////////////////////////////////////////////////////
+void RegressionSuite::evaluate(int index, const unsigned char* pixels, int width, int height,
+                               RegressionResult& result) const
+{
+    const RegressionCase& test = cases[index];
+
+    result.countsPassed = result.drawCalls <= test.maxDrawCalls && result.triangles <= test.maxTriangles;
+    result.timesPassed = result.cpuTime <= test.cpuBudget * (1.0 + timeTolerance) &&
+                         result.gpuTime <= test.gpuBudget * (1.0 + timeTolerance);
+
+    std::vector<unsigned char> frame, golden;
+    downsample(pixels, width, height, frame);
+    int goldenWidth = 0, goldenHeight = 0;
+    result.goldenFound = readPPM(getGoldenFilename(index).c_str(), goldenWidth, goldenHeight, golden) &&
+                         goldenWidth == width / DOWNSAMPLE && goldenHeight == height / DOWNSAMPLE;
+    result.meanDeltaE = 0.0f;
+    result.changedPixels = 1.0f;
+    result.imagePassed = false;
+    if (!result.goldenFound)
+        return;
+
+    int count = goldenWidth * goldenHeight;
+    int changed = 0;
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        float a[3], b[3];
+        toLab(&frame[i * 3], a);
+        toLab(&golden[i * 3], b);
+        float deltaE = std::sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) +
+                                 (a[2] - b[2]) * (a[2] - b[2]));
+        sum += deltaE;
+        if (deltaE > deltaETolerance)
+            ++changed;
+    }
+    result.meanDeltaE = (float)(sum / count);
+    result.changedPixels = (float)changed / count;
+    result.imagePassed = result.changedPixels <= pixelTolerance;
+}
+
+bool RegressionSuite::updateGolden(int index, const unsigned char* pixels, int width, int height) const
+{
+    std::vector<unsigned char> frame;
+    downsample(pixels, width, height, frame);
+    return HeadlessContext::writePPM(getGoldenFilename(index).c_str(), width / DOWNSAMPLE, height / DOWNSAMPLE, &frame[0]);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// console report
+///////////////////////////////////////////////////////////////////////////////
+bool RegressionSuite::report(const std::vector<RegressionResult>& results) const
+{
+    int failed = 0, slow = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const RegressionCase& test = cases[i];
+        const RegressionResult& result = results[i];
+        bool passed = result.imagePassed && result.countsPassed && (result.timesPassed || !timeBudgets);
+        if (!passed)
+            ++failed;
+        else if (!result.timesPassed)
+            ++slow;
+
+        printf("%s %-12s", passed ? (result.timesPassed ? "PASS" : "WARN") : "FAIL", test.name.c_str());
+        if (result.goldenFound)
+            printf(" | image dE %.2f, changed %.2f%% (max %.2f%%)", result.meanDeltaE,
+                   result.changedPixels * 100.0f, pixelTolerance * 100.0f);
+        else
+            printf(" | no reference image (run with --update-golden)");
+        printf(" | draws %d/%d, triangles %lld/%lld | cpu %.2f/%.2f ms, gpu %.2f/%.2f ms\n",
+               result.drawCalls, test.maxDrawCalls, result.triangles, test.maxTriangles,
+               result.cpuTime, test.cpuBudget * (1.0 + timeTolerance),
+               result.gpuTime, test.gpuBudget * (1.0 + timeTolerance));
+    }
+    printf("%d of %d regression cases passed", (int)results.size() - failed, (int)results.size());
+    if (slow > 0)
+        printf(", %d of them over their time budget", slow);
+    printf("\n");
+    return failed == 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// image helpers
+///////////////////////////////////////////////////////////////////////////////
+void RegressionSuite::downsample(const unsigned char* pixels, int width, int height, std::vector<unsigned char>& out)
+{
+    int outWidth = width / DOWNSAMPLE, outHeight = height / DOWNSAMPLE;
+    out.resize(outWidth * outHeight * 3);
+    for (int y = 0; y < outHeight; ++y)
+    {
+        for (int x = 0; x < outWidth; ++x)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                int sum = 0;
+                for (int dy = 0; dy < DOWNSAMPLE; ++dy)
+                {
+                    const unsigned char* row = &pixels[((y * DOWNSAMPLE + dy) * width + x * DOWNSAMPLE) * 3 + c];
+                    for (int dx = 0; dx < DOWNSAMPLE; ++dx)
+                        sum += row[dx * 3];
+                }
+                out[(y * outWidth + x) * 3 + c] = (unsigned char)((sum + DOWNSAMPLE * DOWNSAMPLE / 2) / (DOWNSAMPLE * DOWNSAMPLE));
+            }
+        }
+    }
+}
+
+// binary PPM as written by HeadlessContext::writePPM
+bool RegressionSuite::readPPM(const char* filename, int& width, int& height, std::vector<unsigned char>& pixels)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+        return false;
+
+    int maxValue = 0;
+    bool ok = fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && maxValue == 255 &&
+              width > 0 && height > 0 && fgetc(file) != EOF;
+    if (ok)
+    {
+        pixels.resize((size_t)width * height * 3);
+        ok = fread(&pixels[0], 3, (size_t)width * height, file) == (size_t)width * height;
+    }
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// RegressionSuite.h
+// =================
+// Golden-image and performance-budget checks for fixed camera poses.
+// A suite file lists one case per line:
+//   name x y z yaw pitch perspective drawCalls triangles cpuMs gpuMs
+// plus optional tolerance lines:
+//   tolerance time 0.5         budget overshoot allowed for CPU/GPU time
+//   tolerance deltaE 10        CIE76 difference at which a pixel counts as changed
+//   tolerance pixels 0.005     fraction of changed pixels allowed
+// Rendered frames are box-filtered by 4 before the comparison, which also
+// absorbs single-pixel edge and filtering differences between drivers.
+// A case fails on its image, on more draw calls or triangles than allowed,
+// or on CPU or GPU time over its budget plus the time tolerance. Times depend
+// on the machine the budgets were measured on (see the suite file), so
+// setTimeBudgets(false) turns time overruns into warnings on other machines.
+// References live in golden/<name>.ppm next to the suite file.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef REGRESSION_SUITE_H
+#define REGRESSION_SUITE_H
+
+#include <string>
+#include <vector>
+
+#include "CameraPath.h"
+
+struct RegressionCase
+{
+    std::string name;
+    CameraKey camera;
+    int maxDrawCalls;
+    long long maxTriangles;
+    double cpuBudget;                       // ms
+    double gpuBudget;                       // ms
+};
+
+// measurements of one case
+struct RegressionResult
+{
+    int drawCalls;
+    long long triangles;
+    double cpuTime;                         // ms, median over the measured frames
+    double gpuTime;                         // ms
+    float meanDeltaE;
+    float changedPixels;                    // fraction
+    bool goldenFound;
+    bool imagePassed;
+    bool countsPassed;                      // draw calls and triangles
+    bool timesPassed;                       // CPU and GPU time
+};
+
+class RegressionSuite
+{
+public:
+    RegressionSuite();
+    ~RegressionSuite() {}
+
+    bool load(const char* filename);
+    // on by default; off, time over budget only warns
+    void setTimeBudgets(bool enable)        { timeBudgets = enable; }
+
+    int getCaseCount() const                { return (int)cases.size(); }
+    const RegressionCase& getCase(int index) const { return cases[index]; }
+
+    // compares the frame (RGB8, top row first) with the reference image and the
+    // measurements the caller filled in (draw calls to GPU time) with the budgets
+    void evaluate(int index, const unsigned char* pixels, int width, int height, RegressionResult& result) const;
+    // replaces the reference image of a case with the frame
+    bool updateGolden(int index, const unsigned char* pixels, int width, int height) const;
+
+    // one line per case; true if every case passed
+    bool report(const std::vector<RegressionResult>& results) const;
+
+private:
+    std::string getGoldenFilename(int index) const;
+    static void downsample(const unsigned char* pixels, int width, int height, std::vector<unsigned char>& out);
+    static bool readPPM(const char* filename, int& width, int& height, std::vector<unsigned char>& pixels);
+
+    std::vector<RegressionCase> cases;
+    std::string directory;                  // of the suite file, with a trailing separator
+    double timeTolerance;
+    bool timeBudgets;
+    float deltaETolerance;
+    float pixelTolerance;
+};
+
+#endif
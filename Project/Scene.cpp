@@ -0,0 +1,520 @@
+///////////////////////////////////////////////////////////////////////////////
+// Scene.cpp
+// =========
+// CPU-side description of the desk scene (see Scene.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "CpuProfiler.h"
+#include "Scene.h"
+#include "Cylinder.h"
+#include "Sphere.h"
+
+
+
+// Vertex, Normal, and UV data (non-circular items only) //////////////////////
+namespace {
+    // saves triangles for the plane
+    const float vertsPlane[] = {
+        1.0f, 1.0f, 0.0f,  // triangle 1
+        -1.0f, 1.0f, 0.0f,
+        1.0f, -1.0f, 0.0f,
+
+        -1.0f, 1.0f, 0.0f,  // triangle 2
+        1.0f, -1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f
+    };
+    // save normal data for plane
+    const float normalPlane[] = {
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f
+    };
+    // saves the color data for the plane
+    const float uvPlane[] = {
+        1.0f, 1.0f,
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f
+    };
+    // saves triangles for the pyramid
+    const float vertsP[] = {
+         0.5f,  0.3f,  0.0f, // face 1
+         0.5f, -0.3f,  0.0f,
+         0.0f,  0.0f,  1.0f,
+
+         0.5f, -0.3f,  0.0f, // face 2
+        -0.5f, -0.3f,  0.0f,
+         0.0f,  0.0f,  1.0f,
+
+        -0.5f, -0.3f,  0.0f, // face 3
+        -0.5f,  0.3f,  0.0f,
+         0.0f,  0.0f,  1.0f,
+
+        -0.5f,  0.3f,  0.0f, // face 4
+         0.5f,  0.3f,  0.0f,
+         0.0f,  0.0f,  1.0f,
+
+         0.5f,  0.3f,  0.0f, // base 1
+        -0.5f, -0.3f,  0.0f,
+        -0.5f,  0.3f,  0.0f,
+
+         0.5f,  0.3f,  0.0f, // base 2
+        -0.5f, -0.3f,  0.0f,
+         0.5f, -0.3f,  0.0f
+    };
+    // saves normal data for the pyramid
+    const float normalP[] = {
+        0.6f, 0.0f, 0.3f,
+        0.6f, 0.0f, 0.3f,
+        0.6f, 0.0f, 0.3f,
+
+        0.0f, -1.0f, 0.3f,
+        0.0f, -1.0f, 0.3f,
+        0.0f, -1.0f, 0.3f,
+
+        -0.6f, 0.0f, 0.3f,
+        -0.6f, 0.0f, 0.3f,
+        -0.6f, 0.0f, 0.3f,
+
+        0.0f, 1.0f, 0.3f,
+        0.0f, 1.0f, 0.3f,
+        0.0f, 1.0f, 0.3f,
+
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f
+    };
+    // saves uv data for the pyramid
+    const float uvP[] = {
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.5f, 1.0f,
+
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.5f, 1.0f,
+
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.5f, 1.0f,
+
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.5f, 1.0f,
+
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f
+    };
+    // saves triangles for the cube
+    const float vertsCube[] = {
+         1.0f,  1.0f,  1.0f, //face 1 (top)
+        -1.0f,  1.0f,  1.0f,
+         1.0f, -1.0f,  1.0f,
+        -1.0f,  1.0f,  1.0f,
+         1.0f, -1.0f,  1.0f,
+        -1.0f, -1.0f,  1.0f,
+
+         1.0f, -1.0f,  1.0f, // face 2 (front)
+        -1.0f, -1.0f,  1.0f,
+         1.0f, -1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,
+         1.0f, -1.0f, -1.0f,
+        -1.0f, -1.0f, -1.0f,
+
+         1.0f,  1.0f,  1.0f, //face 3 (right)
+         1.0f, -1.0f,  1.0f,
+         1.0f,  1.0f, -1.0f,
+         1.0f, -1.0f,  1.0f,
+         1.0f,  1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+
+        -1.0f,  1.0f,  1.0f, //face 4 (back)
+         1.0f,  1.0f,  1.0f,
+        -1.0f,  1.0f, -1.0f,
+         1.0f,  1.0f,  1.0f,
+        -1.0f,  1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+
+        -1.0f, -1.0f,  1.0f, //face 5 (left)
+        -1.0f,  1.0f,  1.0f,
+        -1.0f, -1.0f, -1.0f,
+        -1.0f,  1.0f,  1.0f,
+        -1.0f, -1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,
+
+        -1.0f,  1.0f, -1.0f, // face 6 (bottom)
+        -1.0f, -1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+        -1.0f, -1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f
+    };
+    // saves normal data for the cube
+    const float normalCube[] = {
+        0.0f, 0.0f, 1.0f, //top
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+
+        0.0f, -1.0f, 0.0f, //front
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+
+        1.0f, 0.0f, 0.0f, //right
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+
+        0.0f, 1.0f, 0.0f, //back
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+
+        -1.0f, 0.0f, 0.0f, //left
+        -1.0f, 0.0f, 0.0f,
+        -1.0f, 0.0f, 0.0f,
+        -1.0f, 0.0f, 0.0f,
+        -1.0f, 0.0f, 0.0f,
+        -1.0f, 0.0f, 0.0f,
+
+        0.0f, 0.0f, -1.0f, //bottom
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f
+    };
+    // saves uv data for the cube
+    const float repeat = 3.0f;
+    const float uvCube[] = {
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+
+        repeat, repeat,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, repeat,
+        repeat, 0.0f,
+        0.0f, 0.0f,
+    };
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+    // interleave separate position/normal/uv arrays into V/N/T
+    void interleave(SceneMesh& mesh, const float* verts, const float* normals, const float* uvs, int vertexCount)
+    {
+        mesh.interleavedVertices.clear();
+        mesh.interleavedVertices.reserve(vertexCount * 8);
+        for (int i = 0; i < vertexCount; ++i)
+        {
+            mesh.interleavedVertices.insert(mesh.interleavedVertices.end(), verts + i * 3, verts + i * 3 + 3);
+            mesh.interleavedVertices.insert(mesh.interleavedVertices.end(), normals + i * 3, normals + i * 3 + 3);
+            mesh.interleavedVertices.insert(mesh.interleavedVertices.end(), uvs + i * 2, uvs + i * 2 + 2);
+        }
+    }
+
+    // copy the interleaved data of a Sphere or Cylinder
+    template <class Shape>
+    void copyShape(SceneMesh& mesh, const Shape& shape)
+    {
+        const float* data = shape.getInterleavedVertices();
+        mesh.interleavedVertices.assign(data, data + shape.getInterleavedVertexSize() / sizeof(float));
+        mesh.indices.assign(shape.getIndices(), shape.getIndices() + shape.getIndexCount());
+    }
+
+    void computeBounds(SceneMesh& mesh)
+    {
+        mesh.boundsMin = glm::vec3(0.0f);
+        mesh.boundsMax = glm::vec3(0.0f);
+        for (unsigned int i = 0; i < mesh.getVertexCount(); ++i)
+        {
+            const float* v = &mesh.interleavedVertices[i * 8];
+            glm::vec3 p(v[0], v[1], v[2]);
+            mesh.boundsMin = (i == 0) ? p : glm::min(mesh.boundsMin, p);
+            mesh.boundsMax = (i == 0) ? p : glm::max(mesh.boundsMax, p);
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+Scene::Scene()
+{
+    buildMeshes();
+    buildObjects();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// texture file for each SceneTextureId
+///////////////////////////////////////////////////////////////////////////////
+const char* Scene::getTextureFilename(int id)
+{
+    static const char* const filenames[TEX_COUNT] = {
+        "../resources/textures/wood.jpg",
+        "../resources/textures/blueSquare.jpg",
+        "../resources/textures/cardboard.jpg",
+        "../resources/textures/tissue.jpg",
+        "../resources/textures/aloe.jpg",
+        "../resources/textures/yellowFluid.jpg",
+        "../resources/textures/greyPlastic.jpg",
+        "../resources/textures/blueRubber.jpg"
+    };
+    return filenames[id];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform the 8 corners of the object-space box and take their extent
+///////////////////////////////////////////////////////////////////////////////
+void Scene::getWorldBounds(const SceneObject& object, glm::vec3& worldMin, glm::vec3& worldMax) const
+{
+    const SceneMesh& mesh = meshes[object.mesh];
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                         (i & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                         (i & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+        glm::vec3 p = glm::vec3(object.model * glm::vec4(corner, 1.0f));
+        worldMin = (i == 0) ? p : glm::min(worldMin, p);
+        worldMax = (i == 0) ? p : glm::max(worldMax, p);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// build the CPU copies of every mesh
+///////////////////////////////////////////////////////////////////////////////
+void Scene::buildMeshes()
+{
+    interleave(meshes[MESH_PLANE], vertsPlane, normalPlane, uvPlane, 6);
+    interleave(meshes[MESH_PYRAMID], vertsP, normalP, uvP, 18);
+    interleave(meshes[MESH_CUBE], vertsCube, normalCube, uvCube, 36);
+
+    {
+        PROFILE_SCOPE("Cylinder cap");
+        Cylinder cap;
+        cap.setHeight(1.75f);
+        copyShape(meshes[MESH_CAP], cap);
+    }
+
+    {
+        PROFILE_SCOPE("Cylinder container");
+        Cylinder container;
+        container.setHeight(1.0f);
+        copyShape(meshes[MESH_CONTAINER], container);
+    }
+
+    {
+        PROFILE_SCOPE("Sphere ball");
+        // create a sphere with default params
+        Sphere ball;
+        copyShape(meshes[MESH_BALL], ball);
+    }
+
+    for (int i = 0; i < MESH_COUNT; ++i)
+        computeBounds(meshes[i]);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// place the objects in the world, in draw order (occluders first)
+///////////////////////////////////////////////////////////////////////////////
+void Scene::buildObjects()
+{
+    // 1. Scales the plane
+    glm::mat4 scalePlane = glm::scale(glm::vec3(10.0f, 6.0f, 5.0f));
+    // 2. Rotates plane
+    glm::mat4 rotationPlane = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    // 3. Place plane
+    glm::mat4 translationPlane = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelTable = translationPlane * rotationPlane * scalePlane;
+
+    // 1. Scales the pyramid
+    glm::mat4 scalePyramid = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
+    // 2. Rotates pyramid
+    glm::mat4 rotationPyramid = glm::rotate(2.5f, glm::vec3(0.0f, 0.0f, 1.0f));
+    // 3. Place pyramid
+    glm::mat4 translationPyramid = glm::translate(glm::vec3(1.0f, -2.0f, 0.0f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelPyramid = translationPyramid * rotationPyramid * scalePyramid;
+
+    // 1. Scales the cap
+    glm::mat4 scaleCap = glm::scale(glm::vec3(0.5f, 0.5f, 0.5f));
+    // 2. Rotates cap
+    glm::mat4 rotationCap = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
+    // 3. Place cap
+    glm::mat4 translationCap = glm::translate(glm::vec3(1.0f, -2.0f, 2.6f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelCap = translationCap * rotationCap * scaleCap;
+
+    // 1. Scales the cube
+    glm::mat4 scaleCube = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
+    // 2. Rotates cube
+    glm::mat4 rotationCube = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
+    // 3. Place cube
+    glm::mat4 translationCube = glm::translate(glm::vec3(-5.0f, 0.0f, 3.0f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelCube = translationCube * rotationCube * scaleCube;
+
+    // 1. Scales the hole
+    glm::mat4 scaleHole = glm::scale(glm::vec3(1.0f, 2.0f, 1.0f));
+    // 2. Rotates hole
+    glm::mat4 rotationHole = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
+    // 3. Place hole
+    glm::mat4 translationHole = glm::translate(glm::vec3(-5.0f, 0.0f, 6.001f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelHole = translationHole * rotationHole * scaleHole;
+
+    // 1. Scales the tissue
+    glm::mat4 scaleTissue = glm::scale(glm::vec3(3.0f, 1.9f, 1.0f));
+    // 2. Rotates tissue
+    glm::mat4 rotationTissue = glm::rotate(1.57f, glm::vec3(0.0f, 1.0f, 0.0f));
+    // 3. Place tissue
+    glm::mat4 translationTissue = glm::translate(glm::vec3(-5.0f, 0.0f, 6.0f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelTissue = translationTissue * rotationTissue * scaleTissue;
+
+    // 1. Scales the green container
+    glm::mat4 scaleContainer = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
+    // 2. Rotates green container
+    glm::mat4 rotationContainer = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
+    // 3. Place green container
+    glm::mat4 translationContainer = glm::translate(glm::vec3(3.0f, 3.0f, 1.5f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelContainer = translationContainer * rotationContainer * scaleContainer;
+
+    // 1. Scales the ball
+    glm::mat4 scaleBall = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
+    // 2. Rotates ball
+    glm::mat4 rotationBall = glm::rotate(1.5f, glm::vec3(1.0f, 1.0f, 1.0f));
+    // 3. Place ball
+    glm::mat4 translationBall = glm::translate(glm::vec3(2.0f, 2.0f, 5.0f));
+    // Model matrix: transformations are applied right-to-left order
+    glm::mat4 modelBall = translationBall * rotationBall * scaleBall;
+
+    objects.clear();
+    objects.push_back({ "table",          MESH_PLANE,      TEX_WOOD,          modelTable,      true,  GROUP_NONE       });
+    objects.push_back({ "tissue box",     MESH_CUBE,       TEX_BLUE_SQUARE,   modelCube,       true,  GROUP_TISSUE_BOX });
+    objects.push_back({ "tissue hole",    MESH_PLANE,      TEX_CARDBOARD,     modelHole,       false, GROUP_TISSUE_BOX });
+    objects.push_back({ "tissue",         MESH_PLANE,      TEX_TISSUE,        modelTissue,     false, GROUP_TISSUE_BOX });
+    objects.push_back({ "pyramid",        MESH_PYRAMID,    TEX_YELLOW_FLUID,  modelPyramid,    false, GROUP_SANITIZER  });
+    objects.push_back({ "cap",            MESH_CAP,        TEX_GREY_PLASTIC,  modelCap,        false, GROUP_SANITIZER  });
+    objects.push_back({ "aloe container", MESH_CONTAINER,  TEX_ALOE,          modelContainer,  false, GROUP_NONE       });
+    objects.push_back({ "stress ball",    MESH_BALL,       TEX_BLUE_RUBBER,   modelBall,       false, GROUP_NONE       });
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fill a square around the desk with randomly picked, scaled and rotated
+// copies of the ball, the container, the bottle and the cap
+///////////////////////////////////////////////////////////////////////////////
+void Scene::addClutter(int count, unsigned int seed)
+{
+    static const int meshIds[] = { MESH_BALL, MESH_CONTAINER, MESH_PYRAMID, MESH_CAP };
+    static const int textureIds[] = { TEX_BLUE_RUBBER, TEX_ALOE, TEX_YELLOW_FLUID, TEX_GREY_PLASTIC };
+
+    // small LCG so every run builds the same scene
+    unsigned int state = seed;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+
+    int side = (int)std::ceil(std::sqrt((float)count));
+    float spacing = 2.5f;
+    float offset = -0.5f * spacing * (side - 1);
+
+    objects.reserve(objects.size() + count);
+    for (int i = 0; i < count; ++i)
+    {
+        int kind = (int)(random() * 4.0f) % 4;
+        float size = 0.3f + random() * 0.5f;
+        glm::vec3 position(offset + spacing * (i % side) + random() - 0.5f,
+                           offset + spacing * (i / side) + random() - 0.5f,
+                           size);
+        glm::mat4 model = glm::translate(position) *
+                          glm::rotate(random() * 6.2832f, glm::vec3(0.0f, 0.0f, 1.0f)) *
+                          glm::scale(glm::vec3(size));
+
+        objects.push_back({ "clutter", meshIds[kind], textureIds[kind], model, false, GROUP_NONE });
+    }
+}
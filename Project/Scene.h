@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+// Scene.h
+// =======
+// CPU-side description of the desk scene.
+// - meshes  : V/N/T interleaved vertex data (same 32 byte layout as Sphere and
+//             Cylinder) with an object-space bounding box
+// - objects : a mesh placed in the world with a model matrix and a texture
+// The renderer uploads the meshes once and walks the object list every frame.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// meshes shared by the scene objects
+enum SceneMeshId {
+    MESH_PLANE,
+    MESH_PYRAMID,
+    MESH_CUBE,
+    MESH_CAP,
+    MESH_CONTAINER,
+    MESH_BALL,
+    MESH_COUNT
+};
+
+// textures used by the scene objects
+enum SceneTextureId {
+    TEX_WOOD,           // table
+    TEX_BLUE_SQUARE,    // tissue box
+    TEX_CARDBOARD,      // tissue box hole
+    TEX_TISSUE,         // tissue
+    TEX_ALOE,           // aloe container
+    TEX_YELLOW_FLUID,   // hand sanitizer
+    TEX_GREY_PLASTIC,   // cap
+    TEX_BLUE_RUBBER,    // stress ball
+    TEX_COUNT
+};
+
+// objects that sit on or in each other and can be culled as one
+enum SceneGroupId {
+    GROUP_NONE = -1,
+    GROUP_TISSUE_BOX,   // box, hole and tissue
+    GROUP_SANITIZER,    // bottle and cap
+    GROUP_COUNT
+};
+
+struct SceneMesh
+{
+    std::vector<float> interleavedVertices;     // V/N/T, 8 floats per vertex
+    std::vector<unsigned int> indices;          // empty if drawn as a plain triangle list
+    glm::vec3 boundsMin;                        // object-space bounding box
+    glm::vec3 boundsMax;
+
+    unsigned int getVertexCount() const     { return (unsigned int)interleavedVertices.size() / 8; }
+    unsigned int getDrawCount() const       { return indices.empty() ? getVertexCount() : (unsigned int)indices.size(); }
+    unsigned int getTriangleCount() const   { return getDrawCount() / 3; }
+    bool isIndexed() const                  { return !indices.empty(); }
+};
+
+struct SceneObject
+{
+    const char* name;
+    int mesh;                   // SceneMeshId
+    int texture;                // SceneTextureId
+    glm::mat4 model;
+    bool occluder;              // large enough to hide other objects
+    int group;                  // SceneGroupId
+};
+
+class Scene
+{
+public:
+    Scene();
+    ~Scene() {}
+
+    const SceneMesh& getMesh(int id) const              { return meshes[id]; }
+    const std::vector<SceneObject>& getObjects() const  { return objects; }
+    int getObjectCount() const                          { return (int)objects.size(); }
+
+    static const char* getTextureFilename(int id);
+
+    // scatter extra copies of the small objects around the desk (stress tests)
+    void addClutter(int count, unsigned int seed=1);
+
+    // object-space bounding box transformed to a world-space box
+    void getWorldBounds(const SceneObject& object, glm::vec3& worldMin, glm::vec3& worldMax) const;
+
+private:
+    void buildMeshes();
+    void buildObjects();
+
+    SceneMesh meshes[MESH_COUNT];
+    std::vector<SceneObject> objects;
+};
+
+#endif
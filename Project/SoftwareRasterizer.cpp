@@ -0,0 +1,617 @@
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareRasterizer.cpp
+// ======================
+// CPU rendering backend for machines without a GPU
+// (see SoftwareRasterizer.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RASTER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "MipGenerator.h"
+#include "Scene.h"
+#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int TILE_SIZE = 64;                   // pixels, a multiple of 4
+const float MIN_TRIANGLE_AREA = 1.0e-6f;    // in pixels^2
+
+// FragmentShader.fs
+const float AMBIENT_STRENGTH = 0.1f;
+const float SPECULAR_INTENSITY = 0.4f;
+const float HIGHLIGHT_SIZE = 16.0f;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, ThreadPool* threadPool)
+    : width(width), height(height), depthStride((width + 3) & ~3),
+      tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+      threadPool(threadPool), viewProjection(1.0f), cameraPosition(0.0f),
+      triangleCount(0), geometryTime(0.0), binningTime(0.0), rasterTime(0.0)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        lightPositions[i] = glm::vec3(0.0f);
+        lightColors[i] = glm::vec3(0.0f);
+    }
+    clearColor[0] = clearColor[1] = clearColor[2] = 0;
+
+    // depth rows are processed 4 pixels at a time, so pad them to a multiple of 4
+    depthBuffer.assign(depthStride * height, 1.0f);
+    colorBuffer.assign(width * height * 3, 0);
+    bins.resize(tilesX * tilesY);
+    tilePixels.assign(tilesX * tilesY, 0);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scene state
+///////////////////////////////////////////////////////////////////////////////
+bool SoftwareRasterizer::setTexture(int id, const unsigned char* pixels, int width, int height, int channels)
+{
+    if (id < 0 || channels < 1 || channels > 4)
+        return false;
+
+    if (id >= (int)textures.size())
+        textures.resize(id + 1);
+    std::vector<TextureLevel>& levels = textures[id].levels;
+    levels.resize(getMipLevelCount(width, height));
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].texels.resize(width * height * 4);
+    // grey is spread to RGB like the GL swizzle in createTexture()
+    const int green = channels >= 3 ? 1 : 0;
+    const int blue = channels >= 3 ? 2 : 0;
+    const int alpha = channels == 2 ? 1 : 3;
+    for (int i = 0; i < width * height; ++i)
+    {
+        const unsigned char* pixel = &pixels[i * channels];
+        unsigned char* texel = &levels[0].texels[i * 4];
+        texel[0] = pixel[0];
+        texel[1] = pixel[green];
+        texel[2] = pixel[blue];
+        texel[3] = (channels == 2 || channels == 4) ? pixel[alpha] : 255;
+    }
+
+    // the same linear light levels the GL path uploads
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        const TextureLevel& source = levels[level - 1];
+        levels[level].width = std::max(source.width / 2, 1);
+        levels[level].height = std::max(source.height / 2, 1);
+        levels[level].texels.resize(levels[level].width * levels[level].height * 4);
+        generateMipLevel(source.texels.data(), source.width, source.height, 4, levels[level].texels.data(), threadPool);
+    }
+    return true;
+}
+
+void SoftwareRasterizer::setLight(int index, const glm::vec3& position, const glm::vec3& color)
+{
+    lightPositions[index] = position;
+    lightColors[index] = color;
+}
+
+// same rounding as a GL clear of an 8 bit target
+void SoftwareRasterizer::setClearColor(const glm::vec3& color)
+{
+    for (int i = 0; i < 3; ++i)
+        clearColor[i] = (unsigned char)(glm::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// queue the draws of a frame
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareRasterizer::beginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition)
+{
+    viewProjection = projection * view;
+    this->cameraPosition = cameraPosition;
+    draws.clear();
+}
+
+void SoftwareRasterizer::drawMesh(const SceneMesh* mesh, const glm::mat4& model, int texture)
+{
+    Draw draw = { mesh, model, texture };
+    draws.push_back(draw);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform and set up every draw, bin the triangles, then fill the tiles
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareRasterizer::render()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    drawTriangles.resize(draws.size());
+    triangleCount = 0;
+    for (size_t i = 0; i < draws.size(); ++i)
+        triangleCount += draws[i].mesh->getTriangleCount();
+    if (threadPool)
+        threadPool->parallelFor((int)draws.size(), [this](int index) { processDraw(index); });
+    else
+    {
+        for (int i = 0; i < (int)draws.size(); ++i)
+            processDraw(i);
+    }
+    Clock::time_point geometryEnd = Clock::now();
+
+    binTriangles();
+    Clock::time_point binningEnd = Clock::now();
+
+    if (threadPool)
+        threadPool->parallelFor((int)tileOrder.size(), [this](int index) { rasterizeTile(tileOrder[index]); });
+    else
+    {
+        for (size_t i = 0; i < tileOrder.size(); ++i)
+            rasterizeTile(tileOrder[i]);
+    }
+    Clock::time_point rasterEnd = Clock::now();
+
+    geometryTime = std::chrono::duration<double, std::milli>(geometryEnd - start).count();
+    binningTime = std::chrono::duration<double, std::milli>(binningEnd - geometryEnd).count();
+    rasterTime = std::chrono::duration<double, std::milli>(rasterEnd - binningEnd).count();
+}
+
+long long SoftwareRasterizer::getPixelCount() const
+{
+    long long pixels = 0;
+    for (size_t i = 0; i < tilePixels.size(); ++i)
+        pixels += tilePixels[i];
+    return pixels;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// vertex stage of VertexShader.vs, then clipping and triangle setup
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareRasterizer::processDraw(int index)
+{
+    PROFILE_SCOPE("software geometry");
+    const Draw& draw = draws[index];
+    const SceneMesh& mesh = *draw.mesh;
+    const glm::mat4 mvp = viewProjection * draw.model;
+    const glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(draw.model)));
+
+    std::vector<ClipVertex> vertices(mesh.getVertexCount());
+    for (unsigned int i = 0; i < mesh.getVertexCount(); ++i)
+    {
+        const float* v = &mesh.interleavedVertices[i * 8];
+        glm::vec4 position(v[0], v[1], v[2], 1.0f);
+        glm::vec3 world = glm::vec3(draw.model * position);
+        glm::vec3 normal = normalMatrix * glm::vec3(v[3], v[4], v[5]);
+
+        ClipVertex& out = vertices[i];
+        out.position = mvp * position;
+        out.attributes[0] = world.x; out.attributes[1] = world.y; out.attributes[2] = world.z;
+        out.attributes[3] = normal.x; out.attributes[4] = normal.y; out.attributes[5] = normal.z;
+        out.attributes[6] = v[6]; out.attributes[7] = v[7];
+    }
+
+    std::vector<Triangle>& out = drawTriangles[index];
+    out.clear();
+    const unsigned int count = mesh.getDrawCount();
+    for (unsigned int i = 0; i + 2 < count; i += 3)
+    {
+        const ClipVertex& v0 = vertices[mesh.isIndexed() ? mesh.indices[i] : i];
+        const ClipVertex& v1 = vertices[mesh.isIndexed() ? mesh.indices[i + 1] : i + 1];
+        const ClipVertex& v2 = vertices[mesh.isIndexed() ? mesh.indices[i + 2] : i + 2];
+        clipTriangle(v0, v1, v2, draw.texture, out);
+    }
+}
+
+// reject triangles outside one frustum plane, clip the rest against the near plane
+void SoftwareRasterizer::clipTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2,
+                                      int texture, std::vector<Triangle>& out) const
+{
+    const ClipVertex* input[3] = { &v0, &v1, &v2 };
+    unsigned int outsideAll = 0x3f;
+    unsigned int outsideAny = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        const glm::vec4& p = input[k]->position;
+        unsigned int code = (p.x < -p.w ? 1 : 0) | (p.x > p.w ? 2 : 0) |
+                            (p.y < -p.w ? 4 : 0) | (p.y > p.w ? 8 : 0) |
+                            (p.z < -p.w ? 16 : 0) | (p.z > p.w ? 32 : 0);
+        outsideAll &= code;
+        outsideAny |= code;
+    }
+    if (outsideAll)
+        return;
+
+    Triangle tri;
+    if (!(outsideAny & 16))
+    {
+        if (setupTriangle(v0, v1, v2, texture, tri))
+            out.push_back(tri);
+        return;
+    }
+
+    // Sutherland-Hodgman against z >= -w; a triangle becomes at most a quad
+    ClipVertex polygon[4];
+    int count = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        const ClipVertex& a = *input[k];
+        const ClipVertex& b = *input[(k + 1) % 3];
+        float da = a.position.z + a.position.w;
+        float db = b.position.z + b.position.w;
+        if (da >= 0.0f)
+            polygon[count++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+        {
+            float t = da / (da - db);
+            ClipVertex& v = polygon[count++];
+            v.position = a.position + (b.position - a.position) * t;
+            for (int i = 0; i < ATTRIBUTE_COUNT; ++i)
+                v.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+        }
+    }
+    for (int k = 1; k + 1 < count; ++k)
+    {
+        if (setupTriangle(polygon[0], polygon[k], polygon[k + 1], texture, tri))
+            out.push_back(tri);
+    }
+}
+
+bool SoftwareRasterizer::setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2,
+                                       int texture, Triangle& tri) const
+{
+    const ClipVertex* v[3] = { &v0, &v1, &v2 };
+    float x[3], y[3], z[3], invW[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        const glm::vec4& p = v[k]->position;
+        invW[k] = 1.0f / p.w;
+        x[k] = (p.x * invW[k] * 0.5f + 0.5f) * width;
+        y[k] = (0.5f - p.y * invW[k] * 0.5f) * height;  // top row first
+        z[k] = p.z * invW[k] * 0.5f + 0.5f;
+    }
+
+    // make the area positive so inside means all edges >= 0
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (std::fabs(area) < MIN_TRIANGLE_AREA)
+        return false;
+    int i1 = 1, i2 = 2;
+    if (area < 0.0f)
+    {
+        std::swap(i1, i2);
+        area = -area;
+    }
+    const int order[3] = { 0, i1, i2 };
+
+    // pixel bounding box of the pixel centers that may be covered
+    float minX = std::min(x[0], std::min(x[1], x[2]));
+    float maxX = std::max(x[0], std::max(x[1], x[2]));
+    float minY = std::min(y[0], std::min(y[1], y[2]));
+    float maxY = std::max(y[0], std::max(y[1], y[2]));
+    tri.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+    tri.maxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+    tri.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+    tri.maxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return false;
+
+    // edge k is opposite to vertex k and weighs its values
+    for (int k = 0; k < 3; ++k)
+    {
+        int a = order[(k + 1) % 3], b = order[(k + 2) % 3];
+        tri.edges[k][0] = y[a] - y[b];
+        tri.edges[k][1] = x[b] - x[a];
+        tri.edges[k][2] = x[a] * y[b] - x[b] * y[a];
+    }
+
+    // values that are affine in screen space become planes
+    float invArea = 1.0f / area;
+    auto makePlane = [&](float f0, float f1, float f2, float* plane) {
+        const float f[3] = { f0, f1, f2 };
+        for (int c = 0; c < 3; ++c)
+            plane[c] = (tri.edges[0][c] * f[0] + tri.edges[1][c] * f[1] + tri.edges[2][c] * f[2]) * invArea;
+    };
+    makePlane(z[order[0]], z[order[1]], z[order[2]], tri.depth);
+    makePlane(invW[order[0]], invW[order[1]], invW[order[2]], tri.invW);
+    for (int i = 0; i < ATTRIBUTE_COUNT; ++i)
+    {
+        makePlane(v[order[0]]->attributes[i] * invW[order[0]],
+                  v[order[1]]->attributes[i] * invW[order[1]],
+                  v[order[2]]->attributes[i] * invW[order[2]], tri.attributes[i]);
+    }
+    tri.texture = texture;
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// append every triangle to the tiles its bounding box touches
+// Draw order is kept, so equal depths resolve like on the GPU.
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareRasterizer::binTriangles()
+{
+    PROFILE_SCOPE("software binning");
+    triangles.clear();
+    for (size_t i = 0; i < drawTriangles.size(); ++i)
+        triangles.insert(triangles.end(), drawTriangles[i].begin(), drawTriangles[i].end());
+
+    for (size_t i = 0; i < bins.size(); ++i)
+        bins[i].clear();
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        const Triangle& tri = triangles[i];
+        for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ++ty)
+        {
+            for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; ++tx)
+                bins[ty * tilesX + tx].push_back((int)i);
+        }
+    }
+
+    // the pool hands out tiles in order; starting with the busiest ones keeps
+    // a single expensive tile from finishing last on one thread
+    tileOrder.resize(bins.size());
+    for (size_t i = 0; i < tileOrder.size(); ++i)
+        tileOrder[i] = (int)i;
+    std::stable_sort(tileOrder.begin(), tileOrder.end(), [this](int a, int b) {
+        return bins[a].size() > bins[b].size();
+    });
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// clear one tile and draw its bin into it
+///////////////////////////////////////////////////////////////////////////////
+void SoftwareRasterizer::rasterizeTile(int tile)
+{
+    PROFILE_SCOPE("software tile");
+    int tileX0 = (tile % tilesX) * TILE_SIZE;
+    int tileY0 = (tile / tilesX) * TILE_SIZE;
+    int tileX1 = std::min(width, tileX0 + TILE_SIZE) - 1;
+    int tileY1 = std::min(height, tileY0 + TILE_SIZE) - 1;
+
+    for (int y = tileY0; y <= tileY1; ++y)
+    {
+        std::fill(&depthBuffer[y * depthStride + tileX0], &depthBuffer[y * depthStride + tileX1] + 1, 1.0f);
+        unsigned char* color = &colorBuffer[(y * width + tileX0) * 3];
+        for (int x = tileX0; x <= tileX1; ++x, color += 3)
+        {
+            color[0] = clearColor[0];
+            color[1] = clearColor[1];
+            color[2] = clearColor[2];
+        }
+    }
+
+    long long pixels = 0;
+    const std::vector<int>& bin = bins[tile];
+    for (size_t i = 0; i < bin.size(); ++i)
+        rasterizeTriangle(triangles[bin[i]], tileX0, tileY0, tileX1, tileY1, pixels);
+    tilePixels[tile] = pixels;
+}
+
+// half-space test and depth test 4 pixels at a time, then shade the survivors
+void SoftwareRasterizer::rasterizeTriangle(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1,
+                                           long long& pixels)
+{
+    int minX = std::max(tri.minX, tileX0);
+    int maxX = std::min(tri.maxX, tileX1);
+    int minY = std::max(tri.minY, tileY0);
+    int maxY = std::min(tri.maxY, tileY1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // tiles start on a multiple of 4, so aligned groups never leave the tile on the left
+    int startX = minX & ~3;
+    const float (*e)[3] = tri.edges;
+    const Texture* texture = getTexture(tri.texture);
+
+#ifdef SOFTWARE_RASTER_USE_SSE2
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 va0 = _mm_set1_ps(e[0][0]), va1 = _mm_set1_ps(e[1][0]), va2 = _mm_set1_ps(e[2][0]);
+    const __m128 vzA = _mm_set1_ps(tri.depth[0]);
+    const __m128 lastCenter = _mm_set1_ps(maxX + 0.5f);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float py = y + 0.5f;
+        float quadY = (y & ~1) + 0.5f;
+        __m128 row0 = _mm_set1_ps(e[0][1] * py + e[0][2]);
+        __m128 row1 = _mm_set1_ps(e[1][1] * py + e[1][2]);
+        __m128 row2 = _mm_set1_ps(e[2][1] * py + e[2][2]);
+        __m128 rowZ = _mm_set1_ps(tri.depth[1] * py + tri.depth[2]);
+        float* depthRow = &depthBuffer[y * depthStride];
+        unsigned char* colorRow = &colorBuffer[y * width * 3];
+
+        for (int x = startX; x <= maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(va0, px), row0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(va1, px), row1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(va2, px), row2);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+                            _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            // lanes right of the bounding box belong to the next tile or lie off screen
+            inside = _mm_and_ps(inside, _mm_cmple_ps(px, lastCenter));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(vzA, px), rowZ);
+            __m128 depth = _mm_loadu_ps(depthRow + x);
+            __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, depth));
+            int mask = _mm_movemask_ps(pass);
+            if (mask == 0)
+                continue;
+            _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, depth)));
+
+            // the group holds two 2x2 quads, lanes 0-1 and 2-3
+            float lods[2] = { 0.0f, 0.0f };
+            if (texture && (mask & 3))
+                lods[0] = getTextureLod(tri, texture->levels[0], x + 0.5f, quadY);
+            if (texture && (mask & 12))
+                lods[1] = getTextureLod(tri, texture->levels[0], x + 2.5f, quadY);
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (!(mask & (1 << lane)))
+                    continue;
+                glm::vec3 color = shade(tri, x + lane + 0.5f, py, texture, lods[lane >> 1]);
+                unsigned char* out = colorRow + (x + lane) * 3;
+                out[0] = (unsigned char)(color.r * 255.0f + 0.5f);
+                out[1] = (unsigned char)(color.g * 255.0f + 0.5f);
+                out[2] = (unsigned char)(color.b * 255.0f + 0.5f);
+                ++pixels;
+            }
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float py = y + 0.5f;
+        float* depthRow = &depthBuffer[y * depthStride];
+        unsigned char* colorRow = &colorBuffer[y * width * 3];
+        for (int x = minX; x <= maxX; ++x)
+        {
+            float px = x + 0.5f;
+            if (e[0][0] * px + e[0][1] * py + e[0][2] < 0.0f ||
+                e[1][0] * px + e[1][1] * py + e[1][2] < 0.0f ||
+                e[2][0] * px + e[2][1] * py + e[2][2] < 0.0f)
+                continue;
+
+            float z = tri.depth[0] * px + tri.depth[1] * py + tri.depth[2];
+            if (!(z < depthRow[x]))
+                continue;
+            depthRow[x] = z;
+
+            float lod = texture ? getTextureLod(tri, texture->levels[0], (x & ~1) + 0.5f, (y & ~1) + 0.5f) : 0.0f;
+            glm::vec3 color = shade(tri, px, py, texture, lod);
+            unsigned char* out = colorRow + x * 3;
+            out[0] = (unsigned char)(color.r * 255.0f + 0.5f);
+            out[1] = (unsigned char)(color.g * 255.0f + 0.5f);
+            out[2] = (unsigned char)(color.b * 255.0f + 0.5f);
+            ++pixels;
+        }
+    }
+    (void)startX;
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FragmentShader.fs for one pixel center, result clamped to [0, 1]
+///////////////////////////////////////////////////////////////////////////////
+glm::vec3 SoftwareRasterizer::shade(const Triangle& tri, float x, float y, const Texture* texture, float lod) const
+{
+    // perspective-correct attributes: (a/w) / (1/w)
+    float w = 1.0f / (tri.invW[0] * x + tri.invW[1] * y + tri.invW[2]);
+    float a[ATTRIBUTE_COUNT];
+    for (int i = 0; i < ATTRIBUTE_COUNT; ++i)
+        a[i] = (tri.attributes[i][0] * x + tri.attributes[i][1] * y + tri.attributes[i][2]) * w;
+    glm::vec3 fragmentPos(a[0], a[1], a[2]);
+    glm::vec3 norm = glm::normalize(glm::vec3(a[3], a[4], a[5]));
+
+    glm::vec3 ambient = AMBIENT_STRENGTH * lightColors[0] + AMBIENT_STRENGTH * lightColors[1];
+
+    glm::vec3 lightDirection0 = glm::normalize(lightPositions[0] - fragmentPos);
+    glm::vec3 lightDirection1 = glm::normalize(lightPositions[1] - fragmentPos);
+    float impact0 = std::max(glm::dot(norm, lightDirection0), 0.0f);
+    float impact1 = std::max(glm::dot(norm, lightDirection1), 0.0f);
+    glm::vec3 diffuse = impact0 * lightColors[0] + impact1 * lightColors[1];
+
+    // the shader computes a highlight for both lights but only adds the first one
+    glm::vec3 viewDir = glm::normalize(cameraPosition - fragmentPos);
+    glm::vec3 reflectDir0 = glm::reflect(-lightDirection0, norm);
+    float specularComponent0 = std::pow(std::max(glm::dot(viewDir, reflectDir0), 0.0f), HIGHLIGHT_SIZE);
+    glm::vec3 specular = SPECULAR_INTENSITY * specularComponent0 * lightColors[0];
+
+    glm::vec3 textureColor(1.0f);
+    if (texture)
+        textureColor = sampleTexture(*texture, a[6], a[7], lod);
+
+    return glm::clamp((ambient + diffuse + specular) * textureColor, 0.0f, 1.0f);
+}
+
+// null for an untextured triangle
+const SoftwareRasterizer::Texture* SoftwareRasterizer::getTexture(int id) const
+{
+    return (id >= 0 && id < (int)textures.size() && !textures[id].levels.empty()) ? &textures[id] : nullptr;
+}
+
+// log2 of the texels per pixel, like GL once per 2x2 pixel quad, at the
+// center of its top left pixel (which may lie outside the triangle). The
+// derivatives of u = (a/w) / (1/w) are exact there: du/dx = (A - u * W) * w,
+// with A and W the x slopes of a/w and 1/w.
+float SoftwareRasterizer::getTextureLod(const Triangle& tri, const TextureLevel& base, float quadX, float quadY) const
+{
+    float w = 1.0f / (tri.invW[0] * quadX + tri.invW[1] * quadY + tri.invW[2]);
+    float u = (tri.attributes[6][0] * quadX + tri.attributes[6][1] * quadY + tri.attributes[6][2]) * w;
+    float v = (tri.attributes[7][0] * quadX + tri.attributes[7][1] * quadY + tri.attributes[7][2]) * w;
+    float dudx = (tri.attributes[6][0] - u * tri.invW[0]) * w * base.width;
+    float dvdx = (tri.attributes[7][0] - v * tri.invW[0]) * w * base.height;
+    float dudy = (tri.attributes[6][1] - u * tri.invW[1]) * w * base.width;
+    float dvdy = (tri.attributes[7][1] - v * tri.invW[1]) * w * base.height;
+    float scale = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    return scale > 0.0f ? 0.5f * std::log2(scale) : 0.0f;
+}
+
+// GL_LINEAR_MIPMAP_LINEAR: the two levels around the lod, blended; level 0
+// when magnified
+glm::vec3 SoftwareRasterizer::sampleTexture(const Texture& texture, float u, float v, float lod) const
+{
+    const int lastLevel = (int)texture.levels.size() - 1;
+    if (!(lod > 0.0f))
+        return sampleLevel(texture.levels[0], u, v);
+    if (lod >= (float)lastLevel)
+        return sampleLevel(texture.levels[lastLevel], u, v);
+
+    int level = (int)lod;
+    float blend = lod - level;
+    glm::vec3 color = sampleLevel(texture.levels[level], u, v);
+    return color + (sampleLevel(texture.levels[level + 1], u, v) - color) * blend;
+}
+
+// GL_LINEAR with GL_REPEAT on both axes
+glm::vec3 SoftwareRasterizer::sampleLevel(const TextureLevel& level, float u, float v)
+{
+    float tx = u * level.width - 0.5f;
+    float ty = v * level.height - 0.5f;
+    float fx = std::floor(tx), fy = std::floor(ty);
+    float wx = tx - fx, wy = ty - fy;
+
+    int x0 = (int)fx % level.width, y0 = (int)fy % level.height;
+    if (x0 < 0) x0 += level.width;
+    if (y0 < 0) y0 += level.height;
+    int x1 = (x0 + 1 < level.width) ? x0 + 1 : 0;
+    int y1 = (y0 + 1 < level.height) ? y0 + 1 : 0;
+
+    const unsigned char* t00 = &level.texels[(y0 * level.width + x0) * 4];
+    const unsigned char* t10 = &level.texels[(y0 * level.width + x1) * 4];
+    const unsigned char* t01 = &level.texels[(y1 * level.width + x0) * 4];
+    const unsigned char* t11 = &level.texels[(y1 * level.width + x1) * 4];
+
+    glm::vec3 color;
+    for (int c = 0; c < 3; ++c)
+    {
+        float top = t00[c] + (t10[c] - t00[c]) * wx;
+        float bottom = t01[c] + (t11[c] - t01[c]) * wx;
+        color[c] = (top + (bottom - top) * wy) * (1.0f / 255.0f);
+    }
+    return color;
+}
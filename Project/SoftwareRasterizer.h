@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+// SoftwareRasterizer.h
+// ====================
+// CPU rendering backend for machines without a GPU.
+// Draws scene meshes with the shading of VertexShader.vs/FragmentShader.fs
+// (two point lights, Phong, trilinear repeat textures) into an RGB8 image.
+// - the near plane clips triangles; the other planes reject them or clamp
+//   their bounding boxes
+// - set-up triangles are binned into 64x64 tiles, and the tiles are
+//   rasterized in parallel, the busiest first
+// - 4 pixels are tested at a time with SSE2 when it is available
+// - attributes are interpolated perspective-correct (a/w and 1/w)
+// - textures get the linear light mip chain of the GL path (see
+//   MipGenerator.h) and are sampled like GL_LINEAR_MIPMAP_LINEAR, with the
+//   level from the texture coordinate derivatives once per 2x2 pixel quad
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+struct SceneMesh;
+
+class SoftwareRasterizer
+{
+public:
+    SoftwareRasterizer(int width, int height, ThreadPool* threadPool=nullptr);
+    ~SoftwareRasterizer() {}
+
+    int getWidth() const                    { return width; }
+    int getHeight() const                   { return height; }
+
+    // 1 to 4 channels, first row at t = 0 (as uploaded to GL)
+    bool setTexture(int id, const unsigned char* pixels, int width, int height, int channels);
+    void setLight(int index, const glm::vec3& position, const glm::vec3& color);
+    void setClearColor(const glm::vec3& color);
+
+    // per frame: set the camera, queue draws, then render all of them
+    void beginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition);
+    void drawMesh(const SceneMesh* mesh, const glm::mat4& model, int texture);
+    void render();
+
+    // RGB8, top row first
+    const unsigned char* getColorBuffer() const { return colorBuffer.data(); }
+
+    // stats of the last render()
+    int getDrawCount() const                { return (int)draws.size(); }
+    long long getTriangleCount() const      { return triangleCount; }       // submitted
+    int getSetupTriangleCount() const       { return (int)triangles.size(); } // after clipping and rejection
+    long long getPixelCount() const;        // shaded fragments
+    double getGeometryTime() const          { return geometryTime; }        // ms
+    double getBinningTime() const           { return binningTime; }         // ms
+    double getRasterTime() const            { return rasterTime; }          // ms
+
+private:
+    // world position, normal, texture coordinate
+    static const int ATTRIBUTE_COUNT = 8;
+
+    struct TextureLevel
+    {
+        int width, height;
+        std::vector<unsigned char> texels;  // RGBA8
+    };
+
+    struct Texture
+    {
+        std::vector<TextureLevel> levels;   // full size first, down to 1x1
+    };
+
+    struct Draw
+    {
+        const SceneMesh* mesh;
+        glm::mat4 model;
+        int texture;
+    };
+
+    struct ClipVertex
+    {
+        glm::vec4 position;                 // clip space
+        float attributes[ATTRIBUTE_COUNT];
+    };
+
+    // screen-space triangle, every value as a plane A * x + B * y + C
+    struct Triangle
+    {
+        float edges[3][3];                  // >= 0 inside
+        float depth[3];
+        float invW[3];
+        float attributes[ATTRIBUTE_COUNT][3];   // attribute / w
+        int minX, maxX, minY, maxY;         // pixel bounding box (inclusive)
+        int texture;
+    };
+
+    void processDraw(int index);
+    void clipTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int texture,
+                      std::vector<Triangle>& out) const;
+    bool setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int texture, Triangle& tri) const;
+    void binTriangles();
+    void rasterizeTile(int tile);
+    void rasterizeTriangle(const Triangle& tri, int tileX0, int tileY0, int tileX1, int tileY1, long long& pixels);
+    glm::vec3 shade(const Triangle& tri, float x, float y, const Texture* texture, float lod) const;
+    const Texture* getTexture(int id) const;
+    float getTextureLod(const Triangle& tri, const TextureLevel& base, float quadX, float quadY) const;
+    glm::vec3 sampleTexture(const Texture& texture, float u, float v, float lod) const;
+    static glm::vec3 sampleLevel(const TextureLevel& level, float u, float v);
+
+    int width;
+    int height;
+    int depthStride;                        // width rounded up to 4
+    int tilesX, tilesY;
+    ThreadPool* threadPool;                 // may be null (single-threaded)
+
+    std::vector<Texture> textures;
+    glm::vec3 lightPositions[2];
+    glm::vec3 lightColors[2];
+    unsigned char clearColor[3];
+
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    std::vector<Draw> draws;
+    std::vector<std::vector<Triangle> > drawTriangles;  // per draw, filled in parallel
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<int> > bins;    // triangle indices per tile
+    std::vector<int> tileOrder;             // most triangles first
+    std::vector<long long> tilePixels;
+
+    std::vector<float> depthBuffer;
+    std::vector<unsigned char> colorBuffer;
+
+    long long triangleCount;
+    double geometryTime;
+    double binningTime;
+    double rasterTime;
+};
+
+#endif
@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureArrays.cpp
+// =================
+// Packs the scene textures into GL_TEXTURE_2D_ARRAYs (see TextureArrays.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "CpuProfiler.h"
+#include "MipGenerator.h"
+#include "TextureArrays.h"
+#include "TextureLoader.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// grouping
+///////////////////////////////////////////////////////////////////////////////
+bool TextureArrays::matches(const TextureArray& array, const TextureImage& image)
+{
+    const CompressedTexture& compressed = image.compressed;
+    if (compressed.isValid())
+        return array.compressed && array.format == compressed.getFormat() && array.width == compressed.getWidth() &&
+               array.height == compressed.getHeight() && array.levelCount == compressed.getLevelCount();
+    return !array.compressed && array.format == image.channels && array.width == image.width &&
+           array.height == image.height;
+}
+
+void TextureArrays::setFormat(const TextureArray& array, GLenum& internalFormat, GLenum& format)
+{
+    if (array.compressed)
+    {
+        internalFormat = format = (array.format == COMPRESSED_BC3) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                                                                   : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        return;
+    }
+    const GLenum internalFormats[] = { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    const GLenum formats[] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    internalFormat = internalFormats[array.format];
+    format = formats[array.format];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// placeholder
+///////////////////////////////////////////////////////////////////////////////
+bool TextureArrays::init(int textureCount)
+{
+    release();
+
+    TextureArray placeholder;
+    placeholder.compressed = false;
+    placeholder.format = 4;
+    placeholder.width = placeholder.height = 1;
+    placeholder.levelCount = placeholder.layerCount = 1;
+    placeholder.firstLevel = placeholder.baseLevel = 0;
+
+    const unsigned char grey[] = { 128, 128, 128, 255 };
+    glGenTextures(1, &placeholder.id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, placeholder.id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    arrays.push_back(placeholder);
+
+    TextureLayer none = { 0, 0 };
+    layers.assign(textureCount, none);
+    targets.assign(textureCount, none);
+    return true;
+}
+
+void TextureArrays::release()
+{
+    for (size_t i = 0; i < arrays.size(); ++i)
+        glDeleteTextures(1, &arrays[i].id);
+    arrays.clear();
+    layers.clear();
+    targets.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// allocate arrays with all of their layers, the data comes later
+///////////////////////////////////////////////////////////////////////////////
+bool TextureArrays::allocate(const std::vector<int>& textures, const std::vector<const TextureImage*>& images,
+                             int maxFirstSize)
+{
+    PROFILE_SCOPE("TextureArrays::allocate");
+
+    GLint maxUnits = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const TextureImage& image = *images[i];
+        if (image.compressed.isValid() && !GLEW_EXT_texture_compression_s3tc)
+        {
+            printf("S3TC textures are not supported by the driver, run with --no-texture-cache\n");
+            return false;
+        }
+        if (!image.compressed.isValid() && (image.channels < 1 || image.channels > 4))
+        {
+            printf("Not implemented to handle image with %d channels\n", image.channels);
+            return false;
+        }
+    }
+
+    const size_t firstArray = arrays.size();
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const TextureImage& image = *images[i];
+        const CompressedTexture& compressed = image.compressed;
+
+        // arrays allocated earlier are full, only the new ones take layers
+        size_t index = firstArray;
+        while (index < arrays.size() && !matches(arrays[index], image))
+            ++index;
+        if (index == arrays.size())
+        {
+            if ((int)arrays.size() == maxUnits)
+            {
+                printf("More than %d texture arrays, %s stays a placeholder\n", maxUnits, image.filename.c_str());
+                continue;
+            }
+            TextureArray array;
+            array.id = 0;
+            array.compressed = compressed.isValid();
+            array.format = array.compressed ? compressed.getFormat() : image.channels;
+            array.width = array.compressed ? compressed.getWidth() : image.width;
+            array.height = array.compressed ? compressed.getHeight() : image.height;
+            array.levelCount = array.compressed ? compressed.getLevelCount() : 1;
+            array.layerCount = 0;
+            array.firstLevel = 0;
+            while (maxFirstSize > 0 && array.compressed && array.firstLevel < array.levelCount - 1 &&
+                   std::max(array.width, array.height) >> array.firstLevel > maxFirstSize)
+                ++array.firstLevel;
+            array.baseLevel = array.levelCount;
+            arrays.push_back(array);
+        }
+        targets[textures[i]].array = (int)index;
+        targets[textures[i]].layer = arrays[index].layerCount++;
+    }
+
+    for (size_t a = firstArray; a < arrays.size(); ++a)
+        createStorage(arrays[a]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return true;
+}
+
+
+
+void TextureArrays::share(int texture, int source)
+{
+    targets[texture] = targets[source];
+    layers[texture] = layers[source];
+}
+
+// a new texture object for the levels from array.firstLevel on
+void TextureArrays::createStorage(TextureArray& array)
+{
+    GLenum internalFormat, format;
+    setFormat(array, internalFormat, format);
+    const int width = std::max(array.width >> array.firstLevel, 1);
+    const int height = std::max(array.height >> array.firstLevel, 1);
+    const int levelCount = array.compressed ? array.levelCount - array.firstLevel : getMipLevelCount(width, height);
+
+    glGenTextures(1, &array.id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (!array.compressed && array.format <= 2)
+    {
+        // grey and grey+alpha stay small on the GPU, the sampler spreads them to RGBA
+        const GLint greySwizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        const GLint greyAlphaSwizzle[] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, array.format == 1 ? greySwizzle : greyAlphaSwizzle);
+    }
+
+    if (GLEW_ARB_texture_storage)
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, internalFormat, width, height, array.layerCount);
+    else if (array.compressed)
+    {
+        const int blockSize = (array.format == COMPRESSED_BC3) ? 16 : 8;
+        for (int level = 0; level < levelCount; ++level)
+        {
+            int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+            GLsizei size = ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize * array.layerCount;
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelWidth, levelHeight,
+                                   array.layerCount, 0, size, nullptr);
+        }
+    }
+    else
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, array.layerCount, 0, format,
+                     GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    if (array.baseLevel < array.levelCount)
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, array.baseLevel - array.firstLevel);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// adding and evicting fine levels
+///////////////////////////////////////////////////////////////////////////////
+bool TextureArrays::canMoveLevels()
+{
+    return GLEW_ARB_texture_storage && GLEW_VERSION_4_3;
+}
+
+void TextureArrays::setFirstLevel(int array, int level)
+{
+    PROFILE_SCOPE("TextureArrays::setFirstLevel");
+    TextureArray& a = arrays[array];
+    if (!a.compressed || level == a.firstLevel)
+        return;
+
+    // an evicted base level moves up to the new first level, which is uploaded
+    // as long as any level was
+    TextureArray moved = a;
+    moved.firstLevel = level;
+    if (moved.baseLevel < moved.levelCount)
+        moved.baseLevel = std::max(moved.baseLevel, level);
+    createStorage(moved);
+
+    // the levels both storages have and that hold data, all layers at once
+    for (int l = std::max(level, std::max(a.firstLevel, a.baseLevel)); l < a.levelCount; ++l)
+    {
+        const int width = std::max(a.width >> l, 1), height = std::max(a.height >> l, 1);
+        glCopyImageSubData(a.id, GL_TEXTURE_2D_ARRAY, l - a.firstLevel, 0, 0, 0, moved.id, GL_TEXTURE_2D_ARRAY,
+                           l - level, 0, 0, 0, width, height, a.layerCount);
+    }
+    glDeleteTextures(1, &a.id);
+    a = moved;
+}
+
+size_t TextureArrays::getStorageSize(int array, int firstLevel) const
+{
+    const TextureArray& a = arrays[array];
+    if (firstLevel < 0)
+        firstLevel = a.firstLevel;
+    size_t size = 0;
+    if (a.compressed)
+    {
+        for (int level = firstLevel; level < a.levelCount; ++level)
+        {
+            int rowCount;
+            size_t rowSize;
+            getLevelRows(array, level, rowCount, rowSize);
+            size += rowCount * rowSize;
+        }
+    }
+    else
+    {
+        for (int level = 0; level < getMipLevelCount(a.width, a.height); ++level)
+            size += (size_t)std::max(a.width >> level, 1) * std::max(a.height >> level, 1) * a.format;
+    }
+    return size * a.layerCount;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// filling and showing
+///////////////////////////////////////////////////////////////////////////////
+void TextureArrays::getLevelRows(int array, int level, int& rowCount, size_t& rowSize) const
+{
+    const TextureArray& a = arrays[array];
+    const int width = std::max(a.width >> level, 1), height = std::max(a.height >> level, 1);
+    if (a.compressed)
+    {
+        rowCount = (height + 3) / 4;
+        rowSize = (size_t)((width + 3) / 4) * ((a.format == COMPRESSED_BC3) ? 16 : 8);
+    }
+    else
+    {
+        rowCount = height;
+        rowSize = (size_t)width * a.format;
+    }
+}
+
+void TextureArrays::uploadRows(int texture, int level, int firstRow, int rowCount, const void* data) const
+{
+    const TextureLayer& target = targets[texture];
+    const TextureArray& array = arrays[target.array];
+    if (level < array.firstLevel)
+        return;
+    GLenum internalFormat, format;
+    setFormat(array, internalFormat, format);
+
+    const int width = std::max(array.width >> level, 1), height = std::max(array.height >> level, 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+    if (array.compressed)
+    {
+        // whole block rows; the last one may be cut off by the edge of the level
+        int levelRows;
+        size_t rowSize;
+        getLevelRows(target.array, level, levelRows, rowSize);
+        const int y = firstRow * 4;
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - array.firstLevel, 0, y, target.layer, width,
+                                  std::min(rowCount * 4, height - y), 1, format, (GLsizei)(rowSize * rowCount), data);
+    }
+    else
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - array.firstLevel, 0, firstRow, target.layer, width, rowCount, 1, format,
+                        GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArrays::show(int array, int baseLevel)
+{
+    TextureArray& a = arrays[array];
+    if (baseLevel < a.firstLevel)
+        return;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.id);
+    if (!a.compressed)
+    {
+        // only --no-texture-cache gets here: driver mips, filtered on the sRGB values
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        baseLevel = 0;
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, baseLevel - a.firstLevel);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if (a.baseLevel == a.levelCount)
+    {
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            if (targets[i].array == array)
+                layers[i] = targets[i];
+        }
+    }
+    a.baseLevel = baseLevel;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// per frame
+///////////////////////////////////////////////////////////////////////////////
+void TextureArrays::bind(int firstUnit) const
+{
+    for (size_t i = 0; i < arrays.size(); ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + (GLenum)i);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].id);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void TextureArrays::getArraySize(int array, int& width, int& height, int& layerCount) const
+{
+    width = arrays[array].width;
+    height = arrays[array].height;
+    layerCount = arrays[array].layerCount;
+}
@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureArrays.h
+// ===============
+// Packs the scene textures into GL_TEXTURE_2D_ARRAYs.
+// Textures with the same size, format and level count share one array, one
+// layer each (compiled textures are already resampled to power of two sizes
+// so similar textures meet, see CompressedTexture.h). Every array sits on its
+// own texture unit, so the scene binds its textures once per frame and a draw
+// only selects the unit and the layer through uniforms.
+// Textures with the same contents share a layer (see TextureLoader.h).
+// Arrays are allocated empty and filled row by row by the caller (see
+// TextureStreamer.h). Until an array is shown its textures are drawn from
+// array 0, a 1x1 grey placeholder. A shown array is sampled from its base
+// level up, so it can be shown with the coarse levels while the fine ones are
+// still being uploaded.
+// Storage is immutable (glTexStorage3D) where the driver has it. Compressed
+// arrays only hold their levels from the first level up: setFirstLevel()
+// moves them into new storage, copying the levels both have on the GPU, so
+// fine levels can be added or evicted (see TextureResidency.h). Levels are
+// always numbered as in the source texture.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURE_ARRAYS_H
+#define TEXTURE_ARRAYS_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+struct TextureImage;
+
+// where a texture is drawn from, or will be
+struct TextureLayer
+{
+    int array;                              // also the texture unit offset
+    int layer;
+};
+
+class TextureArrays
+{
+public:
+    TextureArrays() {}
+    ~TextureArrays() {}
+
+    // only the placeholder, every texture is drawn from it; needs a current GL context
+    bool init(int textureCount);
+    void release();
+
+    // allocates storage for images[i], which becomes texture textures[i]; the
+    // images only have to be loaded, their data is uploaded with uploadRows().
+    // Compressed arrays start with the levels up to maxFirstSize texels, all with 0.
+    bool allocate(const std::vector<int>& textures, const std::vector<const TextureImage*>& images,
+                  int maxFirstSize=0);
+    // texture is drawn from the layer of source, which has to be allocated
+    void share(int texture, int source);
+    // true if setFirstLevel() works with this driver
+    static bool canMoveLevels();
+    // new storage from level on, copying the uploaded levels that fit; compressed only
+    void setFirstLevel(int array, int level);
+
+    // upload granularity of a level: block rows if compressed, pixel rows otherwise
+    void getLevelRows(int array, int level, int& rowCount, size_t& rowSize) const;
+    // rows of one level of a texture; data is a client pointer, or an offset
+    // into the bound GL_PIXEL_UNPACK_BUFFER. Levels below the first are skipped.
+    void uploadRows(int texture, int level, int firstRow, int rowCount, const void* data) const;
+    // draws the textures of the array from it, sampling baseLevel and the
+    // levels above; uncompressed arrays get their mip levels generated here
+    void show(int array, int baseLevel);
+
+    // array i goes to texture unit firstUnit + i
+    void bind(int firstUnit=0) const;
+
+    int getArrayCount() const               { return (int)arrays.size(); }
+    int getTextureCount() const             { return (int)layers.size(); }
+    const TextureLayer& getLayer(int texture) const  { return layers[texture]; }
+    const TextureLayer& getTarget(int texture) const { return targets[texture]; }
+    bool isCompressed(int array) const      { return arrays[array].compressed; }
+    int getLevelCount(int array) const      { return arrays[array].levelCount; }
+    int getFirstLevel(int array) const      { return arrays[array].firstLevel; }
+    int getBaseLevel(int array) const       { return arrays[array].baseLevel; }
+    void getArraySize(int array, int& width, int& height, int& layerCount) const;
+    // bytes of storage from firstLevel on, all layers; the current storage with -1
+    size_t getStorageSize(int array, int firstLevel=-1) const;
+
+private:
+    struct TextureArray
+    {
+        GLuint id;
+        bool compressed;
+        int format;                         // CompressedFormat, or the # of channels
+        int width;
+        int height;
+        int levelCount;                     // of the source, uncompressed ones only have 1
+        int layerCount;
+        int firstLevel;                     // finest level with storage
+        int baseLevel;                      // finest level sampled, levelCount until shown
+    };
+
+    static bool matches(const TextureArray& array, const TextureImage& image);
+    static void setFormat(const TextureArray& array, GLenum& internalFormat, GLenum& format);
+    static void createStorage(TextureArray& array);
+
+    std::vector<TextureArray> arrays;
+    std::vector<TextureLayer> layers;       // per texture, what is drawn
+    std::vector<TextureLayer> targets;      // per texture, where its data goes
+};
+
+#endif
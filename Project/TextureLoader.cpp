@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureLoader.cpp
+// =================
+// Decodes a batch of image files in the background (see TextureLoader.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "stb_image.h"
+
+#include "AssetPack.h"
+#include "ContentHash.h"
+#include "CpuProfiler.h"
+#include "FramePacing.h"
+#include "MipGenerator.h"
+#include "TextureLoader.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int MAX_SCALE_SHIFT = 3;              // the decoder scales JPEGs down to 1/8
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// load sizes: powers of two fractions, rounded up as the decoder does
+///////////////////////////////////////////////////////////////////////////////
+static int getScaleShift(int width, int height, int maxSize)
+{
+    int shift = 0;
+    while (maxSize > 0 && shift < MAX_SCALE_SHIFT && std::max(width, height) > (maxSize << shift))
+        ++shift;
+    return shift;
+}
+
+static int scaleDown(int size, int shift)
+{
+    return (size + (1 << shift) - 1) >> shift;
+}
+
+// largest compressed levels that do not fit, the smallest one always stays
+static int getDroppedLevels(const CompressedTexture& texture, int maxSize)
+{
+    int count = 0;
+    while (maxSize > 0 && count + 1 < texture.getLevelCount() &&
+           std::max(texture.getLevel(count).width, texture.getLevel(count).height) > maxSize)
+        ++count;
+    return count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// image file -> bytes -> pixels in upload layout
+///////////////////////////////////////////////////////////////////////////////
+static bool readFile(const char* filename, std::vector<unsigned char>& bytes)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+        return false;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        bytes.resize((size_t)size);
+        ok = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+// at 1 / (1 << shift) of the file size
+static void decodeImage(const unsigned char* data, size_t byteCount, int shift, TextureImage& image)
+{
+    if (byteCount == 0)
+        return;
+    const int size = (int)byteCount;
+
+    // RGB is expanded to RGBA by the decoder itself: drivers take RGBA8 as
+    // is, and stb_image only uses its SIMD JPEG color conversion for 4 channels
+    int width = 0, height = 0, channels = 0;
+    int desiredChannels = (stbi_info_from_memory(data, size, &width, &height, &channels) && channels == 3) ? 4 : 0;
+
+    // rows are written bottom-up right after decoding, GL's Y axis goes up
+    stbi_set_flip_vertically_on_load_thread(1);
+    stbi_set_jpeg_scale_thread(shift);
+    image.pixels = stbi_load_from_memory(data, size, &image.width, &image.height, &channels, desiredChannels);
+    image.channels = desiredChannels ? desiredChannels : channels;
+
+    // only JPEGs come out scaled, the other formats are resampled to the same size
+    width = scaleDown(width, shift);
+    height = scaleDown(height, shift);
+    if (image.pixels && (image.width != width || image.height != height))
+    {
+        // stb_image allocates with malloc too, stbi_image_free() frees either
+        unsigned char* scaled = (unsigned char*)malloc((size_t)width * height * image.channels);
+        if (scaled)
+            resampleImage(image.pixels, image.width, image.height, image.channels, scaled, width, height, nullptr);
+        stbi_image_free(image.pixels);
+        image.pixels = scaled;
+        image.width = width;
+        image.height = height;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/dtor
+///////////////////////////////////////////////////////////////////////////////
+TextureLoader::TextureLoader(int threadCount) : threadCount(threadCount), compressedCache(false), assetPack(nullptr),
+                                                maxImageSize(0), nextImage(0),
+                                                startTime(0.0), returned(0), contentHits(0), contentMisses(0)
+{
+    if (this->threadCount <= 0)
+    {
+        int hardwareThreads = (int)std::thread::hardware_concurrency();
+        this->threadCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+    }
+}
+
+TextureLoader::~TextureLoader()
+{
+    for (size_t i = 0; i < decoders.size(); ++i)
+        decoders[i].join();
+    for (size_t i = 0; i < images.size(); ++i)
+        freeImage((int)i);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// decode everything on the loader's threads, so start() returns
+///////////////////////////////////////////////////////////////////////////////
+void TextureLoader::start(const std::vector<const char*>& filenames)
+{
+    images.resize(filenames.size());
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        TextureImage& image = images[i];
+        image.filename = filenames[i];
+        AssetView file;
+        const bool packed = assetPack && assetPack->find(image.filename, file);
+        if (!(packed ? stbi_info_from_memory(file.data, (int)file.size, &image.fileWidth, &image.fileHeight, &image.fileChannels)
+                     : stbi_info(filenames[i], &image.fileWidth, &image.fileHeight, &image.fileChannels)))
+            image.fileWidth = image.fileHeight = image.fileChannels = 0;
+        image.fileSize = image.fileHash = 0;
+        image.source = (int)i;
+        image.pixels = nullptr;
+        image.width = image.height = image.channels = 0;
+        image.compressed.clear();
+        image.cached = false;
+        image.decodeTime = 0.0;
+    }
+    ready.clear();
+    waiting.clear();
+    finished.assign(images.size(), false);
+    contents.clear();
+    returned = contentHits = contentMisses = 0;
+    startTime = getFrameClock();
+
+    nextImage = 0;
+    const int count = (int)images.size();
+    for (int t = 0; t < std::min(threadCount, count); ++t)
+    {
+        decoders.push_back(std::thread([this, count]() {
+            PROFILE_THREAD_NAME("texture loader");
+            for (int i = nextImage++; i < count; i = nextImage++)
+                decode(i);
+        }));
+    }
+}
+
+void TextureLoader::decode(int index)
+{
+    PROFILE_SCOPE("decode texture");
+    TextureImage& image = images[index];
+    double start = getFrameClock();
+
+    // the pack index has the hash and nothing is read yet; a file is read
+    // once, for the hash and then the decoder
+    std::vector<unsigned char> bytes;
+    AssetView file = {};
+    const bool packed = assetPack && assetPack->find(image.filename, file);
+    bool found = packed;
+    if (!packed && readFile(image.filename.c_str(), bytes))
+    {
+        file.data = bytes.data();
+        file.size = bytes.size();
+        file.hash = hashContent(bytes.data(), bytes.size());
+        found = true;
+    }
+    if (found)
+    {
+        image.fileSize = file.size;
+        image.fileHash = file.hash;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto inserted = contents.insert(std::make_pair(std::make_pair(image.fileSize, image.fileHash), index));
+        image.source = inserted.first->second;
+        if (inserted.second)
+            ++contentMisses;
+        else
+            ++contentHits;
+    }
+    if (image.source != index)
+    {
+        image.decodeTime = (getFrameClock() - start) * 1000.0;
+        finishImage(index);
+        return;
+    }
+
+    std::string cacheFilename;
+    if (compressedCache && found)
+    {
+        cacheFilename = CompressedTexture::getCacheFilename(image.filename);
+        AssetView compiled;
+        if (assetPack && assetPack->find(cacheFilename, compiled))
+        {
+            if (AssetPack::verify(compiled))
+                image.cached = image.compressed.view(compiled.data, compiled.size, image.fileSize, image.fileHash);
+            else
+                printf("%s is corrupt in the asset pack, reading the file\n", cacheFilename.c_str());
+        }
+        if (!image.cached)
+            image.cached = image.compressed.load(cacheFilename.c_str(), image.fileSize, image.fileHash);
+    }
+
+    if (image.cached)
+    {
+        image.compressed.dropLevels(getDroppedLevels(image.compressed, maxImageSize));
+        image.width = image.compressed.getWidth();
+        image.height = image.compressed.getHeight();
+        image.channels = (image.compressed.getFormat() == COMPRESSED_BC3) ? 4 : 3;
+    }
+    else
+    {
+        // a packed image is only checked when it is decoded
+        if (packed && !AssetPack::verify(file))
+        {
+            printf("%s is corrupt in the asset pack, reading the file\n", image.filename.c_str());
+            file.size = readFile(image.filename.c_str(), bytes) ? bytes.size() : 0;
+            file.data = bytes.data();
+        }
+        // the cache is always compiled from the full size
+        const int shift = cacheFilename.empty() ? getScaleShift(image.fileWidth, image.fileHeight, maxImageSize) : 0;
+        decodeImage(file.data, file.size, shift, image);
+
+        // first run: compile on this thread, the pool is busy with the other images
+        if (image.pixels && !cacheFilename.empty())
+        {
+            image.compressed.compile(image.pixels, image.width, image.height, image.channels, nullptr);
+            image.compressed.setSource(image.fileSize, image.fileHash);
+            image.compressed.save(cacheFilename.c_str());
+            image.compressed.dropLevels(getDroppedLevels(image.compressed, maxImageSize));
+            stbi_image_free(image.pixels);
+            image.pixels = nullptr;
+            image.width = image.compressed.getWidth();
+            image.height = image.compressed.getHeight();
+            image.channels = (image.compressed.getFormat() == COMPRESSED_BC3) ? 4 : 3;
+        }
+    }
+    image.decodeTime = (getFrameClock() - start) * 1000.0;
+    finishImage(index);
+}
+
+// a shared image waits for its source
+void TextureLoader::finishImage(int index)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const int source = images[index].source;
+        if (source != index && !finished[source])
+        {
+            waiting.push_back(index);
+            return;
+        }
+        pushReady(index);
+        for (size_t i = 0; i < waiting.size();)
+        {
+            if (images[waiting[i]].source != index)
+            {
+                ++i;
+                continue;
+            }
+            pushReady(waiting[i]);
+            waiting.erase(waiting.begin() + i);
+        }
+    }
+    readyCondition.notify_one();
+}
+
+// with the mutex locked; a shared image takes over the size of its source
+void TextureLoader::pushReady(int index)
+{
+    TextureImage& image = images[index];
+    const TextureImage& source = images[image.source];
+    image.width = source.width;
+    image.height = source.height;
+    image.channels = source.channels;
+    ready.push_back(index);
+    finished[index] = true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// finished images, in completion order
+///////////////////////////////////////////////////////////////////////////////
+bool TextureLoader::next(int& index)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (returned == (int)images.size())
+        return false;
+    readyCondition.wait(lock, [this] { return !ready.empty(); });
+    index = ready.front();
+    ready.pop_front();
+    ++returned;
+    return true;
+}
+
+bool TextureLoader::poll(int& index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready.empty())
+        return false;
+    index = ready.front();
+    ready.pop_front();
+    ++returned;
+    return true;
+}
+
+void TextureLoader::getLoadSize(int index, int& width, int& height) const
+{
+    const TextureImage& image = images[index];
+    width = image.fileWidth;
+    height = image.fileHeight;
+    if (width <= 0 || height <= 0)
+        return;
+    if (!compressedCache)
+    {
+        const int shift = getScaleShift(width, height, maxImageSize);
+        width = scaleDown(width, shift);
+        height = scaleDown(height, shift);
+        return;
+    }
+    // as getDroppedLevels() on the full chain
+    CompressedTexture::getLayerSize(width, height, width, height);
+    while (maxImageSize > 0 && std::max(width, height) > maxImageSize && (width > 1 || height > 1))
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+void TextureLoader::freeImage(int index)
+{
+    stbi_image_free(images[index].pixels);
+    images[index].pixels = nullptr;
+    images[index].compressed.clear();
+}
+
+int TextureLoader::getThreadCount() const
+{
+    return threadCount;
+}
+
+double TextureLoader::getElapsedTime() const
+{
+    return (getFrameClock() - startTime) * 1000.0;
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureLoader.h
+// ===============
+// Decodes a batch of image files in the background.
+// start() returns right away. The loader's own threads claim one image at a
+// time, so a long batch never holds up the ThreadPool that the per-frame work
+// runs on, and next() hands finished images to the caller in completion
+// order. That way the GL thread can upload one texture while the others are
+// still being decoded. Images come out ready to upload: bottom-up rows, RGB
+// expanded to RGBA, grey and grey+alpha left as 1 or 2 channels.
+// With the compressed cache enabled, an image whose .ctex file is up to date
+// is read from there instead of being decoded. Otherwise it is decoded,
+// compiled and the .ctex written for the next run, and only the compressed
+// levels are handed out.
+// The file headers are read by start() itself, so the size of every image is
+// known before any of them is decoded.
+// With an asset pack (see AssetPack.h) the files and .ctex caches are read
+// from its mapping, the compiled levels without a copy.
+// Images are content addressed: every file is read once and hashed (see
+// ContentHash.h), and a file with the same bytes as another one in the batch,
+// under whatever name, is neither decoded nor compiled again. It shares the
+// pixels of that image, its source, and is handed out right after it, so the
+// caller can point it at whatever it made of the source.
+// With a maximum image size, images are loaded at the largest fraction of
+// their size, down to 1/8, whose larger side fits: JPEGs decode at 1/2, 1/4
+// or 1/8 straight from the DCT coefficients (a local stb_image patch, see
+// stb_image_jpeg_scale.patch), other formats are decoded and resampled, and
+// compressed ones skip their largest stored levels. getLoadSize() tells the
+// size of an image before it is loaded.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CompressedTexture.h"
+
+class AssetPack;
+
+struct TextureImage
+{
+    std::string filename;
+    int fileWidth;                          // from the file header, 0 if unreadable
+    int fileHeight;
+    int fileChannels;                       // 1 to 4, as stored in the file
+    unsigned long long fileSize;            // bytes, 0 if unreadable
+    unsigned long long fileHash;            // of the file contents
+    int source;                             // image with the same contents returned first, else its own index
+    unsigned char* pixels;                  // null if decoding failed, compressed or shared
+    int width;
+    int height;
+    int channels;                           // 1, 2 or 4
+    CompressedTexture compressed;           // valid instead of pixels with the cache
+    bool cached;                            // compressed came from an up to date .ctex
+    double decodeTime;                      // ms, on the decoding thread
+};
+
+class TextureLoader
+{
+public:
+    // threadCount = 0 uses one thread per hardware thread, minus one
+    explicit TextureLoader(int threadCount = 0);
+    ~TextureLoader();                       // waits for the decodes still running
+
+    // set before start(); off by default
+    void setCompressedCache(bool enable)    { compressedCache = enable; }
+    bool getCompressedCache() const         { return compressedCache; }
+    // images and their compiled versions come from the pack where it has
+    // them; it has to stay open as long as the images are used
+    void setAssetPack(const AssetPack* pack) { assetPack = pack; }
+    // larger side of the loaded images, 0 loads them at full size
+    void setMaxImageSize(int size)          { maxImageSize = size; }
+    int getMaxImageSize() const             { return maxImageSize; }
+    void start(const std::vector<const char*>& filenames);
+
+    // blocks until another image is decoded; false once every image was returned
+    bool next(int& index);
+    // like next(), but false right away when no image is ready
+    bool poll(int& index);
+    const TextureImage& getImage(int index) const   { return images[index]; }
+    // size the image will have once loaded, from its file header; 0 if unreadable
+    void getLoadSize(int index, int& width, int& height) const;
+    void freeImage(int index);
+
+    int getImageCount() const               { return (int)images.size(); }
+    int getThreadCount() const;             // threads decoding in parallel
+    double getElapsedTime() const;          // ms since start()
+    // images whose contents an earlier one had, and the ones that were loaded
+    int getContentHits() const              { return contentHits; }
+    int getContentMisses() const            { return contentMisses; }
+
+private:
+    void decode(int index);
+    void finishImage(int index);
+    void pushReady(int index);
+
+    int threadCount;
+    bool compressedCache;
+    const AssetPack* assetPack;             // may be null
+    int maxImageSize;
+    std::vector<std::thread> decoders;
+    std::atomic<int> nextImage;             // next index a decoder claims
+    std::vector<TextureImage> images;
+    double startTime;
+
+    std::mutex mutex;
+    std::condition_variable readyCondition;
+    std::deque<int> ready;                  // decoded, not returned yet
+    std::vector<int> waiting;               // shared images whose source is still decoding
+    std::vector<bool> finished;             // per image, in ready or returned
+    std::map<std::pair<unsigned long long, unsigned long long>, int> contents; // size and hash -> first image
+    int returned;
+    int contentHits;
+    int contentMisses;
+};
+
+#endif
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureResidency.cpp
+// ====================
+// Keeps only the mip levels the camera needs on the GPU (see TextureResidency.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+#include "CpuProfiler.h"
+#include "TextureArrays.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int MIN_RESIDENT_SIZE = 128;          // texels, the tail that is never evicted
+const int LEVEL_BIAS = 1;                   // finer than the screen size asks, textures wrap around curved meshes
+const unsigned int IDLE_FRAMES = 120;       // a level nobody needed for this long is evicted
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/init
+///////////////////////////////////////////////////////////////////////////////
+TextureResidency::TextureResidency() : arrays(nullptr), streamer(nullptr), enabled(false), budget(0), frame(0),
+                                       evictedLevels(0), streamedLevels(0)
+{
+}
+
+bool TextureResidency::init(TextureArrays* arrays, TextureStreamer* streamer, size_t byteBudget)
+{
+    this->arrays = arrays;
+    this->streamer = streamer;
+    budget = byteBudget;
+    frame = 0;
+    states.clear();
+    screenSizes.assign(arrays->getTextureCount(), 0.0f);
+    evictedLevels = streamedLevels = 0;
+
+    // storage is only resized by copying levels into new immutable storage
+    enabled = TextureArrays::canMoveLevels();
+    if (enabled)
+        streamer->setPartialArrays(MIN_RESIDENT_SIZE);
+    return enabled;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// levels in and out
+///////////////////////////////////////////////////////////////////////////////
+int TextureResidency::getTailLevel(int array) const
+{
+    int width, height, layerCount;
+    arrays->getArraySize(array, width, height, layerCount);
+    int level = 0;
+    while (level < arrays->getLevelCount(array) - 1 && std::max(width, height) >> level > MIN_RESIDENT_SIZE)
+        ++level;
+    return level;
+}
+
+void TextureResidency::moveFirstLevel(int array, int level)
+{
+    const int first = arrays->getFirstLevel(array);
+    arrays->setFirstLevel(array, level);
+
+    // new levels, and the ones the old storage only had partly, are uploaded again
+    const int levelCount = arrays->getLevelCount(array);
+    const int base = arrays->getBaseLevel(array);
+    const int last = (base == levelCount) ? levelCount - 1 : base - 1;
+    if (level <= last)
+        streamer->requestLevels(array, level, last);
+    if (level < first)
+        streamedLevels += first - level;
+}
+
+bool TextureResidency::evictLevel(int array, size_t& residentSize)
+{
+    const int first = arrays->getFirstLevel(array);
+    if (first >= getTailLevel(array))
+        return false;
+    const size_t size = arrays->getStorageSize(array);
+    moveFirstLevel(array, first + 1);
+    residentSize -= size - arrays->getStorageSize(array);
+    ++evictedLevels;
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// per frame
+///////////////////////////////////////////////////////////////////////////////
+void TextureResidency::beginFrame()
+{
+    ++frame;
+    std::fill(screenSizes.begin(), screenSizes.end(), 0.0f);
+}
+
+void TextureResidency::addUse(int texture, float screenSize)
+{
+    screenSizes[texture] = std::max(screenSizes[texture], screenSize);
+}
+
+void TextureResidency::update()
+{
+    if (!enabled)
+        return;
+    PROFILE_SCOPE("TextureResidency::update");
+
+    // arrays allocated since the last frame count as just used
+    while ((int)states.size() < arrays->getArrayCount())
+    {
+        ArrayState state = { frame, frame, arrays->getLevelCount((int)states.size()) };
+        states.push_back(state);
+    }
+
+    // the level whose size matches the largest use of each drawn array
+    for (size_t a = 0; a < states.size(); ++a)
+        states[a].neededLevel = arrays->getLevelCount((int)a);
+    for (size_t t = 0; t < screenSizes.size(); ++t)
+    {
+        const int array = arrays->getTarget((int)t).array;
+        if (screenSizes[t] <= 0.0f || array == 0 || !arrays->isCompressed(array))
+            continue;
+        int width, height, layerCount;
+        arrays->getArraySize(array, width, height, layerCount);
+        const float texelsPerPixel = std::max(width, height) / std::max(screenSizes[t], 1.0f);
+        int level = (int)std::floor(std::log2(std::max(texelsPerPixel, 1.0f))) - LEVEL_BIAS;
+        level = std::min(std::max(level, 0), getTailLevel(array));
+        states[array].neededLevel = std::min(states[array].neededLevel, level);
+        states[array].lastUse = frame;
+    }
+
+    // levels that went unneeded for a while are evicted, one at a time
+    size_t residentSize = getResidentSize();
+    for (int a = 1; a < (int)states.size(); ++a)
+    {
+        ArrayState& state = states[a];
+        if (!arrays->isCompressed(a))
+            continue;
+        if (state.neededLevel <= arrays->getFirstLevel(a))
+            state.lastNeeded = frame;
+        else if (frame - state.lastNeeded > IDLE_FRAMES && evictLevel(a, residentSize))
+            state.lastNeeded = frame;
+    }
+
+    // grow the arrays that are too coarse, making room from the least recently used
+    for (int a = 1; a < (int)states.size(); ++a)
+    {
+        const int first = arrays->getFirstLevel(a);
+        if (!arrays->isCompressed(a) || states[a].neededLevel >= first)
+            continue;
+        int level = states[a].neededLevel;
+        size_t growth = arrays->getStorageSize(a, level) - arrays->getStorageSize(a);
+        while (budget > 0 && residentSize + growth > budget)
+        {
+            // only levels finer than their array needs this frame
+            int victim = -1;
+            for (int v = 1; v < (int)states.size(); ++v)
+            {
+                if (v == a || !arrays->isCompressed(v) ||
+                    arrays->getFirstLevel(v) >= std::min(states[v].neededLevel, getTailLevel(v)))
+                    continue;
+                if (victim < 0 || states[v].lastUse < states[victim].lastUse)
+                    victim = v;
+            }
+            if (victim < 0 || !evictLevel(victim, residentSize))
+                break;
+        }
+        while (budget > 0 && level < first && residentSize + growth > budget)
+        {
+            ++level;
+            growth = arrays->getStorageSize(a, level) - arrays->getStorageSize(a);
+        }
+        if (level < first)
+        {
+            moveFirstLevel(a, level);
+            residentSize += growth;
+        }
+    }
+}
+
+size_t TextureResidency::getResidentSize() const
+{
+    size_t size = 0;
+    for (int a = 0; a < arrays->getArrayCount(); ++a)
+        size += arrays->getStorageSize(a);
+    return size;
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureResidency.h
+// ==================
+// Keeps only the mip levels the camera needs on the GPU, under a byte budget.
+// Every frame the drawn objects report how many pixels they span on screen.
+// An array needs the level whose size matches the largest of its textures on
+// screen; a coarser array gets new storage down to that level and the
+// streamer uploads the missing levels. Levels nobody needed for a while are
+// evicted, and when growing an array would go over the budget, the arrays
+// used least recently lose their finest levels first. If that is not enough
+// the array grows only as far as the budget allows.
+// The coarse tail of every array (up to MIN_RESIDENT_SIZE texels) is never
+// evicted, so an object always has something to draw. Only compressed arrays
+// take part; uncompressed ones (--no-texture-cache) keep all their levels.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <stddef.h>
+#include <vector>
+
+class TextureArrays;
+class TextureStreamer;
+
+class TextureResidency
+{
+public:
+    TextureResidency();
+    ~TextureResidency() {}
+
+    // byteBudget 0 has no limit, only the levels in use stay; false if the
+    // driver cannot move levels between storages, which keeps every level
+    bool init(TextureArrays* arrays, TextureStreamer* streamer, size_t byteBudget);
+    bool isEnabled() const                  { return enabled; }
+
+    // per frame, before the streamer's update()
+    void beginFrame();
+    void addUse(int texture, float screenSize);    // pixels the object spans
+    void update();
+
+    size_t getResidentSize() const;         // bytes of all arrays, the placeholder included
+    size_t getBudget() const                { return budget; }
+    int getEvictedLevels() const            { return evictedLevels; }   // since init()
+    int getStreamedLevels() const           { return streamedLevels; }  // requested after the first ones
+
+private:
+    struct ArrayState
+    {
+        unsigned int lastUse;               // frame the array was last drawn
+        unsigned int lastNeeded;            // frame its first level was last needed
+        int neededLevel;                    // this frame, levelCount if not drawn
+    };
+
+    int getTailLevel(int array) const;
+    bool evictLevel(int array, size_t& residentSize);
+    void moveFirstLevel(int array, int level);
+
+    TextureArrays* arrays;
+    TextureStreamer* streamer;
+    bool enabled;
+    size_t budget;
+    unsigned int frame;
+    std::vector<ArrayState> states;
+    std::vector<float> screenSizes;         // per texture, this frame
+    int evictedLevels;
+    int streamedLevels;
+};
+
+#endif
@@ -0,0 +1,399 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureStreamer.cpp
+// ===================
+// Uploads loaded textures a little every frame (see TextureStreamer.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+#include "CpuProfiler.h"
+#include "FramePacing.h"
+#include "TextureArrays.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const size_t RING_SIZE = 16 << 20;          // a few frames of uploads in flight
+const size_t MAX_UPLOAD_SIZE = 1 << 20;     // per glTexSubImage call, keeps the ring from clogging
+const GLuint64 WAIT_TIMEOUT = 1000000000;   // ns per glClientWaitSync, retried
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/init
+///////////////////////////////////////////////////////////////////////////////
+TextureStreamer::TextureStreamer() : loader(nullptr), arrays(nullptr), ringBuffer(0), ringData(nullptr), head(0),
+                                     tail(0), fencedHead(0), firstSize(0), received(0), complete(true),
+                                     uploadedBytes(0), uploadTime(0.0), maxFrameTime(0.0), waitTime(0.0), frames(0),
+                                     completeTime(0.0)
+{
+}
+
+bool TextureStreamer::init(TextureLoader* loader, TextureArrays* arrays)
+{
+    release();
+    this->loader = loader;
+    this->arrays = arrays;
+
+    // group by the array size the file headers promise: compiled textures
+    // are resampled to their layer size, decoded ones keep theirs, both
+    // scaled down to the maximum size of the loader
+    const int count = loader->getImageCount();
+    std::vector<int> keys((size_t)count * 3);
+    textureGroups.assign(count, -1);
+    groups.clear();
+    for (int i = 0; i < count; ++i)
+    {
+        const TextureImage& image = loader->getImage(i);
+        int width, height;
+        loader->getLoadSize(i, width, height);
+        const bool alpha = (image.fileChannels == 2 || image.fileChannels == 4);
+        int* key = &keys[(size_t)i * 3];
+        key[0] = width;
+        key[1] = height;
+        key[2] = loader->getCompressedCache() ? (alpha ? 1 : 0) : image.fileChannels;
+
+        for (int j = 0; j < i && width > 0; ++j)
+        {
+            if (std::equal(key, key + 3, &keys[(size_t)j * 3]))
+            {
+                textureGroups[i] = textureGroups[j];
+                break;
+            }
+        }
+        if (textureGroups[i] < 0)
+        {
+            textureGroups[i] = (int)groups.size();
+            groups.push_back(Group());
+            groups.back().loaded = 0;
+        }
+        groups[textureGroups[i]].textures.push_back(i);
+    }
+
+    uploads.clear();
+    layersLeft.assign(arrays->getArrayCount(), std::vector<int>());
+    levelsLeft.assign(count, 0);
+    received = 0;
+    complete = (count == 0);
+    uploadedBytes = 0;
+    uploadTime = maxFrameTime = waitTime = completeTime = 0.0;
+    frames = 0;
+
+    // one buffer mapped for good, the GL thread writes into it while the GPU reads older parts
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &ringBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, RING_SIZE, nullptr, flags);
+        ringData = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, RING_SIZE, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!ringData)
+        {
+            glDeleteBuffers(1, &ringBuffer);
+            ringBuffer = 0;
+        }
+    }
+    head = tail = fencedHead = 0;
+    return true;
+}
+
+void TextureStreamer::release()
+{
+    if (ringBuffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &ringBuffer);
+        ringBuffer = 0;
+        ringData = nullptr;
+    }
+    for (size_t i = 0; i < fences.size(); ++i)
+        glDeleteSync(fences[i].sync);
+    fences.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// loaded images -> arrays and upload work
+///////////////////////////////////////////////////////////////////////////////
+void TextureStreamer::receive(int texture)
+{
+    ++received;
+    Group& group = groups[textureGroups[texture]];
+    if (++group.loaded < (int)group.textures.size())
+        return;
+
+    // the whole group is in: allocate its arrays and queue every level
+    std::vector<int> textures;
+    std::vector<const TextureImage*> images;
+    for (size_t i = 0; i < group.textures.size(); ++i)
+    {
+        const TextureImage& image = loader->getImage(group.textures[i]);
+        if (image.source != group.textures[i])
+            continue;
+        if (image.pixels || image.compressed.isValid())
+        {
+            textures.push_back(group.textures[i]);
+            images.push_back(&image);
+        }
+        else
+            printf("Failed to load texture %s\n", image.filename.c_str());
+    }
+
+    const int firstArray = arrays->getArrayCount();
+    const bool allocated = textures.empty() || arrays->allocate(textures, images, firstSize);
+    for (int a = firstArray; a < arrays->getArrayCount(); ++a)
+    {
+        int width, height, layerCount;
+        arrays->getArraySize(a, width, height, layerCount);
+        layersLeft.push_back(std::vector<int>(arrays->getLevelCount(a), layerCount));
+    }
+
+    for (size_t i = 0; i < group.textures.size(); ++i)
+    {
+        const int t = group.textures[i];
+        const int source = loader->getImage(t).source;
+        if (source != t)
+        {
+            // same contents as a texture that is in the group too, nothing to upload
+            arrays->share(t, source);
+            continue;
+        }
+        const int array = arrays->getTarget(t).array;
+        const bool loaded = std::find(textures.begin(), textures.end(), t) != textures.end();
+        if (!allocated || !loaded || array == 0)
+        {
+            // stays a placeholder
+            loader->freeImage(t);
+            continue;
+        }
+
+        const int levelCount = arrays->getLevelCount(array);
+        levelsLeft[t] = levelCount - arrays->getFirstLevel(array);
+        for (int level = levelCount - 1; level >= arrays->getFirstLevel(array); --level)
+        {
+            Upload upload = { t, level, 0 };
+            queue(upload);
+        }
+    }
+}
+
+// keeps the queue sorted coarsest level first
+void TextureStreamer::queue(const Upload& upload)
+{
+    uploads.insert(std::upper_bound(uploads.begin(), uploads.end(), upload,
+                                    [](const Upload& a, const Upload& b) { return a.level > b.level; }),
+                   upload);
+}
+
+void TextureStreamer::requestLevels(int array, int first, int last)
+{
+    // rows already sent of these levels may be gone with the old storage, start over
+    uploads.erase(std::remove_if(uploads.begin(), uploads.end(),
+                                 [&](const Upload& upload) {
+                                     return arrays->getTarget(upload.texture).array == array &&
+                                            upload.level >= first && upload.level <= last;
+                                 }),
+                  uploads.end());
+
+    int width, height, layerCount;
+    arrays->getArraySize(array, width, height, layerCount);
+    for (int level = last; level >= first; --level)
+    {
+        layersLeft[array][level] = layerCount;
+        for (int t = 0; t < arrays->getTextureCount(); ++t)
+        {
+            if (arrays->getTarget(t).array != array || loader->getImage(t).source != t)
+                continue;
+            Upload upload = { t, level, 0 };
+            queue(upload);
+        }
+    }
+}
+
+void TextureStreamer::finishRows(const Upload& upload)
+{
+    const TextureLayer& target = arrays->getTarget(upload.texture);
+    if (--layersLeft[target.array][upload.level] == 0)
+        arrays->show(target.array, upload.level);
+    if (firstSize == 0 && --levelsLeft[upload.texture] == 0)
+        loader->freeImage(upload.texture);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ring buffer
+///////////////////////////////////////////////////////////////////////////////
+bool TextureStreamer::reserve(size_t size, bool wait, size_t& offset)
+{
+    // an upload never wraps around the end of the ring
+    size_t start = head;
+    if (start % RING_SIZE + size > RING_SIZE)
+        start += RING_SIZE - start % RING_SIZE;
+
+    for (;;)
+    {
+        retireFences(false);
+        if (tail == head)
+            tail = start;                   // nothing in flight, the padding is free too
+        if (start + size <= tail + RING_SIZE)
+            break;
+        if (!wait)
+            return false;
+        fenceFrame();
+        retireFences(true);
+    }
+    head = start + size;
+    offset = start % RING_SIZE;
+    return true;
+}
+
+void TextureStreamer::fenceFrame()
+{
+    if (!ringBuffer || head == fencedHead)
+        return;
+    RingFence fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), head };
+    fences.push_back(fence);
+    fencedHead = head;
+}
+
+void TextureStreamer::retireFences(bool wait)
+{
+    while (!fences.empty())
+    {
+        const RingFence& fence = fences.front();
+        GLenum result;
+        if (wait)
+        {
+            double start = getFrameClock();
+            result = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+            waitTime += (getFrameClock() - start) * 1000.0;
+        }
+        else
+            result = glClientWaitSync(fence.sync, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            return;
+
+        tail = std::max(tail, fence.end);
+        glDeleteSync(fence.sync);
+        fences.pop_front();
+        if (wait)
+            return;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// per frame
+///////////////////////////////////////////////////////////////////////////////
+bool TextureStreamer::uploadNext(size_t& budget, bool wait)
+{
+    Upload& upload = uploads.front();
+    const TextureImage& image = loader->getImage(upload.texture);
+    const int array = arrays->getTarget(upload.texture).array;
+    int rowCount;
+    size_t rowSize;
+    arrays->getLevelRows(array, upload.level, rowCount, rowSize);
+
+    // at least one row, so a tiny budget still gets somewhere
+    const size_t limit = std::min(budget, MAX_UPLOAD_SIZE);
+    const int rows = std::min(rowCount - upload.nextRow, std::max((int)(limit / rowSize), 1));
+    const size_t size = rows * rowSize;
+    const unsigned char* source = image.compressed.isValid() ? image.compressed.getLevelData(upload.level)
+                                                             : image.pixels;
+    source += upload.nextRow * rowSize;
+
+    if (ringBuffer)
+    {
+        size_t offset;
+        if (!reserve(size, wait, offset))
+            return false;
+        memcpy(ringData + offset, source, size);
+        arrays->uploadRows(upload.texture, upload.level, upload.nextRow, rows, (const void*)offset);
+    }
+    else
+        arrays->uploadRows(upload.texture, upload.level, upload.nextRow, rows, source);
+
+    budget -= std::min(budget, size);
+    uploadedBytes += size;
+    upload.nextRow += rows;
+    if (upload.nextRow == rowCount)
+    {
+        Upload done = upload;
+        uploads.pop_front();
+        finishRows(done);
+    }
+    return true;
+}
+
+bool TextureStreamer::update(size_t byteBudget)
+{
+    if (!isBusy())
+        return false;
+    PROFILE_SCOPE("TextureStreamer::update");
+    double start = getFrameClock();
+
+    int texture;
+    while (loader->poll(texture))
+        receive(texture);
+    retireFences(false);
+
+    size_t budget = byteBudget ? byteBudget : std::numeric_limits<size_t>::max();
+    bool uploaded = false;
+    if (ringBuffer)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+    while (budget > 0 && !uploads.empty())
+    {
+        // evicted since it was queued
+        const Upload& upload = uploads.front();
+        if (upload.level < arrays->getFirstLevel(arrays->getTarget(upload.texture).array))
+        {
+            uploads.pop_front();
+            continue;
+        }
+        if (!uploadNext(budget, byteBudget == 0))
+            break;
+        uploaded = true;
+    }
+    if (ringBuffer)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    fenceFrame();
+
+    double time = (getFrameClock() - start) * 1000.0;
+    uploadTime += time;
+    if (uploaded)
+    {
+        ++frames;
+        maxFrameTime = std::max(maxFrameTime, time);
+    }
+    if (complete || received < loader->getImageCount() || !uploads.empty())
+        return false;
+    complete = true;
+    completeTime = loader->getElapsedTime();
+    return true;
+}
+
+void TextureStreamer::finish()
+{
+    PROFILE_SCOPE("TextureStreamer::finish");
+    while (!complete)
+    {
+        // nothing to upload yet: block on the loader instead of spinning
+        int texture;
+        if (uploads.empty() && received < loader->getImageCount() && loader->next(texture))
+            receive(texture);
+        update(0);
+        if (!complete && uploads.empty() && received == loader->getImageCount())
+            break;
+    }
+}
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+// TextureStreamer.h
+// =================
+// Uploads the textures of a TextureLoader into TextureArrays a little every
+// frame, so the render loop never stalls on a big texture.
+// update() runs on the GL thread once per frame. It picks up the images the
+// loader finished, copies rows of them into a persistently mapped pixel
+// buffer and issues the texture uploads from there, up to a byte budget. A
+// fence per frame tells when the GPU has consumed a part of the buffer, so it
+// is only overwritten after that.
+// Levels go coarsest first, across all textures, and an array is shown as
+// soon as each of its layers has a level: objects start out with the grey
+// placeholder, then a blurry version of their texture that sharpens as the
+// finer levels arrive.
+// Textures whose file headers give the same array size wait for each other,
+// since an array is allocated with all of its layers. A texture with the same
+// contents as another one has the same header too, and gets its layer.
+// With setPartialArrays(), arrays start with their coarse levels only and
+// requestLevels() streams finer ones later on (see TextureResidency.h).
+// Without GL_ARB_buffer_storage the rows are uploaded from client memory,
+// under the same budget.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <deque>
+#include <vector>
+
+#include <GL/glew.h>
+
+class TextureArrays;
+class TextureLoader;
+
+class TextureStreamer
+{
+public:
+    TextureStreamer();
+    ~TextureStreamer() {}
+
+    // the loader has to be started; needs a current GL context
+    bool init(TextureLoader* loader, TextureArrays* arrays);
+    void release();
+    // before anything is received: compressed arrays are allocated with the
+    // levels up to maxFirstSize texels, and the images are kept in memory to
+    // upload levels again after they were evicted; 0 uploads every level once
+    void setPartialArrays(int maxFirstSize) { firstSize = maxFirstSize; }
+
+    // uploads at most byteBudget bytes, everything that is loaded with 0;
+    // true on the call that completes the last texture
+    bool update(size_t byteBudget);
+    // waits for the loader and uploads everything
+    void finish();
+    // (re)uploads levels first to last of every layer, coarsest first; the
+    // array must have storage for them
+    void requestLevels(int array, int first, int last);
+
+    bool isComplete() const                 { return complete; }
+    bool isBusy() const                     { return !complete || !uploads.empty(); }
+    bool isPersistent() const               { return ringBuffer != 0; }
+    size_t getUploadedBytes() const         { return uploadedBytes; }
+    double getUploadTime() const            { return uploadTime; }      // ms, all update() calls
+    double getMaxFrameTime() const          { return maxFrameTime; }    // ms, the longest update()
+    double getWaitTime() const              { return waitTime; }        // ms, blocked on fences
+    int getFrameCount() const               { return frames; }          // update() calls that uploaded
+    double getCompleteTime() const          { return completeTime; }    // ms after the loader started
+
+private:
+    // rows of one level of one texture, from nextRow on
+    struct Upload
+    {
+        int texture;
+        int level;
+        int nextRow;
+    };
+
+    // a frame's worth of the ring, reusable once its fence signals
+    struct RingFence
+    {
+        GLsync sync;
+        size_t end;                         // head of the ring when it was fenced
+    };
+
+    // textures allocated together
+    struct Group
+    {
+        std::vector<int> textures;
+        int loaded;
+    };
+
+    void receive(int texture);
+    bool uploadNext(size_t& budget, bool wait);
+    bool reserve(size_t size, bool wait, size_t& offset);
+    void fenceFrame();
+    void retireFences(bool wait);
+    void finishRows(const Upload& upload);
+    void queue(const Upload& upload);
+
+    TextureLoader* loader;
+    TextureArrays* arrays;
+
+    GLuint ringBuffer;                      // 0 without persistent mapping
+    unsigned char* ringData;
+    size_t head;                            // bytes ever reserved, the offset is head % ring size
+    size_t tail;                            // bytes the GPU is done with
+    size_t fencedHead;
+    std::deque<RingFence> fences;
+
+    std::vector<Group> groups;
+    std::vector<int> textureGroups;         // per texture
+    std::deque<Upload> uploads;             // coarsest level first
+    std::vector<std::vector<int> > layersLeft; // per array and level, layers still to upload
+    std::vector<int> levelsLeft;            // per texture, until its image is freed
+    int firstSize;
+    int received;
+    bool complete;
+
+    size_t uploadedBytes;
+    double uploadTime;
+    double maxFrameTime;
+    double waitTime;
+    int frames;
+    double completeTime;
+};
+
+#endif
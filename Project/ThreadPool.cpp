@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// ThreadPool.cpp
+// ==============
+// Fixed set of worker threads for data-parallel loops (see ThreadPool.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CpuProfiler.h"
+#include "ThreadPool.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/dtor
+///////////////////////////////////////////////////////////////////////////////
+ThreadPool::ThreadPool(int threadCount) : task(nullptr), taskCount(0), nextIndex(0),
+                                          pendingWorkers(0), generation(0), quit(false)
+{
+    if (threadCount <= 0)
+    {
+        int hardwareThreads = (int)std::thread::hardware_concurrency();
+        threadCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 0;
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeCondition.notify_all();
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// run task(0) .. task(count - 1) on all threads and wait for completion
+///////////////////////////////////////////////////////////////////////////////
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0)
+        return;
+
+    // not worth waking anyone up
+    if (count == 1 || workers.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> dispatchLock(dispatchMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        taskCount = count;
+        nextIndex = 0;
+        pendingWorkers = (int)workers.size();
+        ++generation;
+    }
+    wakeCondition.notify_all();
+
+    runTasks();
+
+    // every worker has to leave the batch before fn goes out of scope
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return pendingWorkers == 0; });
+    task = nullptr;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// claim indices until the batch is exhausted
+///////////////////////////////////////////////////////////////////////////////
+void ThreadPool::runTasks()
+{
+    for (int i = nextIndex++; i < taskCount; i = nextIndex++)
+        (*task)(i);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// worker thread: sleep until a new batch is published
+///////////////////////////////////////////////////////////////////////////////
+void ThreadPool::workerLoop()
+{
+    PROFILE_THREAD_NAME("worker");
+    unsigned int seenGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return quit || generation != seenGeneration; });
+            if (quit)
+                return;
+            seenGeneration = generation;
+        }
+
+        runTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pendingWorkers == 0)
+                doneCondition.notify_one();
+        }
+    }
+}
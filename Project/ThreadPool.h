@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+// ThreadPool.h
+// ============
+// Fixed set of worker threads for data-parallel loops.
+// parallelFor() hands out indices [0, count) one at a time to the workers and
+// the calling thread, and returns once every index has been processed.
+// Calls from different threads are serialized; calling parallelFor() from
+// inside a task is not supported.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threadCount = 0 uses one worker per hardware thread, minus the caller
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    // # of threads that run tasks, including the calling thread
+    int getThreadCount() const              { return (int)workers.size() + 1; }
+
+    void parallelFor(int count, const std::function<void(int)>& task);
+
+private:
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> workers;
+    std::mutex dispatchMutex;               // one parallelFor() at a time
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void(int)>* task;
+    int taskCount;
+    std::atomic<int> nextIndex;
+    int pendingWorkers;                     // workers still inside the current batch
+    unsigned int generation;                // bumped for every batch
+    bool quit;
+};
+
+#endif
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+// TripleBuffer.h
+// ==============
+// Lock-free triple buffer for one producer and one consumer thread.
+// The producer fills getWriteBuffer() and publish()es it. The consumer
+// acquire()s the most recently published buffer and reads getReadBuffer().
+// Neither side ever waits for the other. Snapshots the consumer was too slow
+// to pick up are simply overwritten.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : writeIndex(0), middle(1), readIndex(2) {}
+
+    // producer side
+    T& getWriteBuffer()                     { return buffers[writeIndex]; }
+    void publish()                          { writeIndex = middle.exchange(writeIndex | FRESH) & INDEX_MASK; }
+
+    // consumer side; false if nothing new was published since the last call
+    bool acquire()
+    {
+        if ((middle.load() & FRESH) == 0)
+            return false;
+        readIndex = middle.exchange(readIndex) & INDEX_MASK;
+        return true;
+    }
+    const T& getReadBuffer() const          { return buffers[readIndex]; }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;             // set in middle when it holds an unread buffer
+
+    T buffers[3];
+    int writeIndex;                         // owned by the producer
+    std::atomic<int> middle;                // shared: index | FRESH
+    int readIndex;                          // owned by the consumer
+};
+
+#endif
@@ -0,0 +1,606 @@
+///////////////////////////////////////////////////////////////////////////////
+// VirtualTexture.cpp
+// ==================
+// Sparse virtual texturing of the scene textures (see VirtualTexture.h)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "CompressedTexture.h"
+#include "CpuProfiler.h"
+#include "TextureLoader.h"
+#include "VirtualTexture.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+// page geometry, as in FragmentShader.fs
+const int PAGE_SIZE = 128;                  // texels of a level per page
+const int PAGE_BORDER = 4;                  // texels around a page in its tile, one block
+const int TILE_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+const int PAGE_BLOCKS = PAGE_SIZE / 4;
+const int BORDER_BLOCKS = PAGE_BORDER / 4;
+const int TILE_BLOCKS = TILE_SIZE / 4;
+const size_t TILE_BYTES = (size_t)TILE_BLOCKS * TILE_BLOCKS * 16;   // BC3
+const int MAX_TILES_PER_SIDE = 255;         // page table entries hold a byte per coordinate
+const unsigned char OPAQUE_ALPHA_BLOCK[8] = { 255, 255, 0, 0, 0, 0, 0, 0 };
+
+const int FEEDBACK_DIVISOR = 8;             // the feedback target is 1/8 of the screen in each direction
+const int FEEDBACK_BUFFERS = 3;             // readbacks in flight
+const size_t PAGE_CACHE_FACTOR = 2;         // CPU page cache, in atlas sizes
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// page keys: texture, level and page coordinates
+///////////////////////////////////////////////////////////////////////////////
+unsigned long long VirtualTexture::makeKey(int texture, int level, int x, int y)
+{
+    return ((unsigned long long)texture << 40) | ((unsigned long long)level << 32) |
+           ((unsigned long long)y << 16) | (unsigned long long)x;
+}
+
+void VirtualTexture::splitKey(unsigned long long key, int& texture, int& level, int& x, int& y)
+{
+    texture = (int)(key >> 40);
+    level = (int)((key >> 32) & 0xff);
+    y = (int)((key >> 16) & 0xffff);
+    x = (int)(key & 0xffff);
+}
+
+static int getPagesX(int width, int level)
+{
+    return (std::max(width >> level, 1) + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+static int wrap(int value, int count)
+{
+    return ((value % count) + count) % count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor/init/release
+///////////////////////////////////////////////////////////////////////////////
+VirtualTexture::VirtualTexture() : loader(nullptr), tableChanged(false), registered(0), atlas(0), tilesPerSide(0),
+                                   usedTiles(0), tableBuffer(0), tableTexture(0), feedbackFramebuffer(0),
+                                   feedbackColor(0), feedbackDepth(0), feedbackWidth(0), feedbackHeight(0),
+                                   nextFeedback(0), pendingFeedback(0), savedFramebuffer(0), feedbackFrame(0),
+                                   feedbackChanged(false), uploadedPages(0), evictedPages(0), frameUploads(0)
+{
+    savedViewport[0] = savedViewport[1] = savedViewport[2] = savedViewport[3] = 0;
+}
+
+bool VirtualTexture::init(TextureLoader* loader, size_t atlasBytes, int screenWidth, int screenHeight)
+{
+    release();
+    if (!loader->getCompressedCache())
+    {
+        printf("Virtual texturing needs the compressed texture cache\n");
+        return false;
+    }
+    if (!GLEW_EXT_texture_compression_s3tc || !(GLEW_VERSION_3_1 || GLEW_ARB_texture_buffer_object))
+    {
+        printf("Virtual texturing needs S3TC textures and texture buffers\n");
+        return false;
+    }
+
+    // as many tiles as the budget pays for, at least a tail page per texture and one more
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    tilesPerSide = (int)std::sqrt((double)atlasBytes / TILE_BYTES);
+    tilesPerSide = std::min(std::min(tilesPerSide, MAX_TILES_PER_SIDE), maxSize / TILE_SIZE);
+    if (tilesPerSide * tilesPerSide <= loader->getImageCount())
+    {
+        printf("A page atlas of %.1f MB is too small for %d textures\n", atlasBytes / (1024.0 * 1024.0),
+               loader->getImageCount());
+        return false;
+    }
+    this->loader = loader;
+    Tile free = { -1, 0, 0, 0, false };
+    tiles.assign((size_t)tilesPerSide * tilesPerSide, free);
+    Layout none = { 0, 0, 0, 0, 0, std::vector<int>(), std::vector<int>() };
+    textures.assign(loader->getImageCount(), none);
+    for (size_t i = 0; i < textures.size(); ++i)
+        textures[i].source = (int)i;
+    dirtyTables.assign(textures.size(), false);
+
+    const int atlasSize = tilesPerSide * TILE_SIZE;
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    if (GLEW_ARB_texture_storage)
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, atlasSize, atlasSize);
+    else
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, atlasSize, atlasSize, 0,
+                               (GLsizei)(tiles.size() * TILE_BYTES), nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &tableBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, tableBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 4, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &tableTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, tableTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, tableBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // feedback target and the buffers it is read back through
+    feedbackWidth = std::max(screenWidth / FEEDBACK_DIVISOR, 1);
+    feedbackHeight = std::max(screenHeight / FEEDBACK_DIVISOR, 1);
+    glGenRenderbuffers(1, &feedbackColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, feedbackWidth, feedbackHeight);
+    glGenRenderbuffers(1, &feedbackDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &feedbackFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFramebuffer);
+    if (!complete)
+    {
+        printf("Virtual texture feedback framebuffer is incomplete\n");
+        release();
+        return false;
+    }
+    feedbackBuffers.resize(FEEDBACK_BUFFERS);
+    feedbackFences.assign(FEEDBACK_BUFFERS, nullptr);
+    glGenBuffers(FEEDBACK_BUFFERS, feedbackBuffers.data());
+    for (int i = 0; i < FEEDBACK_BUFFERS; ++i)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pageCache.start([this](unsigned long long key, std::vector<unsigned char>& data) { loadPage(key, data); },
+                    atlasBytes * PAGE_CACHE_FACTOR);
+    return true;
+}
+
+void VirtualTexture::release()
+{
+    pageCache.stop();
+    for (size_t i = 0; i < feedbackFences.size(); ++i)
+    {
+        if (feedbackFences[i])
+            glDeleteSync(feedbackFences[i]);
+    }
+    if (!feedbackBuffers.empty())
+        glDeleteBuffers((GLsizei)feedbackBuffers.size(), feedbackBuffers.data());
+    if (feedbackFramebuffer)
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+    if (feedbackColor)
+        glDeleteRenderbuffers(1, &feedbackColor);
+    if (feedbackDepth)
+        glDeleteRenderbuffers(1, &feedbackDepth);
+    if (tableTexture)
+        glDeleteTextures(1, &tableTexture);
+    if (tableBuffer)
+        glDeleteBuffers(1, &tableBuffer);
+    if (atlas)
+        glDeleteTextures(1, &atlas);
+    feedbackFences.clear();
+    feedbackBuffers.clear();
+    feedbackFramebuffer = feedbackColor = feedbackDepth = tableTexture = tableBuffer = atlas = 0;
+    nextFeedback = pendingFeedback = 0;
+    textures.clear();
+    tiles.clear();
+    table.clear();
+    seenPages.clear();
+    usedTiles = registered = 0;
+    uploadedPages = evictedPages = 0;
+    loader = nullptr;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// pages: built on the page cache thread from the compressed levels, which
+// are only read there once the texture is loaded
+///////////////////////////////////////////////////////////////////////////////
+void VirtualTexture::loadPage(unsigned long long key, std::vector<unsigned char>& data) const
+{
+    int texture, level, x, y;
+    splitKey(key, texture, level, x, y);
+    const CompressedTexture& compressed = loader->getImage(texture).compressed;
+    const CompressedLevel& levelInfo = compressed.getLevel(level);
+    const unsigned char* blocks = compressed.getLevelData(level);
+    const int blocksX = (levelInfo.width + 3) / 4;
+    const int blocksY = (levelInfo.height + 3) / 4;
+    const bool alpha = compressed.getFormat() == COMPRESSED_BC3;
+    const size_t blockSize = alpha ? 16 : 8;
+
+    // the border and levels smaller than a page wrap around, as GL_REPEAT does
+    data.resize(TILE_BYTES);
+    unsigned char* out = data.data();
+    for (int by = 0; by < TILE_BLOCKS; ++by)
+    {
+        const int sourceY = wrap(y * PAGE_BLOCKS + by - BORDER_BLOCKS, blocksY);
+        for (int bx = 0; bx < TILE_BLOCKS; ++bx, out += 16)
+        {
+            const int sourceX = wrap(x * PAGE_BLOCKS + bx - BORDER_BLOCKS, blocksX);
+            const unsigned char* block = blocks + ((size_t)sourceY * blocksX + sourceX) * blockSize;
+            if (alpha)
+                memcpy(out, block, 16);
+            else
+            {
+                // a BC1 block is the color half of a BC3 one; the encoder never uses its 3 color mode
+                memcpy(out, OPAQUE_ALPHA_BLOCK, 8);
+                memcpy(out + 8, block, 8);
+            }
+        }
+    }
+}
+
+// page table entries for every level down to the one that fits in a page
+void VirtualTexture::addTexture(int texture)
+{
+    ++registered;
+    const TextureImage& image = loader->getImage(texture);
+    Layout& layout = textures[texture];
+    layout.source = image.source;
+    if (image.source != texture || !image.compressed.isValid())
+        return;
+
+    const CompressedTexture& compressed = image.compressed;
+    layout.width = compressed.getWidth();
+    layout.height = compressed.getHeight();
+    layout.levelCount = 1;
+    while (layout.levelCount < compressed.getLevelCount() &&
+           std::max(compressed.getLevel(layout.levelCount - 1).width,
+                    compressed.getLevel(layout.levelCount - 1).height) > PAGE_SIZE)
+        ++layout.levelCount;
+
+    int entryCount = 0;
+    layout.levelEntries.clear();
+    for (int level = 0; level < layout.levelCount; ++level)
+    {
+        layout.levelEntries.push_back(entryCount);
+        entryCount += getPagesX(layout.width, level) * getPagesX(layout.height, level);
+    }
+    layout.firstEntry = (int)(table.size() / 4);
+    layout.entryTiles.assign(entryCount, -1);
+    table.resize(table.size() + (size_t)entryCount * 4, 0);
+    dirtyTables[texture] = true;
+}
+
+// entries point at the tile of the page, else at the one of its parent, so
+// a level is always sampled from the finest page that is resident
+void VirtualTexture::updateTable(int texture)
+{
+    const Layout& layout = textures[texture];
+    for (int level = layout.levelCount - 1; level >= 0; --level)
+    {
+        const int pagesX = getPagesX(layout.width, level);
+        const int pagesY = getPagesX(layout.height, level);
+        for (int y = 0; y < pagesY; ++y)
+        {
+            for (int x = 0; x < pagesX; ++x)
+            {
+                const int entry = layout.levelEntries[level] + y * pagesX + x;
+                unsigned char* value = &table[(size_t)(layout.firstEntry + entry) * 4];
+                const int tile = layout.entryTiles[entry];
+                if (tile >= 0)
+                {
+                    value[0] = (unsigned char)(tile % tilesPerSide);
+                    value[1] = (unsigned char)(tile / tilesPerSide);
+                    value[2] = (unsigned char)level;
+                    value[3] = 1;
+                }
+                else if (level == layout.levelCount - 1)
+                    memset(value, 0, 4);
+                else
+                {
+                    const int parent = layout.levelEntries[level + 1] + (y / 2) * getPagesX(layout.width, level + 1) + x / 2;
+                    memcpy(value, &table[(size_t)(layout.firstEntry + parent) * 4], 4);
+                }
+            }
+        }
+    }
+    tableChanged = true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// feedback: the pages the pixels of an earlier frame wanted
+///////////////////////////////////////////////////////////////////////////////
+void VirtualTexture::beginFeedback()
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback()
+{
+    // with every buffer still in flight this frame's feedback is dropped
+    if (pendingFeedback < FEEDBACK_BUFFERS)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[nextFeedback]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackFences[nextFeedback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextFeedback = (nextFeedback + 1) % FEEDBACK_BUFFERS;
+        ++pendingFeedback;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+float VirtualTexture::getFeedbackBias() const
+{
+    return std::log2((float)FEEDBACK_DIVISOR);
+}
+
+// the oldest readback if the GPU is done with it; true if one was read
+bool VirtualTexture::readFeedback()
+{
+    if (pendingFeedback == 0)
+        return false;
+    const int index = (nextFeedback - pendingFeedback + FEEDBACK_BUFFERS) % FEEDBACK_BUFFERS;
+    const GLenum result = glClientWaitSync(feedbackFences[index], 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        return false;
+    PROFILE_SCOPE("VirtualTexture::readFeedback");
+    glDeleteSync(feedbackFences[index]);
+    feedbackFences[index] = nullptr;
+    --pendingFeedback;
+
+    // every page a pixel names, and its ancestors; neighbours mostly name the same one
+    std::vector<unsigned long long> pages;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[index]);
+    const size_t size = (size_t)feedbackWidth * feedbackHeight * 4;
+    const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    unsigned int previous = 0;
+    for (size_t i = 0; pixels && i < size; i += 4)
+    {
+        unsigned int value;
+        memcpy(&value, pixels + i, 4);
+        if (pixels[i] == 0 || value == previous || pixels[i] > (int)textures.size())
+            continue;
+        previous = value;
+        const int texture = textures[pixels[i] - 1].source;
+        const Layout& layout = textures[texture];
+        int level = pixels[i + 1], x = pixels[i + 2], y = pixels[i + 3];
+        if (level >= layout.levelCount || x >= getPagesX(layout.width, level) || y >= getPagesX(layout.height, level))
+            continue;
+        for (; level < layout.levelCount; ++level, x /= 2, y /= 2)
+            pages.push_back(makeKey(texture, level, x, y));
+    }
+    if (pixels)
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    ++feedbackFrame;
+    feedbackChanged = (pages != seenPages);
+    seenPages.swap(pages);
+    for (size_t i = 0; i < seenPages.size(); ++i)
+    {
+        int texture, level, x, y;
+        splitKey(seenPages[i], texture, level, x, y);
+        const Layout& layout = textures[texture];
+        const int tile = layout.entryTiles[layout.levelEntries[level] + y * getPagesX(layout.width, level) + x];
+        if (tile >= 0)
+            tiles[tile].lastSeen = feedbackFrame;
+    }
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// requests, tiles and uploads
+///////////////////////////////////////////////////////////////////////////////
+// tail pages first, then what the feedback saw, coarsest first; no more than
+// there are tiles to put them in
+void VirtualTexture::requestPages()
+{
+    std::vector<unsigned long long> keys;
+    for (size_t t = 0; t < textures.size(); ++t)
+    {
+        const Layout& layout = textures[t];
+        if (layout.source == (int)t && layout.levelCount > 0 && layout.entryTiles[layout.levelEntries.back()] < 0)
+            keys.push_back(makeKey((int)t, layout.levelCount - 1, 0, 0));
+    }
+
+    int available = 0;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (tiles[i].texture < 0 || (!tiles[i].pinned && tiles[i].lastSeen < feedbackFrame))
+            ++available;
+    }
+    std::vector<std::pair<int, unsigned long long> > seen;
+    for (size_t i = 0; i < seenPages.size(); ++i)
+    {
+        int texture, level, x, y;
+        splitKey(seenPages[i], texture, level, x, y);
+        const Layout& layout = textures[texture];
+        if (level < layout.levelCount - 1 &&
+            layout.entryTiles[layout.levelEntries[level] + y * getPagesX(layout.width, level) + x] < 0)
+            seen.push_back(std::make_pair(-level, seenPages[i]));
+    }
+    std::sort(seen.begin(), seen.end());
+    for (size_t i = 0; i < seen.size() && (int)i < available; ++i)
+        keys.push_back(seen[i].second);
+    pageCache.setRequests(keys);
+}
+
+// a free tile, else the one of the page seen longest ago that the last feedback did not see
+int VirtualTexture::findTile()
+{
+    int victim = -1;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        const Tile& tile = tiles[i];
+        if (tile.texture < 0)
+            return (int)i;
+        if (!tile.pinned && tile.lastSeen < feedbackFrame && (victim < 0 || tile.lastSeen < tiles[victim].lastSeen))
+            victim = (int)i;
+    }
+    if (victim >= 0)
+    {
+        Tile& tile = tiles[victim];
+        textures[tile.texture].entryTiles[tile.entry] = -1;
+        dirtyTables[tile.texture] = true;
+        tile.texture = -1;
+        --usedTiles;
+        ++evictedPages;
+    }
+    return victim;
+}
+
+// false if every tile is in use
+bool VirtualTexture::uploadPage(unsigned long long key, const std::vector<unsigned char>& data)
+{
+    int texture, level, x, y;
+    splitKey(key, texture, level, x, y);
+    Layout& layout = textures[texture];
+    const int entry = layout.levelEntries[level] + y * getPagesX(layout.width, level) + x;
+    if (layout.entryTiles[entry] >= 0)
+        return true;
+    const int index = findTile();
+    if (index < 0)
+        return false;
+
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, (index % tilesPerSide) * TILE_SIZE, (index / tilesPerSide) * TILE_SIZE,
+                              TILE_SIZE, TILE_SIZE, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, (GLsizei)data.size(), data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Tile& tile = tiles[index];
+    tile.texture = texture;
+    tile.level = level;
+    tile.entry = entry;
+    tile.lastSeen = feedbackFrame;
+    tile.pinned = (level == layout.levelCount - 1);
+    layout.entryTiles[entry] = index;
+    dirtyTables[texture] = true;
+    ++usedTiles;
+    ++uploadedPages;
+    ++frameUploads;
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// per frame
+///////////////////////////////////////////////////////////////////////////////
+void VirtualTexture::update(size_t byteBudget)
+{
+    PROFILE_SCOPE("VirtualTexture::update");
+    bool changed = false;
+    int texture;
+    while (loader->poll(texture))
+    {
+        addTexture(texture);
+        changed = true;
+    }
+    if (readFeedback() || changed)
+        requestPages();
+
+    // nothing is bound to the unpack buffer target here, pages come from client memory
+    frameUploads = 0;
+    size_t uploaded = 0;
+    unsigned long long key;
+    std::vector<unsigned char> data;
+    while ((byteBudget == 0 || uploaded + TILE_BYTES <= byteBudget) && pageCache.poll(key))
+    {
+        if (!pageCache.getPage(key, data))
+            continue;
+        if (!uploadPage(key, data))
+            break;
+        uploaded += data.size();
+    }
+
+    for (size_t t = 0; t < textures.size(); ++t)
+    {
+        if (dirtyTables[t])
+            updateTable((int)t);
+        dirtyTables[t] = false;
+    }
+    if (tableChanged)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, tableBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)std::max(table.size(), (size_t)4), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)table.size(), table.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        tableChanged = false;
+    }
+}
+
+void VirtualTexture::finish()
+{
+    PROFILE_SCOPE("VirtualTexture::finish");
+    int texture;
+    while (loader->next(texture))
+        addTexture(texture);
+
+    // the tails on this thread, the cache thread would only be waited for
+    std::vector<unsigned char> data;
+    for (size_t t = 0; t < textures.size(); ++t)
+    {
+        const Layout& layout = textures[t];
+        if (layout.source != (int)t || layout.levelCount == 0)
+            continue;
+        const unsigned long long key = makeKey((int)t, layout.levelCount - 1, 0, 0);
+        loadPage(key, data);
+        uploadPage(key, data);
+    }
+    requestPages();
+    update(0);
+}
+
+void VirtualTexture::bind(int atlasUnit, int tableUnit) const
+{
+    glActiveTexture(GL_TEXTURE0 + atlasUnit);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glActiveTexture(GL_TEXTURE0 + tableUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, tableTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void VirtualTexture::getUniform(int texture, GLint value[4]) const
+{
+    const Layout& layout = textures[textures[texture].source];
+    value[0] = layout.firstEntry;
+    value[1] = layout.levelCount;
+    value[2] = layout.width;
+    value[3] = layout.height;
+}
+
+bool VirtualTexture::isBusy() const
+{
+    return !isComplete() || feedbackChanged || frameUploads > 0 || !pageCache.isIdle();
+}
+
+size_t VirtualTexture::getResidentSize() const
+{
+    return (size_t)usedTiles * TILE_BYTES + table.size();
+}
+
+size_t VirtualTexture::getAtlasSize() const
+{
+    return tiles.size() * TILE_BYTES;
+}
@@ -0,0 +1,144 @@
+///////////////////////////////////////////////////////////////////////////////
+// VirtualTexture.h
+// ================
+// Sparse virtual texturing of the scene textures: only the pages the camera
+// sees are on the GPU, in a fixed size atlas, so texture memory follows what
+// is visible rather than how many textures there are.
+// Every level of a compressed texture is split into PAGE_SIZE texel pages,
+// down to the coarsest level that fits in one page, the tail. A page sits in
+// a tile of the atlas with a border of one compressed block copied from its
+// wrapped neighbours, so bilinear filtering never reads another page. The
+// atlas is BC3; BC1 pages get an opaque alpha block on the way.
+// The page table, a texture buffer, has an entry per page of every level: the
+// tile of the page, or of its finest ancestor that is resident. The fragment
+// shader picks the level from the texture coordinate derivatives and samples
+// through the table (FragmentShader.fs with VIRTUAL_TEXTURE).
+// The feedback pass draws the scene into a small target with the
+// VIRTUAL_TEXTURE_FEEDBACK shader, which writes the page each pixel wants.
+// It is read back through pixel buffers a few frames later, so the GL thread
+// never waits for it. The pages it names and their ancestors are loaded on
+// the thread of a PageCache, coarsest first, and uploaded into free tiles or
+// those of the pages no longer in view, least recently seen first. The tail
+// page of every texture stays resident so there is always something to draw.
+// Textures come straight from the TextureLoader, which has to have the
+// compressed cache; texture arrays and the streamer are not used.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "PageCache.h"
+
+class TextureLoader;
+
+class VirtualTexture
+{
+public:
+    VirtualTexture();
+    ~VirtualTexture() {}
+
+    // atlasBytes of tiles; the feedback target is a fraction of screenWidth x
+    // screenHeight. False if the driver or the loader cannot do it; needs a
+    // current GL context and the loader started
+    bool init(TextureLoader* loader, size_t atlasBytes, int screenWidth, int screenHeight);
+    void release();
+
+    // per frame, before drawing: takes in loaded textures and the oldest
+    // finished feedback, then uploads up to byteBudget of ready pages, all with 0
+    void update(size_t byteBudget);
+    // waits for the loader and uploads the tail page of every texture
+    void finish();
+    void bind(int atlasUnit, int tableUnit) const;
+    // uVirtualTexture of a texture: first page table entry, level count (0
+    // until loaded), level 0 width and height
+    void getUniform(int texture, GLint value[4]) const;
+
+    // around drawing the scene with the feedback shader, which sets
+    // uFeedbackBias to getFeedbackBias(); restores framebuffer and viewport
+    void beginFeedback();
+    void endFeedback();
+    float getFeedbackBias() const;
+
+    bool isBusy() const;                    // textures or pages on the way
+    bool isComplete() const                 { return registered == (int)textures.size(); }
+    int getTileCount() const                { return (int)tiles.size(); }
+    int getResidentPages() const            { return usedTiles; }
+    size_t getResidentSize() const;         // bytes of the used tiles and the page table
+    size_t getAtlasSize() const;            // bytes of all tiles
+    int getUploadedPages() const            { return uploadedPages; }
+    int getEvictedPages() const             { return evictedPages; }
+    const PageCache& getPageCache() const   { return pageCache; }
+
+private:
+    // pages of one texture in the page table
+    struct Layout
+    {
+        int source;                         // texture whose pages these are, for shared contents
+        int firstEntry;
+        int levelCount;                     // 0 until loaded
+        int width;                          // of level 0
+        int height;
+        std::vector<int> levelEntries;      // first entry of every level, relative to firstEntry
+        std::vector<int> entryTiles;        // per entry, -1 if the page is not resident
+    };
+
+    struct Tile
+    {
+        int texture;                        // -1 if free
+        int level;
+        int entry;                          // relative to the first entry of the texture
+        unsigned int lastSeen;              // feedback frame that last needed the page
+        bool pinned;                        // a tail page
+    };
+
+    static unsigned long long makeKey(int texture, int level, int x, int y);
+    static void splitKey(unsigned long long key, int& texture, int& level, int& x, int& y);
+    void loadPage(unsigned long long key, std::vector<unsigned char>& data) const;
+    void addTexture(int texture);
+    bool readFeedback();
+    void requestPages();
+    int findTile();
+    bool uploadPage(unsigned long long key, const std::vector<unsigned char>& data);
+    void updateTable(int texture);
+
+    TextureLoader* loader;
+    PageCache pageCache;
+    std::vector<Layout> textures;
+    std::vector<unsigned char> table;       // 4 bytes per entry, as the shader reads them
+    std::vector<bool> dirtyTables;          // per texture, entries to rebuild
+    bool tableChanged;
+    int registered;
+
+    GLuint atlas;
+    int tilesPerSide;
+    std::vector<Tile> tiles;
+    int usedTiles;
+    GLuint tableBuffer;
+    GLuint tableTexture;
+
+    GLuint feedbackFramebuffer;
+    GLuint feedbackColor;
+    GLuint feedbackDepth;
+    int feedbackWidth;
+    int feedbackHeight;
+    std::vector<GLuint> feedbackBuffers;    // pixel pack buffers, in flight in order
+    std::vector<GLsync> feedbackFences;
+    int nextFeedback;
+    int pendingFeedback;
+    GLint savedFramebuffer;
+    GLint savedViewport[4];
+    unsigned int feedbackFrame;             // feedbacks read back
+    std::vector<unsigned long long> seenPages; // by the last feedback, ancestors included
+    bool feedbackChanged;                   // it saw other pages than the one before
+
+    int uploadedPages;
+    int evictedPages;
+    int frameUploads;                       // pages uploaded by the last update()
+};
+
+#endif
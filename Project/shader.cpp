@@ -12,36 +12,86 @@ using namespace std;
 
 #include <GL/glew.h>
 
+#include "AssetPack.h"
+#include "ProgramCache.h"
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Shader code from the asset pack if it has the file, as a view into the
+// mapping, or else read from the file into storage
+static bool ReadShaderCode(const char * file_path, const AssetPack * pack, std::string & storage, AssetView & view){
+	if(pack && pack->find(file_path, view)){
+		if(AssetPack::verify(view))
+			return true;
+		printf("%s is corrupt in the asset pack, reading the file\n", file_path);
+	}
+
+	std::ifstream ShaderStream(file_path, std::ios::in);
+	if(!ShaderStream.is_open())
+		return false;
+	std::stringstream sstr;
+	sstr << ShaderStream.rdbuf();
+	storage = sstr.str();
+	ShaderStream.close();
+	view.data = (const unsigned char *)storage.data();
+	view.size = storage.size();
+	return true;
+}
+
+// The source as up to 4 strings, the defines right after the #version line;
+// #line keeps the line numbers of the file in the compile log
+static GLsizei SplitShaderSource(const AssetView & view, const char * defines, char const * strings[4], GLint lengths[4]){
+	const char * code = (const char *)view.data;
+	const char * end = code + view.size;
+	if(!defines || !*defines){
+		strings[0] = code;
+		lengths[0] = (GLint)view.size;
+		return 1;
+	}
+	const char * versionEnd = std::find(code, end, '\n');
+	versionEnd = (versionEnd == end) ? end : versionEnd + 1;
+	strings[0] = code;
+	lengths[0] = (GLint)(versionEnd - code);
+	strings[1] = defines;
+	lengths[1] = (GLint)strlen(defines);
+	strings[2] = "#line 2\n";
+	lengths[2] = (GLint)strlen(strings[2]);
+	strings[3] = versionEnd;
+	lengths[3] = (GLint)(end - versionEnd);
+	return 4;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const AssetPack * pack, const char * defines, ProgramCache * cache){
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-	// Read the Vertex Shader code from the file
+	// Read the Vertex Shader code from the pack or the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}else{
+	AssetView VertexShaderView = {};
+	if(!ReadShaderCode(vertex_file_path, pack, VertexShaderCode, VertexShaderView)){
 		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
 		getchar();
 		return 0;
 	}
 
-	// Read the Fragment Shader code from the file
+	// Read the Fragment Shader code from the pack or the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
+	AssetView FragmentShaderView = {};
+	ReadShaderCode(fragment_file_path, pack, FragmentShaderCode, FragmentShaderView);
+
+	// Link from the binary of an earlier run if nothing changed
+	unsigned long long CacheKey = 0;
+	if(cache){
+		CacheKey = ProgramCache::makeKey(VertexShaderView.data, VertexShaderView.size, FragmentShaderView.data,
+			FragmentShaderView.size, defines);
+		GLuint CachedProgramID = cache->loadProgram(CacheKey);
+		if(CachedProgramID){
+			glDeleteShader(VertexShaderID);
+			glDeleteShader(FragmentShaderID);
+			printf("Program from the cache : %s, %s\n", vertex_file_path, fragment_file_path);
+			return CachedProgramID;
+		}
 	}
 
 	GLint Result = GL_FALSE;
@@ -50,8 +100,10 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Compile Vertex Shader
 	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
+	char const * VertexSourcePointers[4];
+	GLint VertexSourceLengths[4];
+	GLsizei VertexSourceCount = SplitShaderSource(VertexShaderView, defines, VertexSourcePointers, VertexSourceLengths);
+	glShaderSource(VertexShaderID, VertexSourceCount, VertexSourcePointers , VertexSourceLengths);
 	glCompileShader(VertexShaderID);
 
 	// Check Vertex Shader
@@ -67,8 +119,10 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	char const * FragmentSourcePointers[4];
+	GLint FragmentSourceLengths[4];
+	GLsizei FragmentSourceCount = SplitShaderSource(FragmentShaderView, defines, FragmentSourcePointers, FragmentSourceLengths);
+	glShaderSource(FragmentShaderID, FragmentSourceCount, FragmentSourcePointers , FragmentSourceLengths);
 	glCompileShader(FragmentShaderID);
 
 	// Check Fragment Shader
@@ -87,6 +141,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if(cache)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -97,6 +153,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
+	if(cache && Result == GL_TRUE)
+		cache->storeProgram(CacheKey, ProgramID);
 
 	
 	glDetachShader(ProgramID, VertexShaderID);
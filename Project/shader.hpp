@@ -1,6 +1,14 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+class AssetPack;
+class ProgramCache;
+
+// the shader files are taken from the pack when it has them; defines, e.g.
+// "#define VIRTUAL_TEXTURE\n", go right after the #version line of both;
+// with a cache the program is linked from its binary if it has the same
+// sources and defines, and added to it otherwise
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const AssetPack * pack=nullptr,
+	const char * defines=nullptr, ProgramCache * cache=nullptr);
 
 #endif
@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <iostream>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include <GL/glew.h>
 
@@ -19,6 +24,29 @@
 #include "Cylinder.h"
 #include "Sphere.h"
 #include "camera.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "DrawList.h"
+#include "TripleBuffer.h"
+#include "DynamicResolution.h"
+#include "ChangeTracker.h"
+#include "FramePacing.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "HeadlessContext.h"
+#include "CameraPath.h"
+#include "Benchmark.h"
+#include "SoftwareRasterizer.h"
+#include "RegressionSuite.h"
+#include "TextureLoader.h"
+#include "TextureResidency.h"
+#include "TextureArrays.h"
+#include "TextureStreamer.h"
+#include "AssetPack.h"
+#include "VirtualTexture.h"
+#include "ProgramCache.h"
 
 
 // Unnamed namespace to hold global variables
@@ -26,12 +54,75 @@ namespace {
 	// window title
 	const char* const TITLE = "Pomai Ahlo Final Project";
 
+	// shader files, also their names in an asset pack
+	const char* const VERTEX_SHADER_FILE = "VertexShader.vs";
+	const char* const FRAGMENT_SHADER_FILE = "FragmentShader.fs";
+	// FragmentShader.fs sampling through the page table, and writing the pages it wants
+	const char* const VIRTUAL_TEXTURE_DEFINES = "#define VIRTUAL_TEXTURE\n";
+	const char* const FEEDBACK_DEFINES = "#define VIRTUAL_TEXTURE_FEEDBACK\n";
+	// linked programs of earlier runs, only of use to the same driver
+	const char* const PROGRAM_CACHE_FILE = "programs.cache";
+	// texture units of the virtual texture, the arrays are not bound with it
+	const int PAGE_ATLAS_UNIT = 0;
+	const int PAGE_TABLE_UNIT = 1;
+
 	// window width and height
 	const int WIDTH = 1200;
 	const int HEIGHT = 900;
 
 	GLFWwindow* window;
 
+	// context and framebuffer of --headless, instead of the window
+	HeadlessContext gHeadless;
+
+	// command line options
+	struct Options {
+		int clutterObjects; // --objects N: extra objects scattered around the desk
+		bool renderThread;  // --render-thread: submit GL from a dedicated thread
+		double frameBudget; // --frame-budget MS: GPU time to hold by scaling the resolution, 0 (the default) disables
+		const char* resolutionLog; // --resolution-log FILE: per-frame CSV of the resolution controller
+		bool onDemand;      // --on-demand: only render when something changed
+		double idleTimeout; // --idle-timeout S: longest wait for events while nothing changes
+		double targetRate;  // --fps N: frame limiter target, 0 is unlimited
+		VsyncMode vsync;    // --vsync off|on|adaptive
+		const char* frameLog; // --frame-log FILE: CPU/GPU/present timestamps of every frame
+		bool gpuProfile;    // --gpu-profile: GPU time per pass and per object (dump with G)
+		const char* traceFile; // --trace FILE: CPU trace written on exit and with T
+		bool headless;      // --headless: no window, render into an offscreen framebuffer
+		int headlessFrames; // --frames N: frames rendered in headless and benchmark mode, 0 covers the whole benchmark path
+		const char* outputPattern; // --output PATTERN: printf pattern of the headless images, e.g. frame%04d.ppm
+		const char* benchmarkPath; // --benchmark FILE: replay a camera path for a fixed number of frames
+		double timestep;    // --timestep S: path time between two benchmark frames
+		int warmupFrames;   // --warmup N: benchmark frames left out of the results
+		const char* benchmarkOutput; // --benchmark-output FILE: JSON results, stdout without
+		const char* recordPath; // --record-path FILE: camera path of this session, written on exit
+		bool software;      // --software: render on the CPU, no OpenGL context at all
+		const char* regressionSuite; // --regress FILE: golden-image and budget checks, exit code 1 on failure
+		bool updateGolden;  // --update-golden: rewrite the reference images of --regress
+		bool textureCache;  // --no-texture-cache: decode the images instead of using the compressed .ctex files
+		bool compileTextures; // --compile-textures: write the .ctex file of every texture and exit
+		double uploadBudget; // --upload-budget MB: texture data streamed in per frame, 0 uploads everything before the first frame
+		double textureBudget; // --texture-budget MB: GPU memory for texture levels, 0 only keeps the levels in use
+		const char* assetPack; // --asset-pack FILE: map the shaders and textures from this pack instead of opening each file
+		const char* packAssets; // --pack-assets FILE: write the shaders, textures and .ctex files to a pack and exit
+		int maxTextureSize; // --max-texture-size N: load textures scaled down to fit N texels, 0 is full size
+		double virtualTexture; // --virtual-texture MB: sample the textures through a page atlas of this size, 0 uses texture arrays
+		bool programCache;  // --no-program-cache: compile and link the shaders every run instead of using programs.cache
+		bool timeBudgets;   // --no-time-budgets: CPU and GPU time over budget only warns in --regress
+	};
+	Options gOptions = { 0, false, 0.0, nullptr, false, 0.5, 0.0, VSYNC_ON, nullptr, false, "trace.json", false, 0, nullptr,
+		nullptr, 1.0 / 60.0, 10, nullptr, nullptr, false, nullptr, false, true, false, 2.0, 0.0, nullptr, nullptr, 0, 0.0, true, true };
+
+	// samples of the window, or of the offscreen target with dynamic resolution
+	const int MSAA_SAMPLES = 4;
+
+	// frames of --headless and --software without --frames or a benchmark path
+	const int DEFAULT_HEADLESS_FRAMES = 100;
+
+	// frames rendered per regression case before and while measuring
+	const int REGRESSION_WARMUP_FRAMES = 10;
+	const int REGRESSION_FRAMES = 30;
+
 	// camera
 	Camera gCamera(glm::vec3(0.0f, 0.0f, 15.0f)); // camera with default location as param
 	float gLastX = WIDTH / 2.0f;
@@ -39,42 +130,213 @@ namespace {
 	bool gFirstMouse = true;
 	bool gIsPerspective = true; // perspective or ortho;
 
+	// lights and background, shared by the GL and the software renderer
+	const glm::vec3 LIGHT0_COLOR(1.0f, 1.0f, 1.0f); // 100% strength, white
+	const glm::vec3 LIGHT0_POSITION(15.0f, -10.0f, 15.0f); // off to the front-right
+	const glm::vec3 LIGHT1_COLOR(0.2f, 0.5f, 0.5f); // 50% strength, light-cyan
+	const glm::vec3 LIGHT1_POSITION(-1.0f, 10.0f, 15.0f); // behind the scene
+	const glm::vec3 CLEAR_COLOR(0.0f, 0.0f, 0.4f); // dark blue
+
 	// timing
 	float gDeltaTime = 0.0f; // time between current frame and last frame
-	float gLastFrame = 0.0f;
-
-	GLuint gTextureId0; //wood
-	GLuint gTextureId1; //tissue box
-	GLuint gTextureId2; //tissue box hole
-	GLuint gTextureId3; //tissue
-	GLuint gTextureId4; //aloe container
-	GLuint gTextureId5; //yellow liquid handsanitizer
-	GLuint gTextureId6; //grey cap
-	GLuint gTextureId7;	//blue ball
+
+	// VBOs of one scene mesh, drawn with the V/N/T layout
+	struct GpuMesh {
+		GLuint vertexBuffer;
+		GLuint indexBuffer; // 0 for plain triangle lists
+		GLsizei count;
+	};
+
+	// software occlusion culling (toggle with O)
+	bool gOcclusionCulling = true;
+	// hardware occlusion queries with conditional rendering (toggle with H)
+	bool gOcclusionQueries = true;
+
+	// versions of everything the image depends on, for on-demand rendering
+	ChangeTracker gChanges;
+
+	// set by the G key, picked up by the thread that renders
+	std::atomic<bool> gDumpGpuProfile(false);
+
+	// counters accumulated between two console reports
+	struct FrameStats {
+		int frames;
+		int drawnObjects;
+		int frustumCulledObjects;
+		int culledObjects;
+		double occlusionRasterTime; // ms
+		double occlusionTestTime;   // ms, summed over all threads
+		double recordTime;          // ms
+		int occlusionQueries;
+		int conditionalObjects;
+		double latency;             // ms, input sampled to frame presented
+		double maxLatency;          // ms
+		double resolutionScale;
+		double cpuTime;             // ms, frame start to GL commands submitted
+		double gpuTime;             // ms
+		int gpuFrames;              // frames whose GPU timestamps arrived
+		double frameInterval;       // ms, present to present
+		double frameIntervalSquares;
+		double maxFrameInterval;    // ms
+		int frameIntervals;
+		double residentTextures;    // MB, at the last frame
+		int evictedLevels;          // texture levels evicted for the budget or for being unused
+		double lastReport;
+	};
+	FrameStats gFrameStats = {};
+
+	// everything the render side needs for one frame; the simulation side fills
+	// it and never touches it again once it is handed over
+	struct FrameSnapshot {
+		unsigned int frame;
+		double inputTime;                // when the input of this frame was sampled
+		bool resumed;                    // first frame after on-demand idling
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 cameraPosition;
+		bool occlusionQueries;
+		std::vector<DrawPacket> packets; // visible set in submission order
+
+		// simulation stats
+		int frustumCulledObjects;
+		int culledObjects;
+		double occlusionRasterTime;      // ms
+		double occlusionTestTime;        // ms
+		double recordTime;               // ms
+	};
 }
 
+bool parseCommandLine(int argc, char* argv[], bool& writeTrace);
 int initializeWindow();
+int initializeHeadless();
 void processKeyInput(GLFWwindow* window);
+bool isCameraKeyHeld(GLFWwindow* window);
+void applyCameraKey(const CameraKey& key);
+CameraKey getCameraKey(double time);
+glm::mat4 getProjection();
+void writeBenchmarkResults(BenchmarkRecorder& results, const char* renderer);
+int runSoftwareRenderer(const CameraPath* path, ThreadPool& threadPool, TextureLoader& textureLoader);
+int compileTextures(ThreadPool& threadPool, TextureLoader& textureLoader);
+int packAssets(TextureLoader& textureLoader);
 void mousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-void flipImageVertically(unsigned char* image, int width, int height, int channels);
-bool createTexture(const char* filename, GLuint& textureId);
-
-int main() {
+void windowRefreshCallback(GLFWwindow* window);
+void reportTextureTimes(const TextureLoader& loader, const TextureArrays& arrays, const TextureStreamer& streamer);
+void reportVirtualTexture(const VirtualTexture& virtualTexture);
+void uploadMesh(const SceneMesh& mesh, GpuMesh& gpuMesh);
+void bindMesh(const GpuMesh& gpuMesh);
+void drawBoundMesh(const GpuMesh& gpuMesh);
+void reportFrameStats(double now);
+
+int main(int argc, char* argv[]) {
 	///////////////////
 	//     Setup     //
 	///////////////////
+
+	PROFILE_THREAD_NAME("main");
+	bool writeTraceOnExit = false;
+	if (!parseCommandLine(argc, argv, writeTraceOnExit))
+		return -1;
+
+	// the benchmark drives the camera from a path instead of the keyboard and mouse
+	CameraPath benchmarkPath, recordedPath;
+	const bool benchmark = (gOptions.benchmarkPath != nullptr);
+	if (benchmark && !benchmarkPath.load(gOptions.benchmarkPath))
+		return -1;
+	// by default the benchmark runs to the last key (the epsilon keeps a whole number of steps from rounding up)
+	if (gOptions.headlessFrames <= 0)
+		gOptions.headlessFrames = benchmark ?
+			(int)std::floor(benchmarkPath.getDuration() / gOptions.timestep + 1e-6) + 1 : DEFAULT_HEADLESS_FRAMES;
+
+	// regression images come from the single-sampled headless target at full
+	// resolution, so they do not depend on the window or the GPU load
+	RegressionSuite regressionSuite;
+	const bool regression = (gOptions.regressionSuite != nullptr);
+	if (regression) {
+		if (!regressionSuite.load(gOptions.regressionSuite))
+			return -1;
+		regressionSuite.setTimeBudgets(gOptions.timeBudgets);
+		gOptions.headless = true;
+		gOptions.frameBudget = 0.0;
+		gOptions.uploadBudget = 0.0;
+	}
+	int exitCode = 0;
+
+	// worker threads shared by the CPU-side systems
+	ThreadPool threadPool;
+
+	// one mapping instead of an open and a read per file; without it the files are used
+	AssetPack assetPack;
+	if (gOptions.assetPack && !gOptions.packAssets && assetPack.open(gOptions.assetPack))
+		printf("Asset pack %s: %d assets, %.1f MB mapped\n", gOptions.assetPack, assetPack.getAssetCount(),
+			assetPack.getSize() / (1024.0 * 1024.0));
+	const AssetPack* assets = assetPack.isOpen() ? &assetPack : nullptr;
+
+	// decode the textures while the window, the context and the shaders are created
+	std::vector<const char*> textureFilenames;
+	for (int i = 0; i < TEX_COUNT; ++i)
+		textureFilenames.push_back(Scene::getTextureFilename(i));
+	TextureLoader textureLoader;
+	textureLoader.setCompressedCache((gOptions.textureCache && !gOptions.software && !gOptions.compileTextures) ||
+		gOptions.packAssets);
+	textureLoader.setAssetPack(assets);
+	if (!gOptions.compileTextures && !gOptions.packAssets)
+		textureLoader.setMaxImageSize(gOptions.maxTextureSize);
+	textureLoader.start(textureFilenames);
+
+	// offline texture compiler and asset packer
+	if (gOptions.compileTextures)
+		return compileTextures(threadPool, textureLoader);
+	if (gOptions.packAssets)
+		return packAssets(textureLoader);
+
+	// the CPU backend needs neither a window nor a GL context
+	if (gOptions.software)
+		return runSoftwareRenderer(benchmark ? &benchmarkPath : nullptr, threadPool, textureLoader);
 	
-	// initialize window, glew, and glfw
-	int errorFlag = initializeWindow();
+	// initialize window, glew, and glfw (or a display-less context)
+	int errorFlag = gOptions.headless ? initializeHeadless() : initializeWindow();
 	if (errorFlag == -1) {
 		std::cout << "Error.";
 		return -1;
 	}
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programId = LoadShaders("VertexShader.vs", "FragmentShader.fs");
+	// textures sampled through a page atlas that only holds what is in view
+	VirtualTexture virtualTexture;
+	bool useVirtualTexture = false;
+	if (gOptions.virtualTexture > 0.0) {
+		useVirtualTexture = virtualTexture.init(&textureLoader, (size_t)(gOptions.virtualTexture * 1024.0 * 1024.0), WIDTH, HEIGHT);
+		if (!useVirtualTexture)
+			std::cout << "Virtual texturing disabled, using texture arrays" << std::endl;
+	}
+
+	// Create and compile our GLSL program from the shaders, or link the
+	// binaries of the last run
+	ProgramCache programCache;
+	if (gOptions.programCache && !programCache.open(PROGRAM_CACHE_FILE))
+		std::cout << "The driver has no program binaries, the shaders are compiled every run" << std::endl;
+	ProgramCache* programs = programCache.isOpen() ? &programCache : nullptr;
+	const double shaderStart = getFrameClock();
+	GLuint programId;
+	GLuint feedbackProgramId = 0;
+	{
+		PROFILE_SCOPE("LoadShaders");
+		programId = LoadShaders(VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, assets,
+			useVirtualTexture ? VIRTUAL_TEXTURE_DEFINES : nullptr, programs);
+		if (useVirtualTexture)
+			feedbackProgramId = LoadShaders(VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, assets, FEEDBACK_DEFINES, programs);
+	}
+	if (programs) {
+		programCache.save();
+		printf("Programs ready in %.2f ms: %d from %s, %d compiled (%d binaries rejected)\n",
+			(getFrameClock() - shaderStart) * 1000.0, programCache.getHitCount(), PROGRAM_CACHE_FILE,
+			programCache.getMissCount(), programCache.getRejectCount());
+	}
+	else
+		printf("Programs ready in %.2f ms, compiled from source\n", (getFrameClock() - shaderStart) * 1000.0);
+
+	OcclusionCuller occlusionCuller(256, 128, &threadPool);
 	
 	// initialize location variables
 	GLint modelLoc = glGetUniformLocation(programId, "model");
@@ -86,6 +348,24 @@ int main() {
 	GLint light1ColorLoc = glGetUniformLocation(programId, "lightColor1");
 	GLint light1PositionLoc = glGetUniformLocation(programId, "lightPos1");
 	GLint viewPositionLoc = glGetUniformLocation(programId, "viewPosition");
+	GLint textureLoc = glGetUniformLocation(programId, "uTexture");
+	GLint textureLayerLoc = glGetUniformLocation(programId, "uTextureLayer");
+	GLint virtualTextureLoc = glGetUniformLocation(programId, "uVirtualTexture");
+
+	// the feedback pass only transforms and names pages
+	GLint feedbackModelLoc = glGetUniformLocation(feedbackProgramId, "model");
+	GLint feedbackViewLoc = glGetUniformLocation(feedbackProgramId, "view");
+	GLint feedbackProjLoc = glGetUniformLocation(feedbackProgramId, "projection");
+	GLint feedbackVirtualTextureLoc = glGetUniformLocation(feedbackProgramId, "uVirtualTexture");
+	GLint feedbackTextureLoc = glGetUniformLocation(feedbackProgramId, "uFeedbackTexture");
+	if (useVirtualTexture) {
+		glUseProgram(feedbackProgramId);
+		glUniform1i(glGetUniformLocation(feedbackProgramId, "uPageTable"), PAGE_TABLE_UNIT);
+		glUniform1f(glGetUniformLocation(feedbackProgramId, "uFeedbackBias"), virtualTexture.getFeedbackBias());
+		glUseProgram(programId);
+		glUniform1i(glGetUniformLocation(programId, "uPageAtlas"), PAGE_ATLAS_UNIT);
+		glUniform1i(glGetUniformLocation(programId, "uPageTable"), PAGE_TABLE_UNIT);
+	}
 	
 	///////////////////////////
 	//     Load Textures     //
@@ -93,825 +373,755 @@ int main() {
 
 	glUseProgram(programId);
 
-	// Load table texture
-	const char* texFilename0 = "../resources/textures/wood.jpg";
-	if (!createTexture(texFilename0, gTextureId0)) {
-		std::cout << "Failed to load texture " << texFilename0 << std::endl;
-		return -1;
-	}
-	
-	// Load tissue box texture
-	const char* texFilename1 = "../resources/textures/blueSquare.jpg";
-	if (!createTexture(texFilename1, gTextureId1)) {
-		std::cout << "Failed to load texture " << texFilename1 << std::endl;
-		return -1;
-	}
-	
-	// Load tissue hole texture
-	const char* texFilename2 = "../resources/textures/cardboard.jpg";
-	if (!createTexture(texFilename2, gTextureId2)) {
-		std::cout << "Failed to load texture " << texFilename2 << std::endl;
-		return -1;
+	// the scene owns the CPU copies of all meshes and the object list
+	Scene scene;
+	if (gOptions.clutterObjects > 0) {
+		PROFILE_SCOPE("addClutter");
+		scene.addClutter(gOptions.clutterObjects);
 	}
-	
-	// Load tissue texture
-	const char* texFilename3 = "../resources/textures/tissue.jpg";
-	if (!createTexture(texFilename3, gTextureId3)) {
-		std::cout << "Failed to load texture " << texFilename3 << std::endl;
+	gChanges.markChanged(CHANGE_TRANSFORMS);
+
+	// The scene textures stream into texture arrays a slice per frame, objects
+	// are drawn with a placeholder until theirs is in
+	// (or, with the virtual texture, into its atlas page by page as they come into view)
+	TextureArrays textureArrays;
+	TextureStreamer textureStreamer;
+	if (!textureArrays.init(TEX_COUNT) || (!useVirtualTexture && !textureStreamer.init(&textureLoader, &textureArrays)))
 		return -1;
+	const size_t uploadBudget = (size_t)(gOptions.uploadBudget * 1024.0 * 1024.0);
+
+	// only the levels objects are big enough on screen for stay on the GPU
+	TextureResidency textureResidency;
+	if (!useVirtualTexture && !textureResidency.init(&textureArrays, &textureStreamer, (size_t)(gOptions.textureBudget * 1024.0 * 1024.0)))
+		std::cout << "Texture residency needs OpenGL 4.3 and immutable texture storage, every level stays resident" << std::endl;
+	if (uploadBudget == 0 && useVirtualTexture) {
+		virtualTexture.finish();
+		reportVirtualTexture(virtualTexture);
 	}
-
-	// Load aloe texture
-	const char* texFilename4 = "../resources/textures/aloe.jpg";
-	if (!createTexture(texFilename4, gTextureId4)) {
-		std::cout << "Failed to load texture " << texFilename4 << std::endl;
-		return -1;
+	else if (uploadBudget == 0) {
+		textureStreamer.finish();
+		reportTextureTimes(textureLoader, textureArrays, textureStreamer);
 	}
+	gChanges.markChanged(CHANGE_RESOURCES);
 
-	// Load hand sanitizer texture
-	const char* texFilename5 = "../resources/textures/yellowFluid.jpg";
-	if (!createTexture(texFilename5, gTextureId5)) {
-		std::cout << "Failed to load texture " << texFilename5 << std::endl;
-		return -1;
-	}
+	/////////////////////////////
+	//     Set Buffer Data     //
+	/////////////////////////////
 
-	// Load cap texture
-	const char* texFilename6 = "../resources/textures/greyPlastic.jpg";
-	if (!createTexture(texFilename6, gTextureId6)) {
-		std::cout << "Failed to load texture " << texFilename6 << std::endl;
-		return -1;
+	// copy interleaved vertex data (vertex/normal/uv) and index data of every mesh to VBOs
+	GpuMesh gpuMeshes[MESH_COUNT];
+	for (int i = 0; i < MESH_COUNT; ++i) {
+		PROFILE_SCOPE("uploadMesh");
+		uploadMesh(scene.getMesh(i), gpuMeshes[i]);
 	}
-
-	// Load ball texture
-	const char* texFilename7 = "../resources/textures/blueRubber.jpg";
-	if (!createTexture(texFilename7, gTextureId7)) {
-		std::cout << "Failed to load texture " << texFilename7 << std::endl;
-		return -1;
+	gChanges.markChanged(CHANGE_RESOURCES);
+
+	// one hardware occlusion query per object and per object group
+	const std::vector<SceneObject>& objects = scene.getObjects();
+	std::vector<int> objectGroups;
+	for (size_t i = 0; i < objects.size(); ++i)
+		objectGroups.push_back(objects[i].group);
+
+	OcclusionQueryScheduler occlusionQueries;
+	occlusionQueries.init(objectGroups, GROUP_COUNT);
+	// bounding spheres (center, radius) tell texture residency how large an object is on screen
+	std::vector<glm::vec4> objectSpheres;
+	for (size_t i = 0; i < objects.size(); ++i) {
+		glm::vec3 worldMin, worldMax;
+		scene.getWorldBounds(objects[i], worldMin, worldMax);
+		occlusionQueries.setObjectBounds((int)i, worldMin, worldMax);
+		objectSpheres.push_back(glm::vec4((worldMin + worldMax) * 0.5f, glm::length(worldMax - worldMin) * 0.5f));
 	}
 
-	///////////////////////////////////////////////////////////////////
-	//     Vertex, Normal, and UV data (non-circular items only)     //
-	///////////////////////////////////////////////////////////////////
-	// saves triangles for the plane
-	static const GLfloat vertsPlane[] = {
-		1.0f, 1.0f, 0.0f,  // triangle 1
-		-1.0f, 1.0f, 0.0f,
-		1.0f, -1.0f, 0.0f,
-
-		-1.0f, 1.0f, 0.0f,  // triangle 2
-		1.0f, -1.0f, 0.0f,
-		-1.0f, -1.0f, 0.0f
-	};
-	// save normal data for plane
-	static const GLfloat normalPlane[] = {
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f
-	};
-	// saves the color data for the plane
-	static const GLfloat uvPlane[] = {
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f
-	};
-	// saves triangles for the pyramid
-	static const GLfloat vertsP[] = {
-		 0.5f,  0.3f,  0.0f, // face 1
-		 0.5f, -0.3f,  0.0f,
-		 0.0f,  0.0f,  1.0f,
-
-		 0.5f, -0.3f,  0.0f, // face 2
-		-0.5f, -0.3f,  0.0f,
-		 0.0f,  0.0f,  1.0f,
-
-		-0.5f, -0.3f,  0.0f, // face 3
-		-0.5f,  0.3f,  0.0f,
-		 0.0f,  0.0f,  1.0f,
-
-		-0.5f,  0.3f,  0.0f, // face 4
-		 0.5f,  0.3f,  0.0f,
-		 0.0f,  0.0f,  1.0f,
-
-		 0.5f,  0.3f,  0.0f, // base 1
-		-0.5f, -0.3f,  0.0f,
-		-0.5f,  0.3f,  0.0f,
-
-		 0.5f,  0.3f,  0.0f, // base 2
-		-0.5f, -0.3f,  0.0f,
-		 0.5f, -0.3f,  0.0f
-	};
-	// saves normal data for the pyramid
-	static const GLfloat normalP[] = {
-		0.6f, 0.0f, 0.3f,
-		0.6f, 0.0f, 0.3f,
-		0.6f, 0.0f, 0.3f,
-
-		0.0f, -1.0f, 0.3f,
-		0.0f, -1.0f, 0.3f,
-		0.0f, -1.0f, 0.3f,
-
-		-0.6f, 0.0f, 0.3f,
-		-0.6f, 0.0f, 0.3f,
-		-0.6f, 0.0f, 0.3f,
-
-		0.0f, 1.0f, 0.3f,
-		0.0f, 1.0f, 0.3f,
-		0.0f, 1.0f, 0.3f,
-
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f
-	};
-	// saves uv data for the pyramid
-	static const GLfloat uvP[] = {
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		0.5f, 1.0f,
-
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		0.5f, 1.0f,
-
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		0.5f, 1.0f,
-
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		0.5f, 1.0f,
-
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		0.0f, 1.0f
-	};
-	// saves triangles for the cube
-	static const GLfloat vertsCube[] = {
-		 1.0f,  1.0f,  1.0f, //face 1 (top)
-		-1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		 1.0f, -1.0f,  1.0f, // face 2 (front)
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-
-		 1.0f,  1.0f,  1.0f, //face 3 (right)
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f,  1.0f, 
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-
-		-1.0f,  1.0f,  1.0f, //face 4 (back)
-		 1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f, //face 5 (left)
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f,  1.0f, -1.0f, // face 6 (bottom)
-		-1.0f, -1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f
-	};
-	// saves normal data for the cube
-	static const GLfloat normalCube[] = {
-		0.0f, 0.0f, 1.0f, //top
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, 1.0f,
-
-		0.0f, -1.0f, 0.0f, //front
-		0.0f, -1.0f, 0.0f,
-		0.0f, -1.0f, 0.0f,
-		0.0f, -1.0f, 0.0f,
-		0.0f, -1.0f, 0.0f,
-		0.0f, -1.0f, 0.0f,
-
-		1.0f, 0.0f, 0.0f, //right
-		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f, 0.0f,
-
-		0.0f, 1.0f, 0.0f, //back
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-
-		-1.0f, 0.0f, 0.0f, //left
-		-1.0f, 0.0f, 0.0f,
-		-1.0f, 0.0f, 0.0f,
-		-1.0f, 0.0f, 0.0f,
-		-1.0f, 0.0f, 0.0f,
-		-1.0f, 0.0f, 0.0f,
-
-		0.0f, 0.0f, -1.0f, //bottom
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f,
-		0.0f, 0.0f, -1.0f
-	};
-	// saves uv data for the cube
-	GLfloat repeat = 3.0f;
-	static const GLfloat uvCube[] = {
-		repeat, repeat,
-		0.0f, repeat, 
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
-
-		repeat, repeat,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
-
-		repeat, repeat,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
-
-		repeat, repeat,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
-
-		repeat, repeat,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
-
-		repeat, repeat,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, repeat,
-		repeat, 0.0f,
-		0.0f, 0.0f,
+	// query boxes are drawn with the cube mesh stretched over the world-space bounds
+	int boundMesh = -1;
+	int queryBoxes = 0;
+	OcclusionQueryScheduler::BoxDrawer drawQueryBox = [&](const glm::vec3& boxMin, const glm::vec3& boxMax) {
+		glm::mat4 boxModel = glm::translate((boxMin + boxMax) * 0.5f) * glm::scale((boxMax - boxMin) * 0.5f);
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(boxModel));
+		bindMesh(gpuMeshes[MESH_CUBE]);
+		drawBoundMesh(gpuMeshes[MESH_CUBE]);
+		boundMesh = MESH_CUBE;
+		++queryBoxes;
 	};
 
-	/////////////////////////////
-	//     Set Buffer Data     //
-	/////////////////////////////
-	
-	// copy plane vertex to VBO
-	GLuint vertexBufferPlane;
-	glGenBuffers(1, &vertexBufferPlane);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPlane);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertsPlane), vertsPlane, GL_STATIC_DRAW);
-
-	// copy plane normal data to VBO
-	GLuint normalBufferPlane;
-	glGenBuffers(1, &normalBufferPlane);
-	glBindBuffer(GL_ARRAY_BUFFER, normalBufferPlane);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normalPlane), normalPlane, GL_STATIC_DRAW);
-
-	// copy plane uv data to VBO
-	GLuint uvBufferPlane;
-	glGenBuffers(1, &uvBufferPlane);
-	glBindBuffer(GL_ARRAY_BUFFER, uvBufferPlane);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(uvPlane), uvPlane, GL_STATIC_DRAW);
-
-	// copy pyramid vertex data to VBO
-	GLuint vertexBufferPyramid;
-	glGenBuffers(1, &vertexBufferPyramid);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPyramid);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertsP), vertsP, GL_STATIC_DRAW);
-
-	// copy pyramid normal data to VBO
-	GLuint normalBufferPyramid;
-	glGenBuffers(1, &normalBufferPyramid);
-	glBindBuffer(GL_ARRAY_BUFFER, normalBufferPyramid);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normalP), normalP, GL_STATIC_DRAW);
-
-	// copy pyramid uv data to VBO
-	GLuint uvBufferPyramid;
-	glGenBuffers(1, &uvBufferPyramid);
-	glBindBuffer(GL_ARRAY_BUFFER, uvBufferPyramid);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(uvP), uvP, GL_STATIC_DRAW);
-
-	Cylinder cap;
-	cap.setHeight(1.75f);
-
-	// copy interleaved vertex data (vertex/normal/tangent) to VBO
-	GLuint interleavedBufferCap;
-	glGenBuffers(1, &interleavedBufferCap);
-	glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferCap);             
-	glBufferData(GL_ARRAY_BUFFER,                     // target
-		cap.getInterleavedVertexSize(), // data size, # of bytes
-		cap.getInterleavedVertices(),   // ptr to vertex data
-		GL_STATIC_DRAW);                     // usage
-
-	// copy index data to VBO
-	GLuint indexBufferCap;
-	glGenBuffers(1, &indexBufferCap);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferCap);     // for index data
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,             // target
-		cap.getIndexSize(),             // data size, # of bytes
-		cap.getIndices(),               // ptr to index data
-		GL_STATIC_DRAW);                     // usage
-
-	// copy cube vertex to VBO
-	GLuint vertexBufferCube;
-	glGenBuffers(1, &vertexBufferCube);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferCube);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertsCube), vertsCube, GL_STATIC_DRAW);
-
-	// copy cube normals to VBO
-	GLuint normalBufferCube;
-	glGenBuffers(1, &normalBufferCube);
-	glBindBuffer(GL_ARRAY_BUFFER, normalBufferCube);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normalCube), normalCube, GL_STATIC_DRAW);
-
-	// copy cube color data to VBO
-	GLuint uvBufferCube;
-	glGenBuffers(1, &uvBufferCube);
-	glBindBuffer(GL_ARRAY_BUFFER, uvBufferCube);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(uvCube), uvCube, GL_STATIC_DRAW);
-
-	Cylinder container;
-	container.setHeight(1.0f);
-
-	// copy interleaved vertex data (vertex/normal/tangent) to VBO
-	GLuint interleavedBufferContainer;
-	glGenBuffers(1, &interleavedBufferContainer);
-	glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferContainer);             
-	glBufferData(GL_ARRAY_BUFFER, 
-		container.getInterleavedVertexSize(),
-		container.getInterleavedVertices(),
-		GL_STATIC_DRAW);                    
-
-	// copy index data to VBO
-	GLuint indexBufferContainer;
-	glGenBuffers(1, &indexBufferContainer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferContainer);  
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,            
-		container.getIndexSize(),            
-		container.getIndices(),          
-		GL_STATIC_DRAW);                
-
-	// create a sphere with default params
-	Sphere ball;
-
-	// copy interleaved vertex data (vertex, normals, texture) to VBO
-	GLuint interleavedBufferBall;
-	glGenBuffers(1, &interleavedBufferBall);
-	glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferBall);       
-	glBufferData(GL_ARRAY_BUFFER,                  
-		ball.getInterleavedVertexSize(), 
-		ball.getInterleavedVertices(),   
-		GL_STATIC_DRAW);                   
-
-	// copy index data to VBO
-	GLuint indexBufferBall;
-	glGenBuffers(1, &indexBufferBall);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferBall);   
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,     
-		ball.getIndexSize(),             
-		ball.getIndices(),              
-		GL_STATIC_DRAW);
-
-	////////////////////////////////////
-	//     Create Model Matricies     //
-	////////////////////////////////////
-
-	// 1. Scales the plane
-	glm::mat4 scalePlane = glm::scale(glm::vec3(10.0f, 6.0f, 5.0f));
-	// 2. Rotates plane
-	glm::mat4 rotationPlane = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.0f));
-	// 3. Place plane
-	glm::mat4 translationPlane = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelTable = translationPlane * rotationPlane * scalePlane;
-
-	// 1. Scales the pyramid
-	glm::mat4 scalePyramid = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
-	// 2. Rotates pyramid 
-	glm::mat4 rotationPyramid = glm::rotate(2.5f, glm::vec3(0.0f, 0.0f, 1.0f));
-	// 3. Place pyramid 
-	glm::mat4 translationPyramid = glm::translate(glm::vec3(1.0f, -2.0f, 0.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelPyramid = translationPyramid * rotationPyramid * scalePyramid;
-	
-	// 1. Scales the cap
-	glm::mat4 scaleCap = glm::scale(glm::vec3(0.5f, 0.5f, 0.5f));
-	// 2. Rotates cap 
-	glm::mat4 rotationCap = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
-	// 3. Place cap
-	glm::mat4 translationCap = glm::translate(glm::vec3(1.0f, -2.0f, 2.6f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelCap = translationCap * rotationCap * scaleCap;
-
-	// 1. Scales the cube
-	glm::mat4 scaleCube = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
-	// 2. Rotates cube 
-	glm::mat4 rotationCube = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
-	// 3. Place cube
-	glm::mat4 translationCube = glm::translate(glm::vec3(-5.0f, 0.0f, 3.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelCube = translationCube * rotationCube * scaleCube;
-
-	// 1. Scales the hole
-	glm::mat4 scaleHole = glm::scale(glm::vec3(1.0f, 2.0f, 1.0f));
-	// 2. Rotates hole 
-	glm::mat4 rotationHole = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
-	// 3. Place hole
-	glm::mat4 translationHole = glm::translate(glm::vec3(-5.0f, 0.0f, 6.001f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelHole = translationHole * rotationHole * scaleHole;
-
-	// 1. Scales the tissue
-	glm::mat4 scaleTissue = glm::scale(glm::vec3(3.0f, 1.9f, 1.0f));
-	// 2. Rotates tissue
-	glm::mat4 rotationTissue = glm::rotate(1.57f, glm::vec3(0.0f, 1.0f, 0.0f));
-	// 3. Place tissue
-	glm::mat4 translationTissue = glm::translate(glm::vec3(-5.0f, 0.0f, 6.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelTissue = translationTissue * rotationTissue * scaleTissue;
-
-	// 1. Scales the green container
-	glm::mat4 scaleContainer = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
-	// 2. Rotates green container 
-	glm::mat4 rotationContainer = glm::rotate(0.0f, glm::vec3(1.0f, 0.0f, 0.25f));
-	// 3. Place green container
-	glm::mat4 translationContainer = glm::translate(glm::vec3(3.0f, 3.0f, 1.5f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelContainer = translationContainer * rotationContainer * scaleContainer;
-
-	// 1. Scales the ball
-	glm::mat4 scaleBall = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-	// 2. Rotates ball 
-	glm::mat4 rotationBall = glm::rotate(1.5f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Place ball
-	glm::mat4 translationBall = glm::translate(glm::vec3(2.0f, 2.0f, 5.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 modelBall = translationBall * rotationBall * scaleBall;
-	
+	// worker threads cull and record draw packets, the GL thread only replays them
+	DrawListRecorder drawListRecorder(&threadPool);
+	drawListRecorder.setScene(&scene);
+
+	// offscreen target whose resolution follows the GPU frame time
+	DynamicResolution dynamicResolution;
+	bool useDynamicResolution = false;
+	if (gOptions.frameBudget > 0.0) {
+		int framebufferWidth = WIDTH, framebufferHeight = HEIGHT;
+		if (window)
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		useDynamicResolution = dynamicResolution.init(framebufferWidth, framebufferHeight, MSAA_SAMPLES,
+			gOptions.frameBudget, gOptions.resolutionLog);
+	}
+	unsigned int frameCounter = 0;
+
+	// frame start pacing on the simulation side, timestamps on the GL side
+	FrameLimiter frameLimiter(gOptions.targetRate);
+	FrameTimeline frameTimeline;
+	frameTimeline.init(gOptions.frameLog);
+	double lastPresentTime = 0.0;
+
+	// GPU time per pass and per object name; objects with the same name share a scope
+	GpuProfiler gpuProfiler;
+	GpuProfiler* profiler = nullptr;
+	if (gOptions.gpuProfile) {
+		gpuProfiler.init();
+		profiler = &gpuProfiler;
+	}
+	const int frameScope = gpuProfiler.registerScope("frame");
+	const int clearScope = gpuProfiler.registerScope("clear");
+	const int sceneScope = gpuProfiler.registerScope("scene");
+	const int upscaleScope = gpuProfiler.registerScope("upscale");
+	const int feedbackScope = gpuProfiler.registerScope("feedback");
+	std::vector<int> objectScopes;
+	for (size_t i = 0; i < objects.size(); ++i)
+		objectScopes.push_back(gpuProfiler.registerScope(objects[i].name));
+	bool resumed = false; // the next frame is the first one after idling
+
+	// draw calls and triangles submitted by the last rendered frame
+	int lastDrawCalls = 0;
+	long long lastTriangles = 0;
+	const int queryBoxTriangles = gpuMeshes[MESH_CUBE].count / 3;
+	double recordStart = getFrameClock();
+
 	/////////////////////////////////
 	//     Set Light Variables     //
 	/////////////////////////////////
 
 	glUniform3f(objectColorLoc, 0.0f, 1.0f, 1.0f);
-	glUniform3f(light0ColorLoc, 1.0f, 1.0f, 1.0f); // 100% strength, white
-	glUniform3f(light0PositionLoc, 15.0f, -10.0f, 15.0f); // off to the front-right
-	glUniform3f(light1ColorLoc, 0.2f, 0.5f, 0.5f); // 50% strength, light-cyan
-	glUniform3f(light1PositionLoc, -1.0f, 10.0f, 15.0f); // behind the scene
+	glUniform3fv(light0ColorLoc, 1, glm::value_ptr(LIGHT0_COLOR));
+	glUniform3fv(light0PositionLoc, 1, glm::value_ptr(LIGHT0_POSITION));
+	glUniform3fv(light1ColorLoc, 1, glm::value_ptr(LIGHT1_COLOR));
+	glUniform3fv(light1PositionLoc, 1, glm::value_ptr(LIGHT1_POSITION));
+	gChanges.markChanged(CHANGE_LIGHTS);
 
 	//////////////////////////////
 	//     Main Render Loop     //
 	//////////////////////////////
-	
-	// Check if the ESC key was pressed or the window was closed
-	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0) {
-		// Enable depth test
-		glEnable(GL_DEPTH_TEST);
-		// Accept fragment if it closer to the camera than the former one
-		glDepthFunc(GL_LESS);
 
-		// black background
-		glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
-		// Clear the screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glUseProgram(programId);
-
-		processKeyInput(window);
-		const glm::vec3 cameraPosition = gCamera.Position;
-		glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-		// per-frame timing
+	// Samples input, moves the camera and records the visible set into a snapshot
+	auto simulateFrame = [&](FrameSnapshot& snapshot) {
+		// per-frame timing, before the input is applied with it
 		// --------------------
-		float currentFrame = glfwGetTime();
-		gDeltaTime = currentFrame - gLastFrame;
-		gLastFrame = currentFrame;
+		{
+			PROFILE_SCOPE("frame limiter");
+			gDeltaTime = (float)frameLimiter.beginFrame();
+		}
+		PROFILE_SCOPE("simulate");
+		snapshot.inputTime = frameLimiter.getFrameStart();
+		snapshot.resumed = resumed;
+		resumed = false;
+
+		// frames are a fixed timestep apart on the path, however long they take
+		if (benchmark)
+			applyCameraKey(benchmarkPath.sample(frameCounter * gOptions.timestep));
+		else if (window)
+			processKeyInput(window);
+		if (gOptions.recordPath)
+			recordedPath.addKey(getCameraKey(snapshot.inputTime - recordStart));
+		snapshot.cameraPosition = gCamera.Position;
 
 		// camera/view transformation
-		glm::mat4 View = gCamera.GetViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(View));
+		snapshot.view = gCamera.GetViewMatrix();
 
 		// Calculate Projection
-		glm::mat4 Projection;
-		float scale = 75;
-		if (gIsPerspective)
-			Projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
-		else
-			Projection = glm::ortho(-(GLfloat)WIDTH / scale, (GLfloat)WIDTH / scale, -(GLfloat)HEIGHT / scale, (GLfloat)HEIGHT / scale, -50.0f, 50.0f);
-		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(Projection));
-
-		//enable attribute arrays
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glEnableVertexAttribArray(2);
-
-		//-----Plane 1 (Table)-----
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelTable));
-
-		// 1st attribute buffer : vertices
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPlane);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 2nd attribute buffer : normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferPlane);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 3rd attribute buffer : uv
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferPlane);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId0);
-		glUniform1i(gTextureId0, 0);
-
-		// Draw the triangles to the plane
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		//-----Cube (Tissue Box)-----
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelCube));
-
-		// 1st attribute buffer : vertices
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferCube);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 2nd attribute buffer : normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferCube);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 3rd attribute buffer : uv
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferCube);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId1);
-		glUniform1i(gTextureId1, 0);
-
-		// Draw the triangles to the cube
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		//-----Plane 2 (Tissue Box Hole)------
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelHole));
-
-		// 1st attribute buffer : vertices
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPlane);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 2nd attribute buffer : normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferPlane);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 3rd attribute buffer : uv
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferPlane);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId2);
-		glUniform1i(gTextureId2, 0);
-
-		// Draw the triangles the plane
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		//-----Plane 2 (Tissue)------
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelTissue));
-
-		// 1st attribute buffer : vertices
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPlane);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 2nd attribute buffer : normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferPlane);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 3rd attribute buffer : uv
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferPlane);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId3);
-		glUniform1i(gTextureId3, 0);
-
-		// Draw the triangles the plane
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		//-----Pyramid-----
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelPyramid));
-
-		// 1st attribute buffer : vertices
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferPyramid);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 2nd attribute buffer : normals
-		glBindBuffer(GL_ARRAY_BUFFER, normalBufferPyramid);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// 3rd attribute buffer : uv
-		glBindBuffer(GL_ARRAY_BUFFER, uvBufferPyramid);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId5);
-		glUniform1i(gTextureId5, 0);
-
-		// Draw the triangles to make a pyramid
-		glDrawArrays(GL_TRIANGLES, 0, 18);
+		snapshot.projection = getProjection();
+
+		// rasterize the large occluders into the CPU depth buffer
+		const glm::mat4 viewProjection = snapshot.projection * snapshot.view;
+		snapshot.occlusionRasterTime = 0.0;
+		if (gOcclusionCulling) {
+			PROFILE_SCOPE("occlusion raster");
+			occlusionCuller.beginFrame(viewProjection);
+			for (size_t i = 0; i < objects.size(); ++i) {
+				if (objects[i].occluder)
+					occlusionCuller.addOccluder(scene.getMesh(objects[i].mesh), objects[i].model);
+			}
+			occlusionCuller.rasterizeOccluders();
+			snapshot.occlusionRasterTime = occlusionCuller.getRasterizeTime();
+		}
 
-		// unbind VBOs and disable attribute arrays
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		// cull, sort and record the draw packets on the worker threads
+		PROFILE_SCOPE("record draw list");
+		drawListRecorder.setOcclusionCuller(gOcclusionCulling ? &occlusionCuller : nullptr);
+		drawListRecorder.record(viewProjection);
+		drawListRecorder.getPackets(snapshot.packets);
+		snapshot.frustumCulledObjects = drawListRecorder.getFrustumCulledCount();
+		snapshot.culledObjects = drawListRecorder.getOcclusionCulledCount();
+		snapshot.occlusionTestTime = drawListRecorder.getOcclusionTestTime();
+		snapshot.recordTime = drawListRecorder.getRecordTime();
+		snapshot.occlusionQueries = gOcclusionQueries;
+		snapshot.frame = ++frameCounter;
+	};
 
+	bool virtualTextureSettled = false;
 
-		//-----Cylinder 1 (Cap)------
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelCap));
+	// Replays a snapshot with GL and presents it
+	auto renderFrame = [&](const FrameSnapshot& snapshot) {
+		PROFILE_SCOPE("render");
 
-		// bind VBOs
-		glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferCap);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferCap);
+		// Enable depth test
+		glEnable(GL_DEPTH_TEST);
+		// Accept fragment if it closer to the camera than the former one
+		glDepthFunc(GL_LESS);
 
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId6);
-		glUniform1i(gTextureId6, 0);
+		// the window, or the offscreen framebuffer without one
+		const GLuint outputFramebuffer = gHeadless.getFramebuffer();
+		glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
 
-		// set attrib arrays with stride and offset
-		int strideCap = cap.getInterleavedStride();   // should be 32 bytes
-		glVertexAttribPointer(0, 3, GL_FLOAT, false, strideCap, (void*)0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, false, strideCap, (void*)(sizeof(float)*3));
-		glVertexAttribPointer(2, 2, GL_FLOAT, false, strideCap, (void*)(sizeof(float)*6));
+		frameTimeline.beginFrame(snapshot.frame, snapshot.inputTime);
+		if (profiler) {
+			if (gDumpGpuProfile.exchange(false))
+				profiler->dump(stdout);
+			profiler->beginFrame();
+			profiler->beginScope(frameScope);
+		}
 
-		// draw a cylinder with VBO
-		glDrawElements(GL_TRIANGLES, cap.getIndexCount(), GL_UNSIGNED_INT, (void*)0); 
+		// draw into the scaled offscreen target
+		if (useDynamicResolution)
+			dynamicResolution.beginFrame();
 
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		{
+			GpuScope scope(profiler, clearScope);
+			// black background
+			glClearColor(CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, 0.0f);
+			// Clear the screen
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
-		//-----Cylinder 2 (Aloe Container)-----
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelContainer));
+		glUseProgram(programId);
 
-		// bind VBOs
-		glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferContainer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferContainer);
+		const glm::vec3& cameraPosition = snapshot.cameraPosition;
+		glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(snapshot.view));
+		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(snapshot.projection));
 
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId4);
-		glUniform1i(gTextureId4, 0);
+		//enable attribute arrays
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
 
-		// set attrib arrays with stride and offset
-		int strideContainer = container.getInterleavedStride();   // should be 32 bytes
-		glVertexAttribPointer(0, 3, GL_FLOAT, false, strideCap, (void*)0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, false, strideCap, (void*)(sizeof(float) * 3));
-		glVertexAttribPointer(2, 2, GL_FLOAT, false, strideCap, (void*)(sizeof(float) * 6));
+		// pick up the query results of earlier frames that are ready
+		if (snapshot.occlusionQueries)
+			occlusionQueries.beginFrame(cameraPosition);
+
+		// replay the packets, only touching state that changes between them
+		if (profiler)
+			profiler->beginScope(sceneScope);
+		boundMesh = -1;
+		int boundArray = -1;
+		int boundLayer = -1;
+		int boundTexture = -1;
+		long long triangles = 0;
+		queryBoxes = 0;
+		int openObjectScope = -1; // runs of objects with the same name are timed as one
+
+		// the levels this frame's objects need, then the next slice of the
+		// textures streaming in; until it is all in every frame looks
+		// different, so on-demand keeps rendering
+		if (textureResidency.isEnabled()) {
+			const glm::mat4 viewProjection = snapshot.projection * snapshot.view;
+			textureResidency.beginFrame();
+			for (size_t i = 0; i < snapshot.packets.size(); ++i) {
+				// pixels the bounding sphere spans vertically; w is the distance, 1 in ortho
+				const glm::vec4& sphere = objectSpheres[snapshot.packets[i].object];
+				float w = std::max((viewProjection * glm::vec4(glm::vec3(sphere), 1.0f)).w, 0.1f);
+				textureResidency.addUse(snapshot.packets[i].getTexture(), sphere.w * snapshot.projection[1][1] * HEIGHT / w);
+			}
+			textureResidency.update();
+		}
+		if (useVirtualTexture) {
+			virtualTexture.update(uploadBudget);
+			if (virtualTexture.isBusy())
+				gChanges.markChanged(CHANGE_RESOURCES);
+			else if (!virtualTextureSettled && virtualTexture.isComplete()) {
+				// the first view has every page it wants
+				virtualTextureSettled = true;
+				reportVirtualTexture(virtualTexture);
+			}
+			virtualTexture.bind(PAGE_ATLAS_UNIT, PAGE_TABLE_UNIT);
+		}
+		else {
+			if (textureStreamer.isBusy()) {
+				if (textureStreamer.update(uploadBudget))
+					reportTextureTimes(textureLoader, textureArrays, textureStreamer);
+				gChanges.markChanged(CHANGE_RESOURCES);
+			}
+			textureArrays.bind();
+		}
+		const std::vector<DrawPacket>& packets = snapshot.packets;
+		for (size_t i = 0; i < packets.size(); ++i) {
+			const DrawPacket& packet = packets[i];
+
+			if (profiler && objectScopes[packet.object] != openObjectScope) {
+				if (openObjectScope >= 0)
+					profiler->endScope(openObjectScope);
+				openObjectScope = objectScopes[packet.object];
+				profiler->beginScope(openObjectScope);
+			}
+
+			// query and/or draw conditionally
+			if (snapshot.occlusionQueries)
+				occlusionQueries.beginObject(packet.object, drawQueryBox);
+
+			// set the model
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packet.model));
+
+			// every array is already bound, a texture is just a unit and a layer,
+			// or where its pages are in the page table
+			if (useVirtualTexture) {
+				if (packet.getTexture() != boundTexture) {
+					boundTexture = packet.getTexture();
+					GLint value[4];
+					virtualTexture.getUniform(boundTexture, value);
+					glUniform4iv(virtualTextureLoc, 1, value);
+				}
+			}
+			else {
+				const TextureLayer& textureLayer = textureArrays.getLayer(packet.getTexture());
+				if (textureLayer.array != boundArray) {
+					boundArray = textureLayer.array;
+					glUniform1i(textureLoc, boundArray);
+				}
+				if (textureLayer.layer != boundLayer) {
+					boundLayer = textureLayer.layer;
+					glUniform1f(textureLayerLoc, (float)boundLayer);
+				}
+			}
+
+			if (packet.getMesh() != boundMesh) {
+				boundMesh = packet.getMesh();
+				bindMesh(gpuMeshes[boundMesh]);
+			}
+			drawBoundMesh(gpuMeshes[boundMesh]);
+			triangles += gpuMeshes[boundMesh].count / 3;
+
+			if (snapshot.occlusionQueries)
+				occlusionQueries.endObject(packet.object);
+		}
+		if (profiler) {
+			if (openObjectScope >= 0)
+				profiler->endScope(openObjectScope);
+			profiler->endScope(sceneScope);
+		}
 
-		// draw a cylinder with VBO
-		glDrawElements(GL_TRIANGLES, cap.getIndexCount(), GL_UNSIGNED_INT, (void*)0);
+		// the pages this frame wants, read back a few frames later
+		if (useVirtualTexture) {
+			GpuScope scope(profiler, feedbackScope);
+			virtualTexture.beginFeedback();
+			glUseProgram(feedbackProgramId);
+			glUniformMatrix4fv(feedbackViewLoc, 1, GL_FALSE, glm::value_ptr(snapshot.view));
+			glUniformMatrix4fv(feedbackProjLoc, 1, GL_FALSE, glm::value_ptr(snapshot.projection));
+			boundTexture = -1;
+			for (size_t i = 0; i < packets.size(); ++i) {
+				const DrawPacket& packet = packets[i];
+				glUniformMatrix4fv(feedbackModelLoc, 1, GL_FALSE, glm::value_ptr(packet.model));
+				if (packet.getTexture() != boundTexture) {
+					boundTexture = packet.getTexture();
+					GLint value[4];
+					virtualTexture.getUniform(boundTexture, value);
+					glUniform4iv(feedbackVirtualTextureLoc, 1, value);
+					glUniform1i(feedbackTextureLoc, boundTexture);
+				}
+				if (packet.getMesh() != boundMesh) {
+					boundMesh = packet.getMesh();
+					bindMesh(gpuMeshes[boundMesh]);
+				}
+				drawBoundMesh(gpuMeshes[boundMesh]);
+			}
+			virtualTexture.endFeedback();
+			glUseProgram(programId);
+		}
 
 		// unbind VBO
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-		//-----Sphere (Stress Ball)-----
-		// set the model
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelBall));
-
-		// bind VBOs
-		glBindBuffer(GL_ARRAY_BUFFER, interleavedBufferBall);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferBall);
-
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gTextureId7);
-		glUniform1i(gTextureId7, 0);
-
-		// set attrib arrays with stride and offset
-		int stride = ball.getInterleavedStride();     // should be 32 bytes
-		glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-		glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
-
-		// draw a sphere with VBO
-		glDrawElements(GL_TRIANGLES,ball.getIndexCount(), GL_UNSIGNED_INT, (void*)0);
-
-		// unbind VBO
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		
 		//disable attribute arrays
 		glDisableVertexAttribArray(0);
 		glDisableVertexAttribArray(1);
 		glDisableVertexAttribArray(2);
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		// upscale to the window
+		if (useDynamicResolution) {
+			GpuScope scope(profiler, upscaleScope);
+			dynamicResolution.endFrame(outputFramebuffer);
+		}
+		if (profiler) {
+			profiler->endScope(frameScope);
+			profiler->endFrame();
+		}
+		frameTimeline.endFrame();
+
+		// Swap buffers; headless frames are finished instead, so their time is measurable
+		{
+			PROFILE_SCOPE("swap");
+			if (window)
+				glfwSwapBuffers(window);
+			else
+				glFinish();
+		}
+		frameTimeline.present();
+		double presentTime = getFrameClock();
+
+		// stats are only touched by the thread that renders
+		++gFrameStats.frames;
+		gFrameStats.drawnObjects += (int)packets.size();
+		gFrameStats.frustumCulledObjects += snapshot.frustumCulledObjects;
+		gFrameStats.culledObjects += snapshot.culledObjects;
+		gFrameStats.occlusionRasterTime += snapshot.occlusionRasterTime;
+		gFrameStats.occlusionTestTime += snapshot.occlusionTestTime;
+		gFrameStats.recordTime += snapshot.recordTime;
+		if (snapshot.occlusionQueries) {
+			gFrameStats.occlusionQueries += occlusionQueries.getQueryCount();
+			gFrameStats.conditionalObjects += occlusionQueries.getOccludedCount();
+		}
+		// conditionally rendered objects count as submitted, query boxes on top of them
+		lastDrawCalls = (int)packets.size() + queryBoxes;
+		lastTriangles = triangles + (long long)queryBoxes * queryBoxTriangles;
+		double latency = (presentTime - snapshot.inputTime) * 1000.0;
+		gFrameStats.latency += latency;
+		gFrameStats.maxLatency = std::max(gFrameStats.maxLatency, latency);
+		gFrameStats.resolutionScale += useDynamicResolution ? dynamicResolution.getScale() : 1.0;
+		gFrameStats.residentTextures = (useVirtualTexture ? virtualTexture.getResidentSize() : textureResidency.getResidentSize()) /
+			(1024.0 * 1024.0);
+		gFrameStats.evictedLevels = textureResidency.getEvictedLevels();
+		const FrameTiming* timing = frameTimeline.getLastCompleteFrame();
+		const FrameTiming& current = frameTimeline.getCurrentFrame();
+		gFrameStats.cpuTime += (current.cpuEnd - current.cpuBegin) * 1000.0;
+		if (timing) {
+			gFrameStats.gpuTime += (timing->gpuEnd - timing->gpuBegin) * 1000.0;
+			++gFrameStats.gpuFrames;
+		}
+		if (lastPresentTime > 0.0 && !snapshot.resumed) {
+			double interval = (presentTime - lastPresentTime) * 1000.0;
+			gFrameStats.frameInterval += interval;
+			gFrameStats.frameIntervalSquares += interval * interval;
+			gFrameStats.maxFrameInterval = std::max(gFrameStats.maxFrameInterval, interval);
+			++gFrameStats.frameIntervals;
+		}
+		lastPresentTime = presentTime;
+		reportFrameStats(presentTime);
+	};
+
+	std::cout << "Render thread " << (gOptions.renderThread ? "enabled" : "disabled") << std::endl;
+	if (useDynamicResolution)
+		std::cout << "Dynamic resolution enabled, GPU budget " << gOptions.frameBudget << " ms" << std::endl;
+	if (gOptions.onDemand)
+		std::cout << "On-demand rendering enabled" << std::endl;
+
+	// true when the last presented frame is still up to date; blocks for events meanwhile
+	unsigned int presentedVersion = gChanges.getVersion() - 1;
+	auto waitWhileUnchanged = [&]() {
+		if (!gOptions.onDemand || gChanges.getVersion() != presentedVersion || isCameraKeyHeld(window))
+			return false;
+		PROFILE_SCOPE("wait events");
+		glfwWaitEventsTimeout(gOptions.idleTimeout);
+		frameLimiter.reset(); // the idle time is neither camera movement time nor a frame interval
+		resumed = true;
+		return true;
+	};
 
+	if (regression) {
+		// every case settles first (occlusion query results lag a few frames), then is measured
+		std::vector<RegressionResult> results(regressionSuite.getCaseCount());
+		FrameSnapshot snapshot;
+		std::vector<unsigned char> pixels;
+		std::vector<double> cpuTimes, gpuTimes;
+		auto median = [](std::vector<double>& values) {
+			if (values.empty())
+				return 0.0;
+			std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+			return values[values.size() / 2];
+		};
+		for (int c = 0; c < regressionSuite.getCaseCount(); ++c) {
+			cpuTimes.clear();
+			gpuTimes.clear();
+			for (int i = 0; i < REGRESSION_WARMUP_FRAMES + REGRESSION_FRAMES; ++i) {
+				applyCameraKey(regressionSuite.getCase(c).camera);
+				simulateFrame(snapshot);
+				renderFrame(snapshot);
+				if (i < REGRESSION_WARMUP_FRAMES)
+					continue;
+				const FrameTiming* timing = frameTimeline.getLastCompleteFrame();
+				const FrameTiming& current = frameTimeline.getCurrentFrame();
+				cpuTimes.push_back((current.cpuEnd - current.cpuBegin) * 1000.0);
+				if (timing)
+					gpuTimes.push_back((timing->gpuEnd - timing->gpuBegin) * 1000.0);
+			}
+
+			RegressionResult& result = results[c];
+			result.drawCalls = lastDrawCalls;
+			result.triangles = lastTriangles;
+			result.cpuTime = median(cpuTimes);
+			result.gpuTime = median(gpuTimes);
+			gHeadless.readPixels(pixels);
+			if (gOptions.updateGolden && !regressionSuite.updateGolden(c, &pixels[0], gHeadless.getWidth(), gHeadless.getHeight()))
+				std::cout << "Failed to write the reference image of " << regressionSuite.getCase(c).name << std::endl;
+			regressionSuite.evaluate(c, &pixels[0], gHeadless.getWidth(), gHeadless.getHeight(), result);
+		}
+		if (!regressionSuite.report(results))
+			exitCode = 1;
+	}
+	else if (gOptions.headless || benchmark) {
+		// a fixed number of frames, each one optionally written to disk
+		if (benchmark)
+			std::cout << "Benchmark: " << benchmarkPath.getKeyCount() << " camera keys, " << gOptions.headlessFrames
+				<< " frames at " << gOptions.timestep << " s steps" << std::endl;
+		FrameSnapshot snapshot;
+		std::vector<unsigned char> pixels;
+		BenchmarkRecorder results;
+		double totalTime = 0.0, minTime = 1e9, maxTime = 0.0;
+		for (int i = 0; i < gOptions.headlessFrames; ++i) {
+			if (window) {
+				glfwPollEvents();
+				if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS || glfwWindowShouldClose(window))
+					break;
+			}
+			double start = getFrameClock();
+			simulateFrame(snapshot);
+			renderFrame(snapshot);
+			double frameTime = (getFrameClock() - start) * 1000.0;
+			totalTime += frameTime;
+			minTime = std::min(minTime, frameTime);
+			maxTime = std::max(maxTime, frameTime);
+
+			// GPU timestamps arrive a few frames late, so the GPU time is of an earlier frame
+			const FrameTiming* timing = frameTimeline.getLastCompleteFrame();
+			const FrameTiming& current = frameTimeline.getCurrentFrame();
+			double cpuTime = (current.cpuEnd - current.cpuBegin) * 1000.0;
+			double gpuTime = timing ? (timing->gpuEnd - timing->gpuBegin) * 1000.0 : 0.0;
+			if (benchmark)
+				results.addFrame(frameTime, cpuTime, gpuTime, lastDrawCalls, lastTriangles);
+			else
+				printf("frame %d: %.3f ms (cpu %.3f ms, gpu %.3f ms)\n", i, frameTime, cpuTime, gpuTime);
+
+			if (gOptions.outputPattern) {
+				PROFILE_SCOPE("write image");
+				char filename[1024];
+				snprintf(filename, sizeof(filename), gOptions.outputPattern, i);
+				gHeadless.readPixels(pixels);
+				if (!HeadlessContext::writePPM(filename, gHeadless.getWidth(), gHeadless.getHeight(), &pixels[0]))
+					break;
+			}
+		}
+		if (gOptions.headlessFrames > 0)
+			printf("%d frames: avg %.3f ms, min %.3f ms, max %.3f ms\n", gOptions.headlessFrames,
+				totalTime / gOptions.headlessFrames, minTime, maxTime);
+
+		if (benchmark) {
+			// GL settings that change the work per frame
+			results.addSetting("headless", gOptions.headless ? 1.0 : 0.0);
+			results.addSetting("frameBudget", useDynamicResolution ? gOptions.frameBudget : 0.0);
+			results.addSetting("occlusionCulling", gOcclusionCulling ? 1.0 : 0.0);
+			results.addSetting("occlusionQueries", gOcclusionQueries ? 1.0 : 0.0);
+			results.addSetting("targetRate", gOptions.targetRate);
+			writeBenchmarkResults(results, (const char*)glGetString(GL_RENDERER));
+		}
+	}
+	else if (!gOptions.renderThread) {
+		// Check if the ESC key was pressed or the window was closed
+		FrameSnapshot snapshot;
+		while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0) {
+			if (waitWhileUnchanged())
+				continue;
+			// changes made while this frame is built are picked up by the next one
+			presentedVersion = gChanges.getVersion();
+			simulateFrame(snapshot);
+			renderFrame(snapshot);
+			PROFILE_SCOPE("poll events");
+			glfwPollEvents();
+		}
+	}
+	else {
+		// the GL context moves to the render thread, events stay on this one
+		TripleBuffer<FrameSnapshot> snapshots;
+		std::atomic<bool> running(true);
+		std::atomic<unsigned int> renderedFrame(0);
+
+		glfwMakeContextCurrent(NULL);
+		std::thread renderThread([&]() {
+			PROFILE_THREAD_NAME("render");
+			glfwMakeContextCurrent(window);
+			while (running) {
+				if (!snapshots.acquire()) {
+					// on demand, frames can be seconds apart: do not burn a core waiting
+					if (gOptions.onDemand)
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					else
+						std::this_thread::yield();
+					continue;
+				}
+				renderFrame(snapshots.getReadBuffer());
+				renderedFrame = snapshots.getReadBuffer().frame;
+			}
+			glfwMakeContextCurrent(NULL);
+		});
+
+		// Check if the ESC key was pressed or the window was closed
+		while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0) {
+			{
+				PROFILE_SCOPE("poll events");
+				glfwPollEvents();
+			}
+			if (waitWhileUnchanged())
+				continue;
+			presentedVersion = gChanges.getVersion();
+			simulateFrame(snapshots.getWriteBuffer());
+			unsigned int published = snapshots.getWriteBuffer().frame;
+			snapshots.publish();
+
+			// stay at most one snapshot ahead of the renderer, so input is never older than a frame
+			PROFILE_SCOPE("wait for render");
+			while (renderedFrame + 1 < published && running)
+				std::this_thread::yield();
+		}
+
+		running = false;
+		renderThread.join();
+		glfwMakeContextCurrent(window);
 	}
 
 	// Cleanup VBOs
-	glDeleteBuffers(1, &vertexBufferPlane); // plane
-	glDeleteBuffers(1, &normalBufferPlane);
-	glDeleteBuffers(1, &uvBufferPlane);
-	glDeleteBuffers(1, &vertexBufferPyramid); // pyramid
-	glDeleteBuffers(1, &normalBufferPyramid);
-	glDeleteBuffers(1, &uvBufferPyramid);
-	glDeleteBuffers(1, &interleavedBufferCap); // cap
-	glDeleteBuffers(1, &indexBufferCap);
-	glDeleteBuffers(1, &vertexBufferCube); // cube
-	glDeleteBuffers(1, &normalBufferCube);
-	glDeleteBuffers(1, &uvBufferCube);
-	glDeleteBuffers(1, &interleavedBufferContainer); //container
-	glDeleteBuffers(1, &indexBufferContainer);
-	glDeleteBuffers(1, &interleavedBufferBall); //ball
-	glDeleteBuffers(1, &indexBufferBall);
+	for (int i = 0; i < MESH_COUNT; ++i) {
+		glDeleteBuffers(1, &gpuMeshes[i].vertexBuffer);
+		if (gpuMeshes[i].indexBuffer)
+			glDeleteBuffers(1, &gpuMeshes[i].indexBuffer);
+	}
+	if (useVirtualTexture)
+		reportVirtualTexture(virtualTexture);
+	virtualTexture.release();
+	textureStreamer.release();
+	textureArrays.release();
+	occlusionQueries.release();
+	dynamicResolution.release();
+	frameTimeline.release();
+	if (profiler) {
+		profiler->dump(stdout);
+		profiler->release();
+	}
 
 	glDeleteProgram(programId);
+	if (feedbackProgramId)
+		glDeleteProgram(feedbackProgramId);
+	gHeadless.destroy();
+
+	if (gOptions.recordPath && recordedPath.save(gOptions.recordPath))
+		std::cout << "Camera path of " << recordedPath.getKeyCount() << " keys written to " << gOptions.recordPath << std::endl;
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
-	return 0;
+	if (writeTraceOnExit && !PROFILE_WRITE_TRACE(gOptions.traceFile))
+		std::cout << "No CPU trace written (profiler compiled out or file not writable)" << std::endl;
+
+	return exitCode;
+}
+
+// Parse the command line options
+bool parseCommandLine(int argc, char* argv[], bool& writeTrace) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--objects" && i + 1 < argc)
+			gOptions.clutterObjects = atoi(argv[++i]);
+		else if (arg == "--render-thread")
+			gOptions.renderThread = true;
+		else if (arg == "--frame-budget" && i + 1 < argc)
+			gOptions.frameBudget = atof(argv[++i]);
+		else if (arg == "--resolution-log" && i + 1 < argc)
+			gOptions.resolutionLog = argv[++i];
+		else if (arg == "--on-demand")
+			gOptions.onDemand = true;
+		else if (arg == "--idle-timeout" && i + 1 < argc)
+			gOptions.idleTimeout = atof(argv[++i]);
+		else if (arg == "--fps" && i + 1 < argc)
+			gOptions.targetRate = atof(argv[++i]);
+		else if (arg == "--vsync" && i + 1 < argc && parseVsyncMode(argv[i + 1], gOptions.vsync))
+			++i;
+		else if (arg == "--frame-log" && i + 1 < argc)
+			gOptions.frameLog = argv[++i];
+		else if (arg == "--gpu-profile")
+			gOptions.gpuProfile = true;
+		else if (arg == "--trace" && i + 1 < argc) {
+			gOptions.traceFile = argv[++i];
+			writeTrace = true;
+		}
+		else if (arg == "--headless")
+			gOptions.headless = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			gOptions.headlessFrames = atoi(argv[++i]);
+		else if (arg == "--output" && i + 1 < argc)
+			gOptions.outputPattern = argv[++i];
+		else if (arg == "--benchmark" && i + 1 < argc)
+			gOptions.benchmarkPath = argv[++i];
+		else if (arg == "--timestep" && i + 1 < argc)
+			gOptions.timestep = atof(argv[++i]);
+		else if (arg == "--warmup" && i + 1 < argc)
+			gOptions.warmupFrames = atoi(argv[++i]);
+		else if (arg == "--benchmark-output" && i + 1 < argc)
+			gOptions.benchmarkOutput = argv[++i];
+		else if (arg == "--record-path" && i + 1 < argc)
+			gOptions.recordPath = argv[++i];
+		else if (arg == "--software")
+			gOptions.software = true;
+		else if (arg == "--regress" && i + 1 < argc)
+			gOptions.regressionSuite = argv[++i];
+		else if (arg == "--update-golden")
+			gOptions.updateGolden = true;
+		else if (arg == "--no-texture-cache")
+			gOptions.textureCache = false;
+		else if (arg == "--compile-textures")
+			gOptions.compileTextures = true;
+		else if (arg == "--upload-budget" && i + 1 < argc)
+			gOptions.uploadBudget = atof(argv[++i]);
+		else if (arg == "--texture-budget" && i + 1 < argc)
+			gOptions.textureBudget = atof(argv[++i]);
+		else if (arg == "--asset-pack" && i + 1 < argc)
+			gOptions.assetPack = argv[++i];
+		else if (arg == "--pack-assets" && i + 1 < argc)
+			gOptions.packAssets = argv[++i];
+		else if (arg == "--max-texture-size" && i + 1 < argc)
+			gOptions.maxTextureSize = atoi(argv[++i]);
+		else if (arg == "--virtual-texture" && i + 1 < argc)
+			gOptions.virtualTexture = atof(argv[++i]);
+		else if (arg == "--no-program-cache")
+			gOptions.programCache = false;
+		else if (arg == "--no-time-budgets")
+			gOptions.timeBudgets = false;
+		else {
+			std::cout << "Unknown option " << arg << std::endl;
+			std::cout << "Usage: Project [--objects N] [--render-thread] [--frame-budget MS] [--resolution-log FILE] [--on-demand] [--idle-timeout S]" << std::endl;
+			std::cout << "               [--fps N] [--vsync off|on|adaptive] [--frame-log FILE] [--gpu-profile] [--trace FILE]" << std::endl;
+			std::cout << "               [--headless] [--frames N] [--output PATTERN]" << std::endl;
+			std::cout << "               [--benchmark FILE] [--timestep S] [--warmup N] [--benchmark-output FILE] [--record-path FILE]" << std::endl;
+			std::cout << "               [--software] [--regress FILE] [--update-golden] [--no-time-budgets] [--no-texture-cache]" << std::endl;
+			std::cout << "               [--upload-budget MB] [--texture-budget MB] [--asset-pack FILE] [--pack-assets FILE]" << std::endl;
+			std::cout << "               [--compile-textures] [--max-texture-size N] [--virtual-texture MB] [--no-program-cache]" << std::endl;
+			return false;
+		}
+	}
+	return true;
 }
 
 // Initialize GLFW, GLEW, and the window
 int initializeWindow() {
+	PROFILE_SCOPE("initializeWindow");
+
 	// Initialise GLFW
 	if (!glfwInit()) {
 		fprintf(stderr, "Failed to initialize GLFW\n");
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
+	// with dynamic resolution the offscreen target is multisampled instead;
+	// a multisampled window could not be the target of the scaling blit
+	glfwWindowHint(GLFW_SAMPLES, gOptions.frameBudget > 0.0 ? 0 : MSAA_SAMPLES);
 
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, NULL, NULL);
@@ -933,15 +1143,30 @@ int initializeWindow() {
 	glfwMakeContextCurrent(window);
 	glfwSetCursorPosCallback(window, mousePositionCallback);
 
+	// vsync/adaptive vsync applies to the context current on this thread
+	const char* const vsyncNames[] = { "off", "on", "adaptive" };
+	gOptions.vsync = setSwapInterval(gOptions.vsync);
+	std::cout << "Vsync " << vsyncNames[gOptions.vsync] << std::endl;
+
 	// Ensure we can capture the keyboard and mouse
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetKeyCallback(window, keyCallback);
 	glfwSetScrollCallback(window, mouseScrollCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
 
 	return 0;
 }
 
+// Create an offscreen context and framebuffer, for machines without a display
+int initializeHeadless() {
+	PROFILE_SCOPE("initializeHeadless");
+
+	if (!gHeadless.create(WIDTH, HEIGHT))
+		return -1;
+	return 0;
+}
+
 // Processes key inputs continuously
 void processKeyInput(GLFWwindow* window) {
 	float cameraSpeed = 2.5f;
@@ -961,6 +1186,193 @@ void processKeyInput(GLFWwindow* window) {
 		gCamera.ProcessKeyboard(UP, gDeltaTime);
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
 		gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+
+	if (isCameraKeyHeld(window))
+		gChanges.markChanged(CHANGE_CAMERA);
+}
+
+// True while one of the camera movement keys is down
+bool isCameraKeyHeld(GLFWwindow* window) {
+	const int keys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E };
+	for (int key : keys) {
+		if (glfwGetKey(window, key) == GLFW_PRESS)
+			return true;
+	}
+	return false;
+}
+
+// Moves the camera to a key of a camera path
+void applyCameraKey(const CameraKey& key) {
+	gCamera.Position = key.position;
+	gCamera.Yaw = key.yaw;
+	gCamera.Pitch = key.pitch;
+	gCamera.Zoom = key.fov;
+	gCamera.ProcessMouseMovement(0.0f, 0.0f); // recomputes the camera vectors from yaw and pitch
+	gIsPerspective = key.perspective;
+	gChanges.markChanged(CHANGE_CAMERA);
+}
+
+// The current camera as a camera path key
+CameraKey getCameraKey(double time) {
+	CameraKey key;
+	key.time = time;
+	key.position = gCamera.Position;
+	key.yaw = gCamera.Yaw;
+	key.pitch = gCamera.Pitch;
+	key.fov = gCamera.Zoom;
+	key.perspective = gIsPerspective;
+	return key;
+}
+
+// Projection of the current camera and projection mode
+glm::mat4 getProjection() {
+	float scale = 75;
+	if (gIsPerspective)
+		return glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+	else
+		return glm::ortho(-(GLfloat)WIDTH / scale, (GLfloat)WIDTH / scale, -(GLfloat)HEIGHT / scale, (GLfloat)HEIGHT / scale, -50.0f, 50.0f);
+}
+
+// Adds the settings every benchmark shares and writes the JSON results
+void writeBenchmarkResults(BenchmarkRecorder& results, const char* renderer) {
+	results.addSetting("path", gOptions.benchmarkPath);
+	results.addSetting("timestep", gOptions.timestep);
+	results.addSetting("renderer", renderer);
+	results.addSetting("width", WIDTH);
+	results.addSetting("height", HEIGHT);
+	results.addSetting("clutterObjects", gOptions.clutterObjects);
+
+	FILE* file = gOptions.benchmarkOutput ? fopen(gOptions.benchmarkOutput, "w") : stdout;
+	if (!file) {
+		std::cout << "Failed to open " << gOptions.benchmarkOutput << " for writing" << std::endl;
+		return;
+	}
+	results.writeJson(file, gOptions.warmupFrames);
+	if (file != stdout) {
+		fclose(file);
+		std::cout << "Benchmark results written to " << gOptions.benchmarkOutput << std::endl;
+	}
+}
+
+// Renders --frames N frames on the CPU, along a camera path if there is one,
+// and reports the throughput of the software rasterizer
+int runSoftwareRenderer(const CameraPath* path, ThreadPool& threadPool, TextureLoader& textureLoader) {
+	Scene scene;
+	if (gOptions.clutterObjects > 0)
+		scene.addClutter(gOptions.clutterObjects);
+
+	SoftwareRasterizer rasterizer(WIDTH, HEIGHT, &threadPool);
+	rasterizer.setLight(0, LIGHT0_POSITION, LIGHT0_COLOR);
+	rasterizer.setLight(1, LIGHT1_POSITION, LIGHT1_COLOR);
+	rasterizer.setClearColor(CLEAR_COLOR);
+
+	// the same decoded images the GL path uploads
+	int i;
+	while (textureLoader.next(i)) {
+		const TextureImage& image = textureLoader.getImage(i);
+		if (image.source != i)
+			continue;
+		if (!rasterizer.setTexture(i, image.pixels, image.width, image.height, image.channels)) {
+			std::cout << "Failed to load texture " << image.filename << std::endl;
+			return -1;
+		}
+		textureLoader.freeImage(i);
+	}
+
+	// frustum culling and state sorting as on the GL path
+	DrawListRecorder drawListRecorder(&threadPool);
+	drawListRecorder.setScene(&scene);
+	std::vector<DrawPacket> packets;
+
+	std::cout << "Software renderer: " << WIDTH << "x" << HEIGHT << ", " << threadPool.getThreadCount() << " threads" << std::endl;
+	BenchmarkRecorder results;
+	double totalTime = 0.0, renderTime = 0.0;
+	long long totalTriangles = 0, totalPixels = 0;
+	int frames = 0;
+	for (int i = 0; i < gOptions.headlessFrames; ++i) {
+		double start = getFrameClock();
+		if (path)
+			applyCameraKey(path->sample(i * gOptions.timestep));
+		glm::mat4 view = gCamera.GetViewMatrix();
+		glm::mat4 projection = getProjection();
+
+		drawListRecorder.record(projection * view);
+		drawListRecorder.getPackets(packets);
+		rasterizer.beginFrame(view, projection, gCamera.Position);
+		for (size_t k = 0; k < packets.size(); ++k)
+			rasterizer.drawMesh(&scene.getMesh(packets[k].getMesh()), packets[k].model,
+				textureLoader.getImage(packets[k].getTexture()).source);
+		rasterizer.render();
+		double frameTime = (getFrameClock() - start) * 1000.0;
+		++frames;
+
+		double stageTime = rasterizer.getGeometryTime() + rasterizer.getBinningTime() + rasterizer.getRasterTime();
+		totalTime += frameTime;
+		renderTime += stageTime;
+		totalTriangles += rasterizer.getTriangleCount();
+		totalPixels += rasterizer.getPixelCount();
+		if (path)
+			results.addFrame(frameTime, stageTime, 0.0, rasterizer.getDrawCount(), rasterizer.getTriangleCount());
+		else
+			printf("frame %d: %.3f ms (geometry %.3f ms, binning %.3f ms, raster %.3f ms) | %lld triangles, %d set up, %lld pixels\n",
+				i, frameTime, rasterizer.getGeometryTime(), rasterizer.getBinningTime(), rasterizer.getRasterTime(),
+				rasterizer.getTriangleCount(), rasterizer.getSetupTriangleCount(), rasterizer.getPixelCount());
+
+		if (gOptions.outputPattern) {
+			char filename[1024];
+			snprintf(filename, sizeof(filename), gOptions.outputPattern, i);
+			if (!HeadlessContext::writePPM(filename, WIDTH, HEIGHT, rasterizer.getColorBuffer()))
+				break;
+		}
+	}
+
+	// throughput over the rasterizer stages only, without culling and recording
+	if (frames > 0 && renderTime > 0.0)
+		printf("%d frames: avg %.3f ms | %.2f M triangles/s, %.2f M pixels/s\n", frames, totalTime / frames,
+			totalTriangles / (renderTime * 1000.0), totalPixels / (renderTime * 1000.0));
+	if (path)
+		writeBenchmarkResults(results, "software");
+	return 0;
+}
+
+// Compiles every scene texture to its .ctex file, spreading the block
+// encoding of each image over the thread pool
+int compileTextures(ThreadPool& threadPool, TextureLoader& textureLoader) {
+	int failed = 0, i;
+	size_t sourceBytes = 0, compressedBytes = 0;
+	double start = getFrameClock();
+	while (textureLoader.next(i)) {
+		const TextureImage& image = textureLoader.getImage(i);
+		if (image.source != i) {
+			printf("  %-36s    same contents as %s\n", image.filename.c_str(), textureLoader.getImage(image.source).filename.c_str());
+			continue;
+		}
+		if (!image.pixels) {
+			std::cout << "Failed to load texture " << image.filename << std::endl;
+			++failed;
+			continue;
+		}
+
+		double compileStart = getFrameClock();
+		CompressedTexture compressed;
+		compressed.compile(image.pixels, image.width, image.height, image.channels, &threadPool);
+		compressed.setSource(image.fileSize, image.fileHash);
+		std::string cacheFilename = CompressedTexture::getCacheFilename(image.filename);
+		if (!compressed.save(cacheFilename.c_str()))
+			++failed;
+
+		size_t uncompressedSize = (size_t)image.width * image.height * image.channels;
+		printf("  %-36s -> %s, %d levels, %.1f KB, %.2f ms\n", cacheFilename.c_str(),
+			compressed.getFormat() == COMPRESSED_BC3 ? "BC3" : "BC1", compressed.getLevelCount(),
+			compressed.getDataSize() / 1024.0, (getFrameClock() - compileStart) * 1000.0);
+		sourceBytes += uncompressedSize;
+		compressedBytes += compressed.getDataSize();
+		textureLoader.freeImage(i);
+	}
+	printf("Compiled %d textures on %d threads in %.2f ms: %.1f MB of pixels -> %.1f MB with all levels\n",
+		textureLoader.getImageCount() - textureLoader.getContentHits() - failed, threadPool.getThreadCount(), (getFrameClock() - start) * 1000.0,
+		sourceBytes / (1024.0 * 1024.0), compressedBytes / (1024.0 * 1024.0));
+	return failed ? 1 : 0;
 }
 
 // Callback for when the users moves the mouse
@@ -978,72 +1390,171 @@ void mousePositionCallback(GLFWwindow* window, double xpos, double ypos) {
 	gLastY = ypos;
 
 	gCamera.ProcessMouseMovement(xoffset, yoffset);
+	gChanges.markChanged(CHANGE_CAMERA);
 }
 
 // Callback for when the user uses the mouse scroll
 void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
 	gCamera.ProcessMouseScroll(yoffset);
+	gChanges.markChanged(CHANGE_CAMERA);
 }
 
 // Callback for when the user uses the P key (applicable for single presses) 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
 		gIsPerspective = !gIsPerspective;
+		gChanges.markChanged(CHANGE_SETTINGS);
+	}
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		gOcclusionCulling = !gOcclusionCulling;
+		gChanges.markChanged(CHANGE_SETTINGS);
+		std::cout << "Occlusion culling " << (gOcclusionCulling ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+		gOcclusionQueries = !gOcclusionQueries;
+		gChanges.markChanged(CHANGE_SETTINGS);
+		std::cout << "Occlusion queries " << (gOcclusionQueries ? "on" : "off") << std::endl;
+	}
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		if (!PROFILE_WRITE_TRACE(gOptions.traceFile))
+			std::cout << "No CPU trace written (profiler compiled out or file not writable)" << std::endl;
+	}
+	if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		if (gOptions.gpuProfile) {
+			gDumpGpuProfile = true;
+			gChanges.markChanged(CHANGE_SETTINGS); // the dump happens on the next rendered frame
+		}
+		else
+			std::cout << "GPU profiling is off, start with --gpu-profile" << std::endl;
+	}
 }
 
-// Flips the Y axis, because images are loaded with Y axis going down, but OpenGL's Y axis goes up.
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-	for (int j = 0; j < height / 2; ++j)
-	{
-		int index1 = j * width * channels;
-		int index2 = (height - 1 - j) * width * channels;
-
-		for (int i = width * channels; i > 0; --i)
-		{
-			unsigned char tmp = image[index1];
-			image[index1] = image[index2];
-			image[index2] = tmp;
-			++index1;
-			++index2;
-		}
+// Writes the shaders, the scene textures and their .ctex files, compiled by
+// the loader where they were missing or out of date, to one asset pack
+int packAssets(TextureLoader& textureLoader) {
+	AssetPackWriter writer;
+	bool ok = writer.addFile(VERTEX_SHADER_FILE) && writer.addFile(FRAGMENT_SHADER_FILE);
+	int i;
+	while (textureLoader.next(i)) {
+		const TextureImage& image = textureLoader.getImage(i);
+		ok = writer.addFile(image.filename) && ok;
+		if (image.source == i && image.compressed.isValid())
+			ok = writer.addFile(CompressedTexture::getCacheFilename(image.filename)) && ok;
+		textureLoader.freeImage(i);
 	}
+	if (!ok || !writer.write(gOptions.packAssets))
+		return 1;
+	printf("Packed %d assets into %s\n", writer.getAssetCount(), gOptions.packAssets);
+	return 0;
 }
 
-// Generate and load the textures
-bool createTexture(const char* filename, GLuint& textureId) {
-	int width, height, channels;
-	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-	if (image) {
-		flipImageVertically(image, width, height, channels);
-
-		glGenTextures(1, &textureId);
-		glBindTexture(GL_TEXTURE_2D, textureId);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (channels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		else if (channels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else {
-			std::cout << "Not implemented to handle image with " << channels << " channels" << std::endl;
-			return false;
-		}
+// Callback for when the window contents were damaged, e.g. uncovered or resized
+void windowRefreshCallback(GLFWwindow* window) {
+	gChanges.markChanged(CHANGE_WINDOW);
+}
 
-		glGenerateMipmap(GL_TEXTURE_2D);
+// Prints load time and array layer per texture, then the whole batch
+void reportTextureTimes(const TextureLoader& loader, const TextureArrays& arrays, const TextureStreamer& streamer) {
+	double decodeTime = 0.0;
+	for (int i = 0; i < loader.getImageCount(); ++i) {
+		const TextureImage& image = loader.getImage(i);
+		const TextureLayer& layer = arrays.getTarget(i);
+		const char* origin = image.source != i ? "shared" : image.cached ? "cached" : loader.getCompressedCache() ? "compiled" : "decoded";
+		printf("  %-36s %5dx%-5d %d ch %-8s | load %7.2f ms | array %d layer %d\n", image.filename.c_str(),
+			image.width, image.height, image.channels, origin, image.decodeTime, layer.array, layer.layer);
+		decodeTime += image.decodeTime;
+	}
+	// array 0 is the placeholder
+	for (int i = 1; i < arrays.getArrayCount(); ++i) {
+		int width, height, layerCount;
+		arrays.getArraySize(i, width, height, layerCount);
+		printf("  array %d: %dx%d, %d layers\n", i, width, height, layerCount);
+	}
+	printf("  %d of %d textures shared the contents of another one, %d loaded\n", loader.getContentHits(),
+		loader.getImageCount(), loader.getContentMisses());
+	printf("Textures ready %.2f ms after start: load %.2f ms on %d threads, upload %.2f ms of %.1f MB %s over %d frames"
+		" (at most %.2f ms in one), GL thread waited %.2f ms for the GPU\n", streamer.getCompleteTime(), decodeTime,
+		loader.getThreadCount(), streamer.getUploadTime(), streamer.getUploadedBytes() / (1024.0 * 1024.0),
+		streamer.isPersistent() ? "through a mapped buffer" : "from client memory", streamer.getFrameCount(),
+		streamer.getMaxFrameTime(), streamer.getWaitTime());
+}
 
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+// Prints how much of the virtual texture is in use and how it got there
+void reportVirtualTexture(const VirtualTexture& virtualTexture) {
+	const PageCache& pageCache = virtualTexture.getPageCache();
+	printf("Virtual texture: %d of %d pages resident (%.1f of %.1f MB), %d uploaded, %d evicted | page cache %.1f MB, %d loaded, %d hits\n",
+		virtualTexture.getResidentPages(), virtualTexture.getTileCount(), virtualTexture.getResidentSize() / (1024.0 * 1024.0),
+		virtualTexture.getAtlasSize() / (1024.0 * 1024.0), virtualTexture.getUploadedPages(), virtualTexture.getEvictedPages(),
+		pageCache.getSize() / (1024.0 * 1024.0), pageCache.getLoadCount(), pageCache.getHitCount());
+}
 
-		return true;
+// Copy the interleaved vertex data (vertex/normal/uv) and index data of a mesh to VBOs
+void uploadMesh(const SceneMesh& mesh, GpuMesh& gpuMesh) {
+	glGenBuffers(1, &gpuMesh.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.interleavedVertices.size() * sizeof(float), mesh.interleavedVertices.data(), GL_STATIC_DRAW);
+
+	gpuMesh.indexBuffer = 0;
+	if (mesh.isIndexed()) {
+		glGenBuffers(1, &gpuMesh.indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
 	}
+	gpuMesh.count = mesh.getDrawCount();
 
-	// Error loading the image
-	return false;
-}
\ No newline at end of file
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Bind the VBOs of a mesh and point attribute arrays 0-2 at them
+void bindMesh(const GpuMesh& gpuMesh) {
+	glBindBuffer(GL_ARRAY_BUFFER, gpuMesh.vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh.indexBuffer);
+
+	// set attrib arrays with stride and offset
+	int stride = sizeof(float) * 8; // 32 bytes
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+}
+
+// Draw the mesh bound with bindMesh
+void drawBoundMesh(const GpuMesh& gpuMesh) {
+	if (gpuMesh.indexBuffer)
+		glDrawElements(GL_TRIANGLES, gpuMesh.count, GL_UNSIGNED_INT, (void*)0);
+	else
+		glDrawArrays(GL_TRIANGLES, 0, gpuMesh.count);
+}
+
+// Print the averaged frame stats once per second
+void reportFrameStats(double now) {
+	if (now - gFrameStats.lastReport < 1.0 || gFrameStats.frames == 0)
+		return;
+
+	double frames = gFrameStats.frames;
+	double intervals = std::max(1, gFrameStats.frameIntervals);
+	double intervalMean = gFrameStats.frameInterval / intervals;
+	printf("%.1f fps | frame %.2f ms (jitter %.2f, max %.2f) | cpu %.2f ms, gpu %.2f ms | scale %.2f | latency %.2f ms (max %.2f) | drawn %.1f | record %.3f ms | frustum culled %.1f | occlusion culled %.1f (raster %.3f ms, test %.3f ms) | queries %.1f, conditional %.1f | textures %.1f MB, %d levels evicted\n",
+		frames / (now - gFrameStats.lastReport),
+		intervalMean,
+		sqrt(std::max(0.0, gFrameStats.frameIntervalSquares / intervals - intervalMean * intervalMean)),
+		gFrameStats.maxFrameInterval,
+		gFrameStats.cpuTime / frames,
+		gFrameStats.gpuTime / std::max(1, gFrameStats.gpuFrames),
+		gFrameStats.resolutionScale / frames,
+		gFrameStats.latency / frames,
+		gFrameStats.maxLatency,
+		gFrameStats.drawnObjects / frames,
+		gFrameStats.recordTime / frames,
+		gFrameStats.frustumCulledObjects / frames,
+		gFrameStats.culledObjects / frames,
+		gFrameStats.occlusionRasterTime / frames,
+		gFrameStats.occlusionTestTime / frames,
+		gFrameStats.occlusionQueries / frames,
+		gFrameStats.conditionalObjects / frames,
+		gFrameStats.residentTextures,
+		gFrameStats.evictedLevels);
+
+	gFrameStats = FrameStats();
+	gFrameStats.lastReport = now;
+}
@@ -1,6 +1,14 @@
 /* stb_image - v2.27 - public domain image loader - http://nothings.org/stb
                                   no warranty implied; use at your own risk
 
+   LOCAL CHANGES:
+      This copy is stock v2.27 plus stb_image_jpeg_scale.patch (next to this
+      file), which decodes JPEGs at 1/2, 1/4 or 1/8 size straight from the
+      DCT coefficients: stbi_set_jpeg_scale(), stbi_set_jpeg_scale_thread(),
+      stbi__jpeg::scale_shift and the reduced IDCTs stbi__idct_4x4/2x2/1x1.
+      Apply the patch again (git apply -p1 from the repository root) after
+      updating this file.
+
    Do this:
       #define STB_IMAGE_IMPLEMENTATION
    before you include this file in *one* C or C++ file to create the implementation.
@@ -521,6 +529,12 @@ extern "C" {
     STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
     STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+    // decode JPEGs at 1/2, 1/4 or 1/8 of their size (shift 1 to 3) straight
+    // from the DCT coefficients, with an IDCT of the low frequencies only;
+    // the size rounds up. 0 decodes the full size, other formats ignore it.
+    STBIDEF void stbi_set_jpeg_scale(int shift);
+    STBIDEF void stbi_set_jpeg_scale_thread(int shift);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen);
@@ -1114,6 +1128,27 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_scale_global = 0;
+
+STBIDEF void stbi_set_jpeg_scale(int shift)
+{
+    stbi__jpeg_scale_global = shift;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale  stbi__jpeg_scale_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_local, stbi__jpeg_scale_set;
+
+STBIDEF void stbi_set_jpeg_scale_thread(int shift)
+{
+    stbi__jpeg_scale_local = shift;
+    stbi__jpeg_scale_set = 1;
+}
+
+#define stbi__jpeg_scale  (stbi__jpeg_scale_set ? stbi__jpeg_scale_local : stbi__jpeg_scale_global)
+#endif // STBI_THREAD_LOCAL
+
 static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1975,6 +2010,7 @@ typedef struct
 
     int scan_n, order[4];
     int restart_interval, todo;
+    int scale_shift; // blocks decode to (8 >> scale_shift) pixels square
 
     // kernels
     void (*idct_block_kernel)(stbi_uc* out, int out_stride, short data[64]);
@@ -2502,6 +2538,56 @@ static void stbi__idct_block(stbi_uc* out, int out_stride, short data[64])
     }
 }
 
+// reduced IDCTs for scaled decoding: an NxN block from the NxN lowest
+// frequencies, normalized like the 8x8 one so the block average is kept
+// (as libjpeg's jidctred). basis[x * N + u] = C(u) * cos((2x + 1) u pi / 2N)
+static void stbi__idct_reduced(stbi_uc* out, int out_stride, short data[64], const float* basis, int n)
+{
+    float tmp[16];
+    int x, y, u, v;
+    // columns, then rows
+    for (u = 0; u < n; ++u) {
+        for (y = 0; y < n; ++y) {
+            float sum = 0.0f;
+            for (v = 0; v < n; ++v)
+                sum += basis[y * n + v] * data[v * 8 + u];
+            tmp[y * n + u] = sum;
+        }
+    }
+    for (y = 0; y < n; ++y, out += out_stride) {
+        for (x = 0; x < n; ++x) {
+            float sum = 0.0f;
+            for (u = 0; u < n; ++u)
+                sum += basis[x * n + u] * tmp[y * n + u];
+            out[x] = stbi__clamp((int)(sum * 0.25f + 128.5f)); // truncation only differs below 0, clamped anyway
+        }
+    }
+}
+
+static void stbi__idct_4x4(stbi_uc* out, int out_stride, short data[64])
+{
+    static const float basis[16] = {
+        0.707106781f, 0.923879533f, 0.707106781f, 0.382683432f,
+        0.707106781f, 0.382683432f, -0.707106781f, -0.923879533f,
+        0.707106781f, -0.382683432f, -0.707106781f, 0.923879533f,
+        0.707106781f, -0.923879533f, 0.707106781f, -0.382683432f
+    };
+    stbi__idct_reduced(out, out_stride, data, basis, 4);
+}
+
+static void stbi__idct_2x2(stbi_uc* out, int out_stride, short data[64])
+{
+    static const float basis[4] = { 0.707106781f, 0.707106781f, 0.707106781f, -0.707106781f };
+    stbi__idct_reduced(out, out_stride, data, basis, 2);
+}
+
+static void stbi__idct_1x1(stbi_uc* out, int out_stride, short data[64])
+{
+    STBI_NOTUSED(out_stride);
+    // DC / 8 is the average of the block
+    out[0] = stbi__clamp((data[0] + 4 + (128 << 3)) >> 3);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2927,6 +3013,7 @@ static void stbi__jpeg_reset(stbi__jpeg* j)
 
 static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
 {
+    const int bs = 8 >> z->scale_shift; // pixels per block side in the output
     stbi__jpeg_reset(z);
     if (!z->progressive) {
         if (z->scan_n == 1) {
@@ -2943,7 +3030,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
                 for (i = 0; i < w; ++i) {
                     int ha = z->img_comp[n].ha;
                     if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * bs + i * bs, z->img_comp[n].w2, data);
                     // every data block is an MCU, so countdown the restart interval
                     if (--z->todo <= 0) {
                         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2968,8 +3055,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
                         // by the basic H and V specified for the component
                         for (y = 0; y < z->img_comp[n].v; ++y) {
                             for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i * z->img_comp[n].h + x) * 8;
-                                int y2 = (j * z->img_comp[n].v + y) * 8;
+                                int x2 = (i * z->img_comp[n].h + x) * bs;
+                                int y2 = (j * z->img_comp[n].v + y) * bs;
                                 int ha = z->img_comp[n].ha;
                                 if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
                                 z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
@@ -3062,6 +3149,7 @@ static void stbi__jpeg_dequantize(short* data, stbi__uint16* dequant)
 
 static void stbi__jpeg_finish(stbi__jpeg* z)
 {
+    const int bs = 8 >> z->scale_shift;
     if (z->progressive) {
         // dequantize and idct the data
         int i, j, n;
@@ -3072,7 +3160,7 @@ static void stbi__jpeg_finish(stbi__jpeg* z)
                 for (i = 0; i < w; ++i) {
                     short* data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                     stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * bs + i * bs, z->img_comp[n].w2, data);
                 }
             }
         }
@@ -3314,8 +3402,8 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         //
         // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
         // so these muls can't overflow with 32-bit ints (which we require)
-        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
         z->img_comp[i].coeff = 0;
         z->img_comp[i].raw_coeff = 0;
         z->img_comp[i].linebuf = NULL;
@@ -3325,10 +3413,10 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         // align blocks for idct using mmx/sse
         z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
         if (z->progressive) {
-            // w2, h2 are multiples of 8 (see above)
-            z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-            z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+            // coefficients of every block, whatever the output scale
+            z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+            z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
             if (z->img_comp[i].raw_coeff == NULL)
                 return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
             z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3788,6 +3876,7 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc* out, stbi_uc const* y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg* j)
 {
+    j->scale_shift = 0;
     j->idct_block_kernel = stbi__idct_block;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
@@ -3841,6 +3930,17 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
     // load a jpeg image from whichever source, but leave in YCbCr format
     if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+    // the components were decoded scaled, resample and convert at that size
+    if (z->scale_shift) {
+        int k, round = (1 << z->scale_shift) - 1;
+        z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+        z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+        for (k = 0; k < z->s->img_n; ++k) {
+            z->img_comp[k].x = (z->img_comp[k].x + round) >> z->scale_shift;
+            z->img_comp[k].y = (z->img_comp[k].y + round) >> z->scale_shift;
+        }
+    }
+
     // determine actual number of components to generate
     n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -4010,6 +4110,11 @@ static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int re
     STBI_NOTUSED(ri);
     j->s = s;
     stbi__setup_jpeg(j);
+    if (stbi__jpeg_scale >= 1 && stbi__jpeg_scale <= 3) {
+        static void (* const reduced[3])(stbi_uc* out, int out_stride, short data[64]) = { stbi__idct_4x4, stbi__idct_2x2, stbi__idct_1x1 };
+        j->scale_shift = stbi__jpeg_scale;
+        j->idct_block_kernel = reduced[j->scale_shift - 1];
+    }
     result = load_jpeg_image(j, x, y, comp, req_comp);
     STBI_FREE(j);
     return result;